@@ -0,0 +1,360 @@
+//
+//  AssetLoadingBench.cpp
+//
+//  Times gps::Model3D loading a synthetic .obj/.mtl model, stage by stage (mesh cache, parse, vertex
+//  build, optimize, quantize, texture decode and, with --upload, the GL upload), over several runs,
+//  and writes the results as JSON so they can be compared across commits.
+//
+//  Build (from the repository root):
+//    g++ -O2 -std=c++11 -Isrc bench/AssetLoadingBench.cpp src/Model3D.cpp src/Mesh.cpp src/MeshCache.cpp
+//        src/MeshOptimizer.cpp src/MeshSimplifier.cpp src/MeshletBuilder.cpp src/VertexQuantizer.cpp
+//        src/ObjParser.cpp src/ThreadPool.cpp src/AssetManager.cpp src/TextureDecoder.cpp src/ImageProcessing.cpp
+//        src/Ktx2File.cpp src/Uploader.cpp src/GeometryArena.cpp src/GLStateCache.cpp src/IndirectRenderer.cpp
+//        src/Shader.cpp src/stb_image.cpp src/tiny_obj_loader.cpp -lGLEW -lglfw -lGL -lpthread -o assetLoadingBench
+//  Run:
+//    assetLoadingBench [--faces n] [--shapes n] [--materials n] [--texture-size n] [--repetitions n]
+//                      [--mesh-cache] [--upload] [--dir path] [--label text] [--output file.json] [--verbose]
+//
+//  --upload creates an invisible window, through OSMesa when GLFW supports it, so it also runs
+//  headless under Mesa (e.g. LIBGL_ALWAYS_SOFTWARE=1). The upload is skipped when no context can be made.
+//
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "Model3D.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+struct Config
+{
+    int faces;
+    int shapes;
+    int materials;
+    int textureSize;
+    int repetitions;
+    bool meshCache;
+    bool upload;
+    bool verbose;
+    std::string dir;
+    std::string label;
+    std::string output;
+};
+
+struct Stage
+{
+    const char* name;
+    std::vector<double> runs;
+};
+
+// Grid patches, one per shape, triangle count spread evenly; shape s uses material s % materials
+static bool writeObj(const Config& config, const std::string& objPath, int& vertexCount)
+{
+    std::ofstream obj(objPath.c_str());
+    if (!obj) {
+        return false;
+    }
+    obj << "mtllib synthetic.mtl\n";
+
+    vertexCount = 0;
+    int written = 0;
+    for (int s = 0; s < config.shapes; s++) {
+        int triangles = (config.faces - written) / (config.shapes - s);
+        written += triangles;
+        int quads = (triangles + 1) / 2;
+        int columns = std::max(1, (int)std::ceil(std::sqrt((double)quads)));
+        int rows = (quads + columns - 1) / columns;
+
+        obj << "o shape" << s << "\n";
+        if (config.materials > 0) {
+            obj << "usemtl material" << s % config.materials << "\n";
+        }
+        int first = vertexCount + 1;
+        for (int y = 0; y <= rows; y++) {
+            for (int x = 0; x <= columns; x++) {
+                // a gentle wave, so the normals and the simplifier have something to work with
+                float height = 0.25f * std::sin(x * 0.3f) * std::cos(y * 0.2f);
+                obj << "v " << s * (columns + 2) + x << " " << height << " " << y << "\n";
+                obj << "vn 0 1 0\n";
+                obj << "vt " << (float)x / columns << " " << (float)y / std::max(rows, 1) << "\n";
+                vertexCount++;
+            }
+        }
+        for (int t = 0; t < triangles; t++) {
+            int quad = t / 2;
+            int a = first + (quad / columns) * (columns + 1) + quad % columns;
+            int b = a + 1;
+            int c = a + columns + 1;
+            int d = c + 1;
+            int corners[2][3] = { { a, c, b }, { b, c, d } };
+            const int* corner = corners[t % 2];
+            obj << "f";
+            for (int k = 0; k < 3; k++) {
+                obj << " " << corner[k] << "/" << corner[k] << "/" << corner[k];
+            }
+            obj << "\n";
+        }
+    }
+    return (bool)obj;
+}
+
+static bool writeMtl(const Config& config, const std::string& mtlPath)
+{
+    std::ofstream mtl(mtlPath.c_str());
+    if (!mtl) {
+        return false;
+    }
+    for (int m = 0; m < config.materials; m++) {
+        mtl << "newmtl material" << m << "\nKa 1 1 1\nKd 1 1 1\nKs 0.5 0.5 0.5\n";
+        if (config.textureSize > 0) {
+            mtl << "map_Kd texture" << m << ".ppm\n";
+        }
+    }
+    return (bool)mtl;
+}
+
+// Binary PPM, which stb_image decodes like the PNG/JPEG files of the scene
+static bool writeTexture(const std::string& path, int size, int seed)
+{
+    std::ofstream file(path.c_str(), std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    file << "P6\n" << size << " " << size << "\n255\n";
+    std::vector<unsigned char> row((size_t)size * 3);
+    unsigned int state = 12345u + seed;
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            state = state * 1664525u + 1013904223u;
+            row[x * 3 + 0] = (unsigned char)(x * 255 / size);
+            row[x * 3 + 1] = (unsigned char)(y * 255 / size);
+            row[x * 3 + 2] = (unsigned char)(state >> 24);
+        }
+        file.write((const char*)row.data(), row.size());
+    }
+    return (bool)file;
+}
+
+static double median(std::vector<double> values)
+{
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : 0.5 * (values[middle - 1] + values[middle]);
+}
+
+static std::string jsonString(const std::string& text)
+{
+    std::string quoted = "\"";
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '"' || text[i] == '\\') {
+            quoted += '\\';
+        }
+        quoted += text[i];
+    }
+    return quoted + "\"";
+}
+
+static GLFWwindow* createContext()
+{
+#ifdef GLFW_PLATFORM_NULL
+    // no display needed - the OSMesa context renders to memory
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+    if (!glfwInit()) {
+        return NULL;
+    }
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "assetLoadingBench", NULL, NULL);
+    if (!window) {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_NATIVE_CONTEXT_API);
+        window = glfwCreateWindow(64, 64, "assetLoadingBench", NULL, NULL);
+    }
+    if (!window) {
+        glfwTerminate();
+        return NULL;
+    }
+    glfwMakeContextCurrent(window);
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return NULL;
+    }
+    return window;
+}
+
+int main(int argc, const char* argv[])
+{
+    Config config;
+    config.faces = 200000;
+    config.shapes = 16;
+    config.materials = 4;
+    config.textureSize = 1024;
+    config.repetitions = 5;
+    config.meshCache = false;
+    config.upload = false;
+    config.verbose = false;
+    config.dir = "assetLoadingBench";
+    config.output = "assetLoadingBench.json";
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--faces" && hasValue) config.faces = atoi(argv[++i]);
+        else if (arg == "--shapes" && hasValue) config.shapes = atoi(argv[++i]);
+        else if (arg == "--materials" && hasValue) config.materials = atoi(argv[++i]);
+        else if (arg == "--texture-size" && hasValue) config.textureSize = atoi(argv[++i]);
+        else if (arg == "--repetitions" && hasValue) config.repetitions = atoi(argv[++i]);
+        else if (arg == "--dir" && hasValue) config.dir = argv[++i];
+        else if (arg == "--label" && hasValue) config.label = argv[++i];
+        else if (arg == "--output" && hasValue) config.output = argv[++i];
+        else if (arg == "--mesh-cache") config.meshCache = true;
+        else if (arg == "--upload") config.upload = true;
+        else if (arg == "--verbose") config.verbose = true;
+        else {
+            fprintf(stderr, "usage: %s [--faces n] [--shapes n] [--materials n] [--texture-size n] [--repetitions n]\n"
+                "       [--mesh-cache] [--upload] [--dir path] [--label text] [--output file.json] [--verbose]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    config.faces = std::max(config.faces, 1);
+    config.shapes = std::max(std::min(config.shapes, config.faces), 1);
+    config.materials = std::max(config.materials, 0);
+    config.repetitions = std::max(config.repetitions, 1);
+
+    mkdir(config.dir.c_str(), 0755);
+    std::string objPath = config.dir + "/synthetic.obj";
+    int vertexCount = 0;
+    bool written = writeObj(config, objPath, vertexCount) && writeMtl(config, config.dir + "/synthetic.mtl");
+    for (int m = 0; written && config.textureSize > 0 && m < config.materials; m++) {
+        std::ostringstream path;
+        path << config.dir << "/texture" << m << ".ppm";
+        written = writeTexture(path.str(), config.textureSize, m);
+    }
+    if (!written) {
+        fprintf(stderr, "ERROR: could not write the synthetic model to %s\n", config.dir.c_str());
+        return EXIT_FAILURE;
+    }
+    struct stat info;
+    long long objBytes = stat(objPath.c_str(), &info) == 0 ? (long long)info.st_size : 0;
+    remove((objPath + ".meshcache").c_str());
+
+    GLFWwindow* window = NULL;
+    if (config.upload) {
+        window = createContext();
+        if (!window) {
+            fprintf(stderr, "WARNING: no GL context, the upload is not measured\n");
+        }
+    }
+    gps::MeshCache::enabled = config.meshCache;
+
+    Stage stages[] = {
+        { "cache", std::vector<double>() },
+        { "parse", std::vector<double>() },
+        { "build", std::vector<double>() },
+        { "optimize", std::vector<double>() },
+        { "quantize", std::vector<double>() },
+        { "textureDecode", std::vector<double>() },
+        { "upload", std::vector<double>() },
+        { "total", std::vector<double>() },
+    };
+    const size_t stageCount = sizeof(stages) / sizeof(stages[0]);
+    // null in the JSON without a context, rather than a misleading 0
+    const size_t UPLOAD_STAGE = 6;
+
+    // with the cache on, a first untimed load writes it so the timed ones read it
+    std::streambuf* coutBuffer = std::cout.rdbuf();
+    std::ostringstream discarded;
+    for (int r = config.meshCache ? -1 : 0; r < config.repetitions; r++) {
+        if (!config.verbose) {
+            std::cout.rdbuf(discarded.rdbuf());
+        }
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        double upload = 0.0;
+        {
+            // a new model each time - the asset of the last one is gone with it, so nothing is shared
+            gps::Model3D model;
+            model.Prepare(objPath, config.dir + "/");
+            if (window) {
+                model.UploadPending(std::chrono::high_resolution_clock::time_point::max(), NULL);
+                // the driver may defer the copies until the GPU needs them
+                glFinish();
+                upload = model.GetLoadTimings().upload;
+            }
+            std::chrono::duration<double, std::milli> total = std::chrono::high_resolution_clock::now() - start;
+
+            const gps::Model3D::LoadTimings& timings = model.GetLoadTimings();
+            double values[] = { timings.cache, timings.parse, timings.build, timings.optimize, timings.quantize,
+                timings.textureDecode, upload, total.count() };
+            for (size_t s = 0; r >= 0 && s < stageCount; s++) {
+                stages[s].runs.push_back(values[s]);
+            }
+        }
+        std::cout.rdbuf(coutBuffer);
+        discarded.str("");
+    }
+
+    printf("%d faces, %d shapes, %d materials, %dx%d textures, %d vertices (%.1f MB .obj), %d runs%s\n",
+        config.faces, config.shapes, config.materials, config.textureSize, config.textureSize, vertexCount,
+        objBytes / (1024.0 * 1024.0), config.repetitions, config.meshCache ? ", mesh cache" : "");
+    printf("%-14s %10s %10s\n", "stage", "min ms", "median ms");
+    for (size_t s = 0; s < stageCount; s++) {
+        if (s == UPLOAD_STAGE && !window) {
+            printf("%-14s %10s %10s\n", stages[s].name, "skipped", "skipped");
+            continue;
+        }
+        printf("%-14s %10.2f %10.2f\n", stages[s].name, *std::min_element(stages[s].runs.begin(), stages[s].runs.end()),
+            median(stages[s].runs));
+    }
+
+    FILE* json = fopen(config.output.c_str(), "w");
+    if (!json) {
+        fprintf(stderr, "ERROR: could not write %s\n", config.output.c_str());
+        return EXIT_FAILURE;
+    }
+    fprintf(json, "{\n  \"benchmark\": \"assetLoading\",\n  \"label\": %s,\n", jsonString(config.label).c_str());
+    fprintf(json, "  \"config\": { \"faces\": %d, \"shapes\": %d, \"materials\": %d, \"textureSize\": %d, \"repetitions\": %d, "
+        "\"meshCache\": %s, \"upload\": %s },\n", config.faces, config.shapes, config.materials, config.textureSize,
+        config.repetitions, config.meshCache ? "true" : "false", window ? "true" : "false");
+    fprintf(json, "  \"model\": { \"vertices\": %d, \"objBytes\": %lld },\n", vertexCount, objBytes);
+    fprintf(json, "  \"stages\": {\n");
+    for (size_t s = 0; s < stageCount; s++) {
+        if (s == UPLOAD_STAGE && !window) {
+            fprintf(json, "    \"%s\": null,\n", stages[s].name);
+            continue;
+        }
+        fprintf(json, "    \"%s\": { \"minMs\": %.4f, \"medianMs\": %.4f, \"runsMs\": [", stages[s].name,
+            *std::min_element(stages[s].runs.begin(), stages[s].runs.end()), median(stages[s].runs));
+        for (size_t r = 0; r < stages[s].runs.size(); r++) {
+            fprintf(json, "%s%.4f", r ? ", " : "", stages[s].runs[r]);
+        }
+        fprintf(json, "] }%s\n", s + 1 < stageCount ? "," : "");
+    }
+    fprintf(json, "  }\n}\n");
+    fclose(json);
+    printf("Results written to %s\n", config.output.c_str());
+
+    if (window) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,242 @@
+//
+//  MeshletConeTest.cpp
+//
+//  Checks the meshlet culling tests: the bounding sphere and normal cone gps::MeshletBuilder::ComputeBounds
+//  gives a cluster, gps::ClusterView::IsBackfacing against eyes all around it (a cluster reported as
+//  backfacing must have no triangle facing the eye), IsOutside against a perspective frustum, and the
+//  clusters whose normals spread over 90 degrees or more from their axis, which must never be culled.
+//  Exits with 1 when a check fails.
+//
+//  Build (from the repository root):
+//    g++ -O2 -std=c++11 -Isrc bench/MeshletConeTest.cpp src/Mesh.cpp src/MeshletBuilder.cpp src/GeometryArena.cpp
+//        src/GLStateCache.cpp src/Shader.cpp -lGLEW -lGL -o meshletConeTest
+//  Run:
+//    meshletConeTest
+//
+
+#include "MeshletBuilder.hpp"
+
+#include "glm.hpp"
+#include "gtc/matrix_transform.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool condition, const char* what)
+{
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+struct Cluster
+{
+    std::vector<gps::Vertex> vertices;
+    std::vector<GLuint> indices;
+
+    void AddTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c)
+    {
+        glm::vec3 corners[3] = { a, b, c };
+        for (int k = 0; k < 3; k++) {
+            gps::Vertex vertex = {};
+            vertex.Position = corners[k];
+            indices.push_back((GLuint)vertices.size());
+            vertices.push_back(vertex);
+        }
+    }
+
+    gps::Meshlet Bounds() const
+    {
+        return gps::MeshletBuilder::ComputeBounds(vertices.data(), indices.data(), indices.size());
+    }
+
+    // true when no triangle has its front side towards `eye` (w = 1), or the viewing direction (w = 0)
+    bool AllBackfacing(const glm::vec4& eye) const
+    {
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            const glm::vec3& p0 = vertices[indices[i]].Position;
+            glm::vec3 normal = glm::cross(vertices[indices[i + 1]].Position - p0, vertices[indices[i + 2]].Position - p0);
+            glm::vec3 toEye = eye.w != 0.0f ? glm::vec3(eye) / eye.w - p0 : -glm::vec3(eye);
+            if (glm::dot(normal, toEye) > 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Square of 2x2 triangles in the z = 0 plane facing +z, bent along x by `bend` radians on each side
+static Cluster bentSheet(float bend)
+{
+    Cluster cluster;
+    for (int side = -1; side <= 1; side += 2) {
+        glm::vec3 edge(side * std::cos(bend), 0.0f, -std::sin(bend));
+        glm::vec3 a(0.0f, -1.0f, 0.0f), b(0.0f, 1.0f, 0.0f);
+        glm::vec3 c = b + edge, d = a + edge;
+        if (side > 0) {
+            cluster.AddTriangle(a, c, b);
+            cluster.AddTriangle(a, d, c);
+        }
+        else {
+            cluster.AddTriangle(a, b, c);
+            cluster.AddTriangle(a, c, d);
+        }
+    }
+    return cluster;
+}
+
+// Eyes on spheres around the origin, the poles on the z axis included
+static std::vector<glm::vec4> eyesAround()
+{
+    std::vector<glm::vec4> eyes;
+    for (float distance = 0.5f; distance <= 20.0f; distance *= 2.0f) {
+        for (int i = 0; i < 24; i++) {
+            for (int j = 0; j <= 12; j++) {
+                float phi = 6.2831853f * i / 24.0f;
+                float theta = 3.1415927f * j / 12.0f;
+                eyes.push_back(glm::vec4(distance * std::sin(theta) * std::cos(phi), distance * std::sin(theta) * std::sin(phi),
+                    distance * std::cos(theta), 1.0f));
+            }
+        }
+    }
+    return eyes;
+}
+
+static void testBounds()
+{
+    Cluster cluster = bentSheet(0.5f);
+    gps::Meshlet meshlet = cluster.Bounds();
+    bool inside = true;
+    for (size_t v = 0; v < cluster.vertices.size(); v++) {
+        inside = inside && glm::distance(cluster.vertices[v].Position, meshlet.center) <= meshlet.radius * 1.0001f;
+    }
+    check(inside, "the bounding sphere holds every vertex");
+    check(meshlet.indexCount == (GLsizei)cluster.indices.size(), "the meshlet covers every index");
+    check(glm::dot(meshlet.coneAxis, glm::vec3(0.0f, 0.0f, 1.0f)) > 0.999f, "the cone axis is the mean normal");
+    check(std::fabs(meshlet.coneCutoff - std::sin(0.5f)) < 1e-4f, "the cutoff is the sine of the widest normal angle");
+}
+
+static void testBackfacing()
+{
+    const float bends[] = { 0.0f, 0.3f, 1.0f, 1.4f };
+    std::vector<glm::vec4> eyes = eyesAround();
+    for (size_t b = 0; b < sizeof(bends) / sizeof(bends[0]); b++) {
+        Cluster cluster = bentSheet(bends[b]);
+        gps::Meshlet meshlet = cluster.Bounds();
+        gps::ClusterView view;
+        view.cones = true;
+
+        size_t culled = 0;
+        bool conservative = true;
+        for (size_t e = 0; e < eyes.size(); e++) {
+            view.eye = eyes[e];
+            if (view.IsBackfacing(meshlet)) {
+                culled++;
+                conservative = conservative && cluster.AllBackfacing(eyes[e]);
+            }
+        }
+        check(conservative, "a backfacing cluster has no triangle facing the eye");
+        check(culled > 0, "some eye below the cluster culls it");
+
+        // straight below, and looking up at it from far away
+        view.eye = glm::vec4(0.0f, 0.0f, -10.0f, 1.0f);
+        check(view.IsBackfacing(meshlet), "the cluster is backfacing from below");
+        view.eye = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+        check(view.IsBackfacing(meshlet), "the cluster is backfacing to an orthographic view from below");
+        view.eye = glm::vec4(0.0f, 0.0f, 10.0f, 1.0f);
+        check(!view.IsBackfacing(meshlet), "the cluster faces an eye above it");
+
+        // a mirroring transform turns the front faces into back faces
+        view.eye = glm::vec4(0.0f, 0.0f, -10.0f, 1.0f);
+        gps::ClusterView mirrored = view.ToObjectSpace(glm::scale(glm::mat4(1.0f), glm::vec3(-1.0f, 1.0f, 1.0f)));
+        check(!mirrored.IsBackfacing(meshlet), "no cone culling through a mirroring transform");
+    }
+}
+
+static void testDegenerateCones()
+{
+    gps::ClusterView view;
+    view.cones = true;
+    std::vector<glm::vec4> eyes = eyesAround();
+
+    // bent down past 90 degrees on each side, with a triangle still facing up: the mean normal points down,
+    // the triangle on top 180 degrees from it
+    Cluster folded = bentSheet(2.0f);
+    folded.AddTriangle(glm::vec3(-0.2f, -0.2f, 0.1f), glm::vec3(0.2f, -0.2f, 0.1f), glm::vec3(0.0f, 0.2f, 0.1f));
+    // closed, the normals add up to nothing
+    Cluster tetrahedron;
+    glm::vec3 corners[4] = { glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.0f, -1.0f, -1.0f), glm::vec3(-1.0f, 1.0f, -1.0f),
+        glm::vec3(-1.0f, -1.0f, 1.0f) };
+    tetrahedron.AddTriangle(corners[0], corners[1], corners[2]);
+    tetrahedron.AddTriangle(corners[0], corners[3], corners[1]);
+    tetrahedron.AddTriangle(corners[0], corners[2], corners[3]);
+    tetrahedron.AddTriangle(corners[1], corners[3], corners[2]);
+    // two triangles back to back
+    Cluster flat;
+    flat.AddTriangle(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    flat.AddTriangle(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    // every triangle of zero area
+    Cluster collapsed;
+    collapsed.AddTriangle(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(2.0f, 0.0f, 0.0f));
+
+    const Cluster* clusters[] = { &folded, &tetrahedron, &flat, &collapsed };
+    for (int c = 0; c < 4; c++) {
+        gps::Meshlet meshlet = clusters[c]->Bounds();
+        check(meshlet.coneCutoff > 1.0f, "a cone of 90 degrees or more is marked as unusable");
+        bool culled = false;
+        for (size_t e = 0; e < eyes.size(); e++) {
+            view.eye = eyes[e];
+            culled = culled || view.IsBackfacing(meshlet);
+        }
+        check(!culled, "a cone of 90 degrees or more never culls");
+    }
+}
+
+static void testFrustum()
+{
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 100.0f);
+    glm::mat4 viewMatrix = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    gps::ClusterView view(projection * viewMatrix, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+    gps::Meshlet meshlet = bentSheet(0.0f).Bounds();
+    meshlet.center = glm::vec3(0.0f, 0.0f, -10.0f);
+    meshlet.radius = 1.0f;
+    check(!view.IsOutside(meshlet), "a cluster in front of the eye is inside");
+    meshlet.center = glm::vec3(0.0f, 0.0f, 10.0f);
+    check(view.IsOutside(meshlet), "a cluster behind the eye is outside");
+    meshlet.center = glm::vec3(50.0f, 0.0f, -10.0f);
+    check(view.IsOutside(meshlet), "a cluster far to the side is outside");
+    meshlet.center = glm::vec3(0.0f, 0.0f, -200.0f);
+    check(view.IsOutside(meshlet), "a cluster past the far plane is outside");
+    // the right plane is at x = z * tan(30 degrees); a sphere across it is kept
+    meshlet.center = glm::vec3(10.0f * std::tan(glm::radians(30.0f)) + 0.5f, 0.0f, -10.0f);
+    check(!view.IsOutside(meshlet), "a cluster across a plane is inside");
+
+    // the same test in the object space of a moved model
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -10.0f));
+    gps::ClusterView objectView = view.ToObjectSpace(model);
+    meshlet.center = glm::vec3(0.0f);
+    check(!objectView.IsOutside(meshlet), "a cluster at the origin of a model in front is inside");
+    meshlet.center = glm::vec3(0.0f, 0.0f, 20.0f);
+    check(objectView.IsOutside(meshlet), "a cluster of a model behind the eye is outside");
+}
+
+int main()
+{
+    testBounds();
+    testBackfacing();
+    testDegenerateCones();
+    testFrustum();
+
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("all checks passed\n");
+    return EXIT_SUCCESS;
+}
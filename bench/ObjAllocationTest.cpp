@@ -0,0 +1,190 @@
+//
+//  ObjAllocationTest.cpp
+//
+//  Counts the heap allocations of gps::Model3D::BuildMeshes, the step of ReadOBJ that turns the parsed
+//  .obj shapes into meshes, through a counting operator new. Synthetic models with more shapes, and more
+//  vertices per shape, must not allocate more: only the materials may add allocations, a fixed number
+//  each. Exits with 1 when the count grows with the shapes or vertices, or passes the bound.
+//
+//  Build (from the repository root):
+//    g++ -O2 -std=c++11 -Isrc bench/ObjAllocationTest.cpp src/Model3D.cpp src/Mesh.cpp src/MeshCache.cpp
+//        src/MeshOptimizer.cpp src/MeshSimplifier.cpp src/MeshletBuilder.cpp src/VertexQuantizer.cpp
+//        src/ObjParser.cpp src/ThreadPool.cpp src/AssetManager.cpp src/TextureDecoder.cpp src/ImageProcessing.cpp
+//        src/Ktx2File.cpp src/Uploader.cpp src/GeometryArena.cpp src/GLStateCache.cpp src/IndirectRenderer.cpp
+//        src/Shader.cpp src/stb_image.cpp src/tiny_obj_loader.cpp -lGLEW -lGL -lpthread -o objAllocationTest
+//  Run:
+//    objAllocationTest [--dir path]
+//
+
+#include "Model3D.hpp"
+#include "ObjParser.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Allocations that may be made per material: its bucket of faces, its indices and vertices, its textures
+static const size_t ALLOCATIONS_PER_MATERIAL = 8;
+// Allocations made once: the bucket tables, the weld arena and the meshes array
+static const size_t ALLOCATIONS_PER_BUILD = 12;
+
+static std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size)
+{
+    allocations++;
+    void* memory = malloc(size != 0 ? size : 1);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+// `shapes` grids of side x side vertices, two triangles per cell, the shapes cycling through `materials`
+// materials of a generated .mtl
+static void writeModel(const std::string& dir, const std::string& name, int shapes, int side, int materials)
+{
+    std::ofstream mtl((dir + "/" + name + ".mtl").c_str());
+    for (int m = 0; m < materials; m++) {
+        mtl << "newmtl material" << m << "\nKd 0.8 0.8 0.8\nmap_Kd texture" << m << ".png\n";
+    }
+
+    std::ofstream obj((dir + "/" + name + ".obj").c_str());
+    obj << "mtllib " << name << ".mtl\n";
+    int base = 1;
+    for (int s = 0; s < shapes; s++) {
+        obj << "o shape" << s << "\nusemtl material" << s % materials << "\n";
+        for (int y = 0; y < side; y++) {
+            for (int x = 0; x < side; x++) {
+                obj << "v " << x << " " << y << " " << s << "\nvn 0 0 1\nvt " << (float)x / side << " " << (float)y / side << "\n";
+            }
+        }
+        for (int y = 0; y + 1 < side; y++) {
+            for (int x = 0; x + 1 < side; x++) {
+                int a = base + y * side + x;
+                int corners[4] = { a, a + 1, a + side + 1, a + side };
+                obj << "f";
+                for (int k = 0; k < 3; k++) {
+                    obj << " " << corners[k] << "/" << corners[k] << "/" << corners[k];
+                }
+                obj << "\nf";
+                for (int k = 0; k < 4; k++) {
+                    if (k != 1) {
+                        obj << " " << corners[k] << "/" << corners[k] << "/" << corners[k];
+                    }
+                }
+                obj << "\n";
+            }
+        }
+        base += side * side;
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    std::string dir = ".";
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--dir" && i + 1 < argc) {
+            dir = argv[++i];
+        }
+    }
+
+    const int shapeCounts[] = { 10, 40 };
+    const int sides[] = { 8, 32 };
+    const int materialCounts[] = { 1, 4 };
+
+    bool failed = false;
+    for (int m = 0; m < 2; m++) {
+        size_t first = 0;
+        for (int s = 0; s < 2; s++) {
+            for (int v = 0; v < 2; v++) {
+                std::ostringstream name;
+                name << "allocationTest" << shapeCounts[s] << "x" << sides[v] << "x" << materialCounts[m];
+                writeModel(dir, name.str(), shapeCounts[s], sides[v], materialCounts[m]);
+
+                tinyobj::attrib_t attrib;
+                std::vector<tinyobj::shape_t> shapes;
+                std::vector<tinyobj::material_t> materials;
+                std::string err;
+                std::string path = dir + "/" + name.str() + ".obj";
+                if (!gps::ObjParser::LoadObj(&attrib, &shapes, &materials, &err, path.c_str(), (dir + "/").c_str(), true,
+                    gps::ThreadPool::Shared())) {
+                    fprintf(stderr, "ERROR: could not read %s: %s\n", path.c_str(), err.c_str());
+                    return EXIT_FAILURE;
+                }
+
+                std::vector<gps::MeshData> meshes;
+                // the per-material lines BuildMeshes prints are not counted against it
+                std::ostringstream log;
+                std::streambuf* console = std::cout.rdbuf(log.rdbuf());
+                log.str(std::string(4096, ' '));
+                log.seekp(0);
+                size_t before = allocations;
+                gps::Model3D::BuildMeshes(attrib, shapes, materials, dir + "/", meshes);
+                size_t count = allocations - before;
+                std::cout.rdbuf(console);
+
+                size_t vertices = 0;
+                for (size_t i = 0; i < meshes.size(); i++) {
+                    vertices += meshes[i].vertices.size();
+                }
+                size_t bound = ALLOCATIONS_PER_BUILD + ALLOCATIONS_PER_MATERIAL * materialCounts[m];
+                printf("%3d shapes of %4d vertices, %d materials: %zu meshes, %6zu vertices, %3zu allocations (bound %zu)\n",
+                    shapeCounts[s], sides[v] * sides[v], materialCounts[m], meshes.size(), vertices, count, bound);
+
+                if (meshes.size() != (size_t)materialCounts[m] || vertices != (size_t)shapeCounts[s] * sides[v] * sides[v]) {
+                    printf("FAILED: the meshes are not one per material with every vertex welded once\n");
+                    failed = true;
+                }
+                if (count > bound) {
+                    printf("FAILED: more allocations than the bound\n");
+                    failed = true;
+                }
+                if (s == 0 && v == 0) {
+                    first = count;
+                }
+                else if (count != first) {
+                    printf("FAILED: the allocations change with the shapes or vertices (%zu, then %zu)\n", first, count);
+                    failed = true;
+                }
+            }
+        }
+    }
+
+    if (failed) {
+        return EXIT_FAILURE;
+    }
+    printf("the allocations depend on the materials only\n");
+    return EXIT_SUCCESS;
+}
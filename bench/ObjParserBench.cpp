@@ -0,0 +1,112 @@
+//
+//  ObjParserBench.cpp
+//
+//  Compares the throughput of gps::ObjParser against tinyobj::LoadObj and checks that
+//  both produce identical data.
+//
+//  Build (from the repository root):
+//    g++ -O2 -std=c++11 -Isrc bench/ObjParserBench.cpp src/ObjParser.cpp src/ThreadPool.cpp src/tiny_obj_loader.cpp -lpthread -o objParserBench
+//  Run:
+//    objParserBench models/scene/staticScene.obj [repetitions]
+//
+
+#include "ObjParser.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+struct ParseResult
+{
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+};
+
+template <typename T>
+static bool sameBits(const std::vector<T>& a, const std::vector<T>& b)
+{
+    return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+static bool sameResult(const ParseResult& a, const ParseResult& b)
+{
+    if (!sameBits(a.attrib.vertices, b.attrib.vertices) || !sameBits(a.attrib.normals, b.attrib.normals) ||
+        !sameBits(a.attrib.texcoords, b.attrib.texcoords)) {
+        return false;
+    }
+    if (a.shapes.size() != b.shapes.size() || a.materials.size() != b.materials.size()) {
+        return false;
+    }
+    for (size_t s = 0; s < a.shapes.size(); s++) {
+        const tinyobj::mesh_t& ma = a.shapes[s].mesh;
+        const tinyobj::mesh_t& mb = b.shapes[s].mesh;
+        if (a.shapes[s].name != b.shapes[s].name || !sameBits(ma.indices, mb.indices) ||
+            !sameBits(ma.num_face_vertices, mb.num_face_vertices) || !sameBits(ma.material_ids, mb.material_ids) ||
+            ma.tags.size() != mb.tags.size()) {
+            return false;
+        }
+    }
+    for (size_t m = 0; m < a.materials.size(); m++) {
+        if (a.materials[m].name != b.materials[m].name) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s file.obj [repetitions]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::string fileName = argv[1];
+    int repetitions = argc > 2 ? atoi(argv[2]) : 5;
+    std::string basePath = fileName.substr(0, fileName.find_last_of('/') + 1);
+
+    struct stat info;
+    if (stat(fileName.c_str(), &info) != 0) {
+        fprintf(stderr, "ERROR: could not open %s\n", fileName.c_str());
+        return EXIT_FAILURE;
+    }
+    double megabytes = info.st_size / (1024.0 * 1024.0);
+
+    // best of N runs
+    ParseResult reference;
+    double best = 1e30;
+    for (int r = 0; r < repetitions; r++) {
+        std::string err;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        tinyobj::LoadObj(&reference.attrib, &reference.shapes, &reference.materials, &err, fileName.c_str(), basePath.c_str(), true);
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        if (elapsed.count() < best) best = elapsed.count();
+        reference.materials.clear();
+    }
+    tinyobj::LoadObj(&reference.attrib, &reference.shapes, &reference.materials, NULL, fileName.c_str(), basePath.c_str(), true);
+    printf("%-12s %8s %10s %8s\n", "parser", "threads", "MB/s", "output");
+    printf("%-12s %8d %10.1f %8s\n", "tinyobj", 1, megabytes / best, "-");
+
+    const unsigned int threadCounts[] = { 1, 2, 4, 8 };
+    for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++) {
+        gps::ThreadPool pool(threadCounts[t]);
+        ParseResult result;
+        best = 1e30;
+        for (int r = 0; r < repetitions; r++) {
+            std::string err;
+            result.materials.clear();
+            std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+            gps::ObjParser::LoadObj(&result.attrib, &result.shapes, &result.materials, &err, fileName.c_str(), basePath.c_str(), true, pool);
+            std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+            if (elapsed.count() < best) best = elapsed.count();
+        }
+        printf("%-12s %8u %10.1f %8s\n", "gps parallel", threadCounts[t], megabytes / best,
+            sameResult(reference, result) ? "same" : "DIFFERS");
+    }
+
+    return EXIT_SUCCESS;
+}
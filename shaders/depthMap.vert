@@ -1,9 +1,48 @@
 #version 410 core
 layout(location=0) in vec3 vPosition;
+// mesh of the draw for indirect draws - see myShader.vert
+layout(location=3) in int drawIndex;
 
-uniform mat4 lightSpaceTrMatrix;
-uniform mat4 model;
+// per-frame constants, the FrameBlock of every shader (gps::FrameUniforms)
+struct PointLight {
+    vec3 position;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+#define NR_POINT_LIGHTS 4
+layout(std140) uniform FrameBlock {
+    mat4 view;
+    mat4 projection;
+    mat4 lightSpaceTrMatrix;
+    vec3 lightDir;
+    int fog;
+    vec3 lightColor;
+    int directionalLightEnabled;
+    PointLight pointLights[NR_POINT_LIGHTS];
+};
+// per-object constants, a range of the ring of gps::UniformBuffers (gps::ObjectUniforms)
+layout(std140) uniform ObjectBlock {
+    mat4 model;
+    mat3 normalMatrix;
+};
+// Packed positions arrive normalized to [0, 1] - see myShader.vert
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform bool indirectDraw;
+uniform samplerBuffer drawData;
 void main()
 {
-	gl_Position = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
+	vec3 offset = positionOffset;
+	vec3 scale = positionScale;
+	if (indirectDraw) {
+		offset = texelFetch(drawData, drawIndex * 3 + 0).xyz;
+		scale = texelFetch(drawData, drawIndex * 3 + 1).xyz;
+	}
+	gl_Position = lightSpaceTrMatrix * model * vec4(offset + vPosition * scale, 1.0f);
 }
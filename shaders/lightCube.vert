@@ -4,9 +4,35 @@ layout(location=0) in vec3 vPosition;
 layout(location=1) in vec3 vNormal;
 layout(location=2) in vec2 vTexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// per-frame constants, the FrameBlock of every shader (gps::FrameUniforms)
+struct PointLight {
+    vec3 position;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+#define NR_POINT_LIGHTS 4
+layout(std140) uniform FrameBlock {
+    mat4 view;
+    mat4 projection;
+    mat4 lightSpaceTrMatrix;
+    vec3 lightDir;
+    int fog;
+    vec3 lightColor;
+    int directionalLightEnabled;
+    PointLight pointLights[NR_POINT_LIGHTS];
+};
+
+// per-object constants, a range of the ring of gps::UniformBuffers (gps::ObjectUniforms)
+layout(std140) uniform ObjectBlock {
+    mat4 model;
+    mat3 normalMatrix;
+};
 
 void main() 
 {
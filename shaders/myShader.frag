@@ -4,18 +4,12 @@ in vec3 fPosition;
 in vec3 fNormal;
 in vec4 fragPosLightSpace;
 in vec2 fTexCoords;
+flat in int fDiffuseLayer;
+flat in int fSpecularLayer;
 
 out vec4 fColor;
 
-// Matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat3 normalMatrix;
-
-// lighting
-uniform vec3 lightDir;
-uniform vec3 lightColor;
-uniform int directionalLightEnabled;
+// per-frame constants, the FrameBlock of every shader (gps::FrameUniforms)
 struct PointLight {
     vec3 position;
 
@@ -28,16 +22,30 @@ struct PointLight {
     vec3 specular;
 };
 #define NR_POINT_LIGHTS 4
-uniform PointLight pointLights[NR_POINT_LIGHTS];
+layout(std140) uniform FrameBlock {
+    mat4 view;
+    mat4 projection;
+    mat4 lightSpaceTrMatrix;
+    vec3 lightDir;
+    int fog;
+    vec3 lightColor;
+    int directionalLightEnabled;
+    PointLight pointLights[NR_POINT_LIGHTS];
+};
+
+// per-object constants, a range of the ring of gps::UniformBuffers (gps::ObjectUniforms)
+layout(std140) uniform ObjectBlock {
+    mat4 model;
+    mat3 normalMatrix;
+};
 
 // fog
-uniform int fog;
 uniform vec4 fogColor; // Configurable fog color
 uniform float fogDensity;
 
-// textures
-uniform sampler2D diffuseTexture;
-uniform sampler2D specularTexture;
+// textures - layers of texture arrays, -1 when the mesh has none (black)
+uniform sampler2DArray diffuseTexture;
+uniform sampler2DArray specularTexture;
 uniform sampler2D shadowMap;
 
 // lighting components
@@ -131,8 +139,8 @@ void main() {
 	
     float shadow = computeShadow();
 
-    vec3 texDiffuse = texture(diffuseTexture, fTexCoords).rgb;
-    vec3 texSpecular = texture(specularTexture, fTexCoords).rgb;
+    vec3 texDiffuse = fDiffuseLayer < 0 ? vec3(0.0f) : texture(diffuseTexture, vec3(fTexCoords, fDiffuseLayer)).rgb;
+    vec3 texSpecular = fSpecularLayer < 0 ? vec3(0.0f) : texture(specularTexture, vec3(fTexCoords, fSpecularLayer)).rgb;
 
     vec3 color = min((ambient + totalPointLight + diffuse * (1.0f - shadow)) * texDiffuse + specular * (1.0f - shadow) * texSpecular, 1.0f);
 	
@@ -3,22 +3,90 @@
 layout(location=0) in vec3 vPosition;
 layout(location=1) in vec3 vNormal;
 layout(location=2) in vec2 vTexCoords;
+// mesh of the draw, for the per-draw data of gps::IndirectRenderer
+layout(location=3) in int drawIndex;
 
 out vec3 fPosition;
 out vec3 fNormal;
 out vec4 fragPosLightSpace;
 out vec2 fTexCoords;
+flat out int fDiffuseLayer;
+flat out int fSpecularLayer;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 lightSpaceTrMatrix;
+// per-frame constants, the FrameBlock of every shader (gps::FrameUniforms)
+struct PointLight {
+    vec3 position;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+#define NR_POINT_LIGHTS 4
+layout(std140) uniform FrameBlock {
+    mat4 view;
+    mat4 projection;
+    mat4 lightSpaceTrMatrix;
+    vec3 lightDir;
+    int fog;
+    vec3 lightColor;
+    int directionalLightEnabled;
+    PointLight pointLights[NR_POINT_LIGHTS];
+};
+
+// per-object constants, a range of the ring of gps::UniformBuffers (gps::ObjectUniforms)
+layout(std140) uniform ObjectBlock {
+    mat4 model;
+    mat3 normalMatrix;
+};
+
+// Packed vertices (gps::PackedVertex) arrive normalized to [0, 1]: positions and texture coordinates
+// are scaled back to their range, normals are octahedral. Float vertices use offset 0 and scale 1
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform vec2 texCoordOffset;
+uniform vec2 texCoordScale;
+uniform bool octahedralNormals;
+
+// texture array layers, -1 when the mesh has none
+uniform int diffuseTextureLayer;
+uniform int specularTextureLayer;
+
+// Indirect draws take the values above from 3 texels per mesh: position offset and diffuse layer,
+// position scale and specular layer, texture coordinate offset and scale
+uniform bool indirectDraw;
+uniform samplerBuffer drawData;
+
+vec3 octahedralDecode(vec2 encoded)
+{
+	vec2 e = encoded * 2.0f - 1.0f;
+	vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return normalize(n);
+}
 
 void main() 
 {
-	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
-	fPosition = vPosition;
-	fNormal = vNormal;
-	fragPosLightSpace = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
-	fTexCoords = vTexCoords;
+	vec4 offset = vec4(positionOffset, diffuseTextureLayer);
+	vec4 scale = vec4(positionScale, specularTextureLayer);
+	vec4 texCoordRange = vec4(texCoordOffset, texCoordScale);
+	if (indirectDraw) {
+		offset = texelFetch(drawData, drawIndex * 3 + 0);
+		scale = texelFetch(drawData, drawIndex * 3 + 1);
+		texCoordRange = texelFetch(drawData, drawIndex * 3 + 2);
+	}
+
+	vec3 position = offset.xyz + vPosition * scale.xyz;
+	gl_Position = projection * view * model * vec4(position, 1.0f);
+	fPosition = position;
+	fNormal = octahedralNormals ? octahedralDecode(vNormal.xy) : vNormal;
+	fragPosLightSpace = lightSpaceTrMatrix * model * vec4(position, 1.0f);
+	fTexCoords = texCoordRange.xy + vTexCoords * texCoordRange.zw;
+	fDiffuseLayer = int(offset.w);
+	fSpecularLayer = int(scale.w);
 }
@@ -6,8 +6,14 @@ layout(location=2) in vec2 vTexCoords;
 
 out vec2 fTexCoords;
 
+// the quad is a gps::Mesh too - see myShader.vert
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform vec2 texCoordOffset;
+uniform vec2 texCoordScale;
+
 void main() 
 {
-	fTexCoords = vTexCoords;
-	gl_Position = vec4(vPosition, 1.0f);
+	fTexCoords = texCoordOffset + vTexCoords * texCoordScale;
+	gl_Position = vec4(positionOffset + vPosition * positionScale, 1.0f);
 }
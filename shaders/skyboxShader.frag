@@ -4,7 +4,30 @@ in vec3 textureCoordinates;
 out vec4 color;
 
 uniform samplerCube skybox;
-uniform int fog;
+
+// per-frame constants, the FrameBlock of every shader (gps::FrameUniforms)
+struct PointLight {
+    vec3 position;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+#define NR_POINT_LIGHTS 4
+layout(std140) uniform FrameBlock {
+    mat4 view;
+    mat4 projection;
+    mat4 lightSpaceTrMatrix;
+    vec3 lightDir;
+    int fog;
+    vec3 lightColor;
+    int directionalLightEnabled;
+    PointLight pointLights[NR_POINT_LIGHTS];
+};
 
 void main()
 {
@@ -0,0 +1,185 @@
+#include "AssetManager.hpp"
+
+#include <iostream>
+
+namespace gps {
+
+	TextureArray::TextureArray() : id(0), width(0), height(0), levels(0), layers(0), internalFormat(GL_SRGB)
+	{
+	}
+
+	TextureArray::~TextureArray()
+	{
+		// never created - e.g. released before its model reached the GL thread
+		if (id != 0) {
+			glDeleteTextures(1, &id);
+		}
+	}
+
+	TextureAsset::TextureAsset(GLuint id, std::string path) : id(id), layer(0), path(path)
+	{
+	}
+
+	ModelAsset::ModelAsset() : loaded(false), version(0)
+	{
+	}
+
+	ModelAsset::~ModelAsset()
+	{
+		for (size_t i = 0; i < meshes.size(); i++) {
+			GeometryArena::Release(meshes.at(i).getAllocation());
+		}
+	}
+
+	AssetManager::AssetManager() : modelHits(0), modelMisses(0), textureHits(0), textureMisses(0),
+		textureBytes(0), uncompressedTextureBytes(0), freedGeometryBytes(0), keptGeometryBytes(0)
+	{
+	}
+
+	AssetManager& AssetManager::Get()
+	{
+		static AssetManager manager;
+		return manager;
+	}
+
+	std::shared_ptr<ModelAsset> AssetManager::FindModel(std::string path)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unordered_map<std::string, std::weak_ptr<ModelAsset> >::iterator found = models.find(CanonicalPath(path));
+		std::shared_ptr<ModelAsset> model;
+		if (found != models.end()) {
+			model = found->second.lock();
+		}
+
+		if (model) {
+			modelHits++;
+		}
+		else {
+			modelMisses++;
+		}
+		return model;
+	}
+
+	std::shared_ptr<TextureAsset> AssetManager::FindTexture(std::string path)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unordered_map<std::string, std::weak_ptr<TextureAsset> >::iterator found = textures.find(CanonicalPath(path));
+		std::shared_ptr<TextureAsset> texture;
+		if (found != textures.end()) {
+			texture = found->second.lock();
+		}
+
+		if (texture) {
+			textureHits++;
+		}
+		else {
+			textureMisses++;
+		}
+		return texture;
+	}
+
+	std::vector<std::shared_ptr<ModelAsset> > AssetManager::GetModels()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<std::shared_ptr<ModelAsset> > live;
+		for (std::unordered_map<std::string, std::weak_ptr<ModelAsset> >::iterator it = models.begin(); it != models.end(); ++it) {
+			std::shared_ptr<ModelAsset> model = it->second.lock();
+			if (model) {
+				live.push_back(model);
+			}
+		}
+		return live;
+	}
+
+	std::vector<std::shared_ptr<TextureAsset> > AssetManager::GetTextures()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<std::shared_ptr<TextureAsset> > live;
+		for (std::unordered_map<std::string, std::weak_ptr<TextureAsset> >::iterator it = textures.begin(); it != textures.end(); ++it) {
+			std::shared_ptr<TextureAsset> texture = it->second.lock();
+			if (texture) {
+				live.push_back(texture);
+			}
+		}
+		return live;
+	}
+
+	void AssetManager::AddModel(std::string path, std::shared_ptr<ModelAsset> model)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		models[CanonicalPath(path)] = model;
+	}
+
+	void AssetManager::AddTexture(std::string path, std::shared_ptr<TextureAsset> texture)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		textures[CanonicalPath(path)] = texture;
+	}
+
+	void AssetManager::AddTextureMemory(size_t gpuBytes, size_t uncompressedBytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		textureBytes += gpuBytes;
+		uncompressedTextureBytes += uncompressedBytes;
+	}
+
+	void AssetManager::AddGeometryMemory(size_t freedBytes, size_t keptBytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		freedGeometryBytes += freedBytes;
+		keptGeometryBytes += keptBytes;
+	}
+
+	void AssetManager::PrintStats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::cout << "Asset cache - models   : " << modelHits << " hits, " << modelMisses << " misses" << std::endl;
+		std::cout << "Asset cache - textures : " << textureHits << " hits, " << textureMisses << " misses" << std::endl;
+
+		const double megabyte = 1024.0 * 1024.0;
+		std::cout << "Texture memory         : " << textureBytes / megabyte << " MB ("
+			<< uncompressedTextureBytes / megabyte << " MB as RGBA8, "
+			<< (uncompressedTextureBytes - textureBytes) / megabyte << " MB saved by compression)" << std::endl;
+		std::cout << "CPU geometry           : " << freedGeometryBytes / megabyte << " MB freed after upload, "
+			<< keptGeometryBytes / megabyte << " MB kept" << std::endl;
+	}
+
+	std::string AssetManager::CanonicalPath(std::string path)
+	{
+		for (size_t i = 0; i < path.size(); i++) {
+			if (path[i] == '\\') {
+				path[i] = '/';
+			}
+		}
+
+		bool absolute = !path.empty() && path[0] == '/';
+		std::vector<std::string> segments;
+		size_t start = 0;
+		while (start <= path.size()) {
+			size_t end = path.find('/', start);
+			if (end == std::string::npos) {
+				end = path.size();
+			}
+			std::string segment = path.substr(start, end - start);
+			start = end + 1;
+
+			if (segment.empty() || segment == ".") {
+				continue;
+			}
+			if (segment == ".." && !segments.empty() && segments.back() != "..") {
+				segments.pop_back();
+				continue;
+			}
+			segments.push_back(segment);
+		}
+
+		std::string canonical = absolute ? "/" : "";
+		for (size_t i = 0; i < segments.size(); i++) {
+			if (i > 0) {
+				canonical += "/";
+			}
+			canonical += segments[i];
+		}
+		return canonical;
+	}
+}
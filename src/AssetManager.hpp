@@ -0,0 +1,110 @@
+#ifndef AssetManager_hpp
+#define AssetManager_hpp
+
+#include "Mesh.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gps {
+
+// GL_TEXTURE_2D_ARRAY holding same-size, same-format textures as layers, so the meshes using any of them
+// draw with the same binding and only switch layers. Deleted with the last texture in it
+struct TextureArray
+{
+    // 0 until created on the GL thread
+    GLuint id;
+    GLsizei width;
+    GLsizei height;
+    GLint levels;
+    GLsizei layers;
+    // GL_SRGB for decoded images, otherwise the S3TC format of the .ktx2 files
+    GLenum internalFormat;
+
+    TextureArray();
+    ~TextureArray();
+};
+
+// GL texture shared by every model that references the same image file - a layer of a texture array
+struct TextureAsset
+{
+    // GL name of the array, 0 until the texture is uploaded on the GL thread
+    GLuint id;
+    GLint layer;
+    std::shared_ptr<TextureArray> array;
+    std::string path;
+
+    TextureAsset(GLuint id, std::string path);
+};
+
+// Meshes of one .obj file shared by every Model3D that loads it
+struct ModelAsset
+{
+    std::vector<gps::Mesh> meshes;
+    // Keeps the textures referenced by the meshes alive - keyed by path
+    std::unordered_map<std::string, std::shared_ptr<TextureAsset> > loadedTextures;
+    // Content hash of each mesh, when Model3D::hotReload is set
+    std::vector<uint64_t> meshHashes;
+    // Set on the GL thread once every mesh and texture is uploaded
+    bool loaded;
+    // Bumped when a reload changes the meshes or the textures they draw with
+    unsigned int version;
+
+    ModelAsset();
+    ~ModelAsset();
+};
+
+// Process-wide registry of loaded models and textures, keyed by canonical path.
+// Only weak references are kept, so an asset is freed once the last handle to it is released.
+// Safe to use from the background loading thread
+class AssetManager
+{
+public:
+    static AssetManager& Get();
+
+    // Return an empty handle when the asset is not loaded yet
+    std::shared_ptr<ModelAsset> FindModel(std::string path);
+    std::shared_ptr<TextureAsset> FindTexture(std::string path);
+
+    // Every model and texture still in use
+    std::vector<std::shared_ptr<ModelAsset> > GetModels();
+    std::vector<std::shared_ptr<TextureAsset> > GetTextures();
+
+    void AddModel(std::string path, std::shared_ptr<ModelAsset> model);
+    void AddTexture(std::string path, std::shared_ptr<TextureAsset> texture);
+
+    // Records the video memory taken by an uploaded texture, and what it would take as RGBA8 with mipmaps
+    void AddTextureMemory(size_t gpuBytes, size_t uncompressedBytes);
+    // Records the system memory a model released after its upload, and what it kept of its geometry
+    void AddGeometryMemory(size_t freedBytes, size_t keptBytes);
+
+    // Prints the cache hit/miss counts and the texture memory
+    void PrintStats();
+
+    // Lexically normalized path ('\\' -> '/', "." and ".." segments resolved)
+    static std::string CanonicalPath(std::string path);
+
+private:
+    std::unordered_map<std::string, std::weak_ptr<ModelAsset> > models;
+    std::unordered_map<std::string, std::weak_ptr<TextureAsset> > textures;
+
+    unsigned int modelHits;
+    unsigned int modelMisses;
+    unsigned int textureHits;
+    unsigned int textureMisses;
+    size_t textureBytes;
+    size_t uncompressedTextureBytes;
+    size_t freedGeometryBytes;
+    size_t keptGeometryBytes;
+    std::mutex mutex;
+
+    AssetManager();
+};
+
+}
+
+#endif /* AssetManager_hpp */
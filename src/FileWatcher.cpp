@@ -0,0 +1,251 @@
+#include "FileWatcher.hpp"
+
+#include <iostream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace gps {
+
+#ifdef __linux__
+
+	// written in place (IN_CLOSE_WRITE) or saved to a temporary file and renamed over (IN_MOVED_TO)
+	static const uint32_t FILE_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+
+	FileWatcher::FileWatcher()
+	{
+		fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd < 0) {
+			std::cerr << "WARNING: inotify_init1 failed (errno " << errno << ")" << std::endl;
+		}
+	}
+
+	FileWatcher::~FileWatcher()
+	{
+		if (fd >= 0) {
+			close(fd);
+		}
+	}
+
+	bool FileWatcher::Watch(std::string directory)
+	{
+		struct stat info;
+		if (fd < 0 || stat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+			return false;
+		}
+		while (directory.size() > 1 && directory[directory.size() - 1] == '/') {
+			directory.erase(directory.size() - 1);
+		}
+		AddDirectory(directory);
+		return !directories.empty();
+	}
+
+	// inotify watches are not recursive - one per directory of the tree
+	void FileWatcher::AddDirectory(std::string path)
+	{
+		int wd = inotify_add_watch(fd, path.c_str(), FILE_EVENTS);
+		if (wd < 0) {
+			std::cerr << "WARNING: cannot watch " << path << " (errno " << errno << ")" << std::endl;
+			return;
+		}
+		directories[wd] = path;
+
+		DIR* dir = opendir(path.c_str());
+		if (!dir) {
+			return;
+		}
+		while (struct dirent* entry = readdir(dir)) {
+			std::string name = entry->d_name;
+			if (name == "." || name == "..") {
+				continue;
+			}
+			std::string child = path + "/" + name;
+			struct stat info;
+			if (stat(child.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+				AddDirectory(child);
+			}
+		}
+		closedir(dir);
+	}
+
+	void FileWatcher::Poll(std::vector<std::string>& changedPaths)
+	{
+		if (fd < 0) {
+			return;
+		}
+
+		// aligned for the inotify_event headers
+		alignas(struct inotify_event) char buffer[16 * 1024];
+		for (;;) {
+			ssize_t length = read(fd, buffer, sizeof(buffer));
+			if (length <= 0) {
+				// EAGAIN - nothing left to read
+				return;
+			}
+
+			for (ssize_t offset = 0; offset < length; ) {
+				const struct inotify_event* event = (const struct inotify_event*)(buffer + offset);
+				offset += sizeof(struct inotify_event) + event->len;
+
+				if (event->mask & IN_Q_OVERFLOW) {
+					std::cerr << "WARNING: file change events were dropped" << std::endl;
+					continue;
+				}
+				if (event->mask & IN_IGNORED) {
+					// the directory was deleted
+					directories.erase(event->wd);
+					continue;
+				}
+				std::unordered_map<int, std::string>::iterator directory = directories.find(event->wd);
+				if (directory == directories.end() || event->len == 0) {
+					continue;
+				}
+				std::string path = directory->second + "/" + event->name;
+
+				if (event->mask & IN_ISDIR) {
+					if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+						AddDirectory(path);
+					}
+				}
+				// a created file is reported once it is closed
+				else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+					changedPaths.push_back(path);
+				}
+			}
+		}
+	}
+
+#elif defined(_WIN32)
+
+	// written in place (last write) or saved to a temporary file and renamed over (file name)
+	static const DWORD FILE_EVENTS = FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME;
+
+	struct FileWatcher::PendingRead
+	{
+		HANDLE directory;
+		OVERLAPPED overlapped;
+		// DWORD aligned, as ReadDirectoryChangesW requires
+		DWORD buffer[16 * 1024];
+	};
+
+	FileWatcher::FileWatcher() : read(new PendingRead())
+	{
+		read->directory = INVALID_HANDLE_VALUE;
+		ZeroMemory(&read->overlapped, sizeof(read->overlapped));
+	}
+
+	FileWatcher::~FileWatcher()
+	{
+		if (read->directory != INVALID_HANDLE_VALUE) {
+			// the kernel writes into the buffer until the read is cancelled
+			CancelIo(read->directory);
+			DWORD bytes;
+			GetOverlappedResult(read->directory, &read->overlapped, &bytes, TRUE);
+			CloseHandle(read->directory);
+		}
+		if (read->overlapped.hEvent) {
+			CloseHandle(read->overlapped.hEvent);
+		}
+	}
+
+	bool FileWatcher::Watch(std::string directory)
+	{
+		while (directory.size() > 1 && (directory[directory.size() - 1] == '/' || directory[directory.size() - 1] == '\\')) {
+			directory.erase(directory.size() - 1);
+		}
+		read->directory = CreateFileA(directory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+		if (read->directory == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		read->overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+		root = directory;
+		return read->overlapped.hEvent != NULL && StartRead();
+	}
+
+	// one read covers the whole tree, the subdirectories created later included
+	bool FileWatcher::StartRead()
+	{
+		ResetEvent(read->overlapped.hEvent);
+		if (!ReadDirectoryChangesW(read->directory, read->buffer, sizeof(read->buffer), TRUE, FILE_EVENTS, NULL, &read->overlapped, NULL)) {
+			std::cerr << "WARNING: ReadDirectoryChangesW failed (error " << GetLastError() << ")" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	void FileWatcher::Poll(std::vector<std::string>& changedPaths)
+	{
+		if (read->directory == INVALID_HANDLE_VALUE || read->overlapped.hEvent == NULL) {
+			return;
+		}
+
+		DWORD length = 0;
+		if (!GetOverlappedResult(read->directory, &read->overlapped, &length, FALSE)) {
+			// ERROR_IO_INCOMPLETE - nothing changed yet
+			return;
+		}
+		if (length == 0) {
+			std::cerr << "WARNING: file change events were dropped" << std::endl;
+		}
+
+		const unsigned char* records = (const unsigned char*)read->buffer;
+		for (DWORD offset = 0; offset < length; ) {
+			const FILE_NOTIFY_INFORMATION* record = (const FILE_NOTIFY_INFORMATION*)(records + offset);
+			// a file is reported on every write, also before it is complete - the loader waits for the writes to settle
+			if (record->Action == FILE_ACTION_MODIFIED || record->Action == FILE_ACTION_ADDED ||
+				record->Action == FILE_ACTION_RENAMED_NEW_NAME) {
+				int wideLength = (int)(record->FileNameLength / sizeof(WCHAR));
+				int size = WideCharToMultiByte(CP_UTF8, 0, record->FileName, wideLength, NULL, 0, NULL, NULL);
+				std::string name(size, '\0');
+				WideCharToMultiByte(CP_UTF8, 0, record->FileName, wideLength, &name[0], size, NULL, NULL);
+				for (size_t c = 0; c < name.size(); c++) {
+					if (name[c] == '\\') {
+						name[c] = '/';
+					}
+				}
+
+				std::string path = root + "/" + name;
+				DWORD attributes = GetFileAttributesA(path.c_str());
+				if (attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+					changedPaths.push_back(path);
+				}
+			}
+			if (record->NextEntryOffset == 0) {
+				break;
+			}
+			offset += record->NextEntryOffset;
+		}
+
+		StartRead();
+	}
+
+#else
+
+	FileWatcher::FileWatcher()
+	{
+	}
+
+	FileWatcher::~FileWatcher()
+	{
+	}
+
+	bool FileWatcher::Watch(std::string directory)
+	{
+		std::cerr << "WARNING: watching " << directory << " for changes needs inotify (Linux) or ReadDirectoryChangesW (Windows)" << std::endl;
+		return false;
+	}
+
+	void FileWatcher::Poll(std::vector<std::string>& changedPaths)
+	{
+	}
+
+#endif
+}
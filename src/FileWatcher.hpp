@@ -0,0 +1,48 @@
+#ifndef FileWatcher_hpp
+#define FileWatcher_hpp
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gps {
+
+// Reports the files written under a directory tree, without blocking - inotify on Linux,
+// ReadDirectoryChangesW on Windows. Elsewhere Watch fails and nothing is ever reported
+class FileWatcher
+{
+public:
+    FileWatcher();
+    ~FileWatcher();
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Watches `directory` and its subdirectories, including those created later
+    bool Watch(std::string directory);
+
+    // Appends the files closed after writing or moved in since the last call ("dir/sub/name").
+    // A file saved several times in between is listed several times
+    void Poll(std::vector<std::string>& changedPaths);
+
+private:
+#ifdef __linux__
+    int fd;
+    // watch descriptor -> watched directory
+    std::unordered_map<int, std::string> directories;
+
+    void AddDirectory(std::string path);
+#elif defined(_WIN32)
+    // the overlapped ReadDirectoryChangesW in flight, with its buffer
+    struct PendingRead;
+    std::unique_ptr<PendingRead> read;
+    std::string root;
+
+    // Queues the next read of the changes, false when it cannot be issued
+    bool StartRead();
+#endif
+};
+
+}
+
+#endif /* FileWatcher_hpp */
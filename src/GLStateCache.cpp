@@ -0,0 +1,136 @@
+#include "GLStateCache.hpp"
+
+namespace gps {
+
+	// the state of the GL context, as far as the cache knows - only used on the GL thread
+	static const GLuint UNKNOWN = ~(GLuint)0;
+	static const GLenum TEXTURE_TARGETS[] = { GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BUFFER };
+	static const int TARGET_COUNT = sizeof(TEXTURE_TARGETS) / sizeof(TEXTURE_TARGETS[0]);
+
+	static GLuint program = UNKNOWN;
+	static GLuint vertexArray = UNKNOWN;
+	static GLuint activeUnit = UNKNOWN;
+	static GLuint textures[GLStateCache::TEXTURE_UNITS][TARGET_COUNT];
+	static GLenum depthFunc = UNKNOWN;
+	static GLuint depthMask = UNKNOWN;
+	static GLenum polygonMode = UNKNOWN;
+	// false until the first Invalidate marks the texture table unknown
+	static bool texturesKnown = false;
+
+	static GLStateCache::Stats stats = {};
+
+	// true when `value` has to be set - and then records it
+	static bool change(GLuint& current, GLuint value, GLStateCache::Kind kind)
+	{
+		if (current == value) {
+			stats.skipped[kind]++;
+			return false;
+		}
+		current = value;
+		stats.issued[kind]++;
+		return true;
+	}
+
+	void GLStateCache::UseProgram(GLuint newProgram)
+	{
+		if (change(program, newProgram, PROGRAM)) {
+			glUseProgram(newProgram);
+		}
+	}
+
+	void GLStateCache::BindVertexArray(GLuint newVertexArray)
+	{
+		if (change(vertexArray, newVertexArray, VERTEX_ARRAY)) {
+			glBindVertexArray(newVertexArray);
+		}
+	}
+
+	bool GLStateCache::BindTexture(GLuint unit, GLenum target, GLuint texture)
+	{
+		if (!texturesKnown) {
+			Invalidate();
+		}
+		int t = 0;
+		while (t < TARGET_COUNT && TEXTURE_TARGETS[t] != target) {
+			t++;
+		}
+		// not tracked - always issued
+		if (unit >= TEXTURE_UNITS || t == TARGET_COUNT) {
+			glActiveTexture(GL_TEXTURE0 + unit);
+			glBindTexture(target, texture);
+			activeUnit = unit;
+			stats.issued[TEXTURE]++;
+			return true;
+		}
+
+		if (!change(textures[unit][t], texture, TEXTURE)) {
+			return false;
+		}
+		if (activeUnit != unit) {
+			glActiveTexture(GL_TEXTURE0 + unit);
+			activeUnit = unit;
+		}
+		glBindTexture(target, texture);
+		return true;
+	}
+
+	void GLStateCache::ActiveTexture(GLuint unit)
+	{
+		if (change(activeUnit, unit, TEXTURE)) {
+			glActiveTexture(GL_TEXTURE0 + unit);
+		}
+	}
+
+	void GLStateCache::DepthFunc(GLenum func)
+	{
+		if (change(depthFunc, func, DEPTH)) {
+			glDepthFunc(func);
+		}
+	}
+
+	void GLStateCache::DepthMask(GLboolean mask)
+	{
+		if (change(depthMask, mask, DEPTH)) {
+			glDepthMask(mask);
+		}
+	}
+
+	void GLStateCache::PolygonMode(GLenum mode)
+	{
+		if (change(polygonMode, mode, POLYGON_MODE)) {
+			glPolygonMode(GL_FRONT_AND_BACK, mode);
+		}
+	}
+
+	void GLStateCache::Invalidate()
+	{
+		program = UNKNOWN;
+		vertexArray = UNKNOWN;
+		activeUnit = UNKNOWN;
+		for (GLuint unit = 0; unit < TEXTURE_UNITS; unit++) {
+			for (int t = 0; t < TARGET_COUNT; t++) {
+				textures[unit][t] = UNKNOWN;
+			}
+		}
+		texturesKnown = true;
+		depthFunc = UNKNOWN;
+		depthMask = UNKNOWN;
+		polygonMode = UNKNOWN;
+	}
+
+	const GLStateCache::Stats& GLStateCache::GetStats()
+	{
+		return stats;
+	}
+
+	void GLStateCache::ResetStats()
+	{
+		stats = Stats();
+	}
+
+	const char* GLStateCache::GetKindName(Kind kind)
+	{
+		static const char* const names[KINDS] = { "program", "vertex array", "texture", "depth", "polygon mode" };
+		return names[kind];
+	}
+}
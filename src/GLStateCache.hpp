@@ -0,0 +1,57 @@
+#ifndef GLStateCache_hpp
+#define GLStateCache_hpp
+
+#include <GL/glew.h>
+
+#include <cstddef>
+
+namespace gps {
+
+// Last value set for the program, vertex array, texture bindings, depth function/mask and polygon mode, so
+// setting one again issues no GL call. Whatever changes that state directly (loading, uploads) must be
+// followed by Invalidate before the cache is used again
+class GLStateCache
+{
+public:
+    enum Kind
+    {
+        PROGRAM,
+        VERTEX_ARRAY,
+        TEXTURE,
+        DEPTH,
+        POLYGON_MODE,
+        KINDS
+    };
+
+    // Calls issued and skipped (the state was already set) for each kind
+    struct Stats
+    {
+        size_t issued[KINDS];
+        size_t skipped[KINDS];
+    };
+
+    static const GLuint TEXTURE_UNITS = 8;
+
+    static void UseProgram(GLuint program);
+    static void BindVertexArray(GLuint vertexArray);
+    // Binds `texture` to `target` on `unit`, switching the active unit only when the binding changes.
+    // Returns false when it was already bound
+    static bool BindTexture(GLuint unit, GLenum target, GLuint texture);
+    // Makes `unit` the active one, e.g. to change the texture bound on it
+    static void ActiveTexture(GLuint unit);
+    static void DepthFunc(GLenum func);
+    static void DepthMask(GLboolean mask);
+    // For GL_FRONT_AND_BACK, the only face of the core profile
+    static void PolygonMode(GLenum mode);
+
+    // Forgets every value, so the next call of each kind is issued
+    static void Invalidate();
+
+    static const Stats& GetStats();
+    static void ResetStats();
+    static const char* GetKindName(Kind kind);
+};
+
+}
+
+#endif /* GLStateCache_hpp */
@@ -0,0 +1,288 @@
+#include "GeometryArena.hpp"
+#include "GLStateCache.hpp"
+#include "Mesh.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace gps {
+
+	// first capacity of the buffers, doubled whenever an allocation does not fit
+	static const GLsizeiptr INITIAL_VERTICES = 1 << 16;
+	static const GLsizeiptr INITIAL_INDEX_BYTES = 1 << 20;
+
+	GeometryAllocation::GeometryAllocation() : packed(false), firstVertex(0), vertexCount(0), indexOffset(0), indexBytes(0)
+	{
+	}
+
+	RangeAllocator::RangeAllocator() : capacity(0), used(0)
+	{
+	}
+
+	GLintptr RangeAllocator::Allocate(GLsizeiptr size)
+	{
+		if (size <= 0) {
+			return 0;
+		}
+		for (std::map<GLintptr, GLsizeiptr>::iterator range = freeRanges.begin(); range != freeRanges.end(); ++range) {
+			if (range->second < size) {
+				continue;
+			}
+			GLintptr offset = range->first;
+			GLsizeiptr left = range->second - size;
+			freeRanges.erase(range);
+			if (left > 0) {
+				freeRanges[offset + size] = left;
+			}
+			used += size;
+			return offset;
+		}
+		return -1;
+	}
+
+	void RangeAllocator::Free(GLintptr offset, GLsizeiptr size)
+	{
+		if (size <= 0) {
+			return;
+		}
+		used -= size;
+
+		std::map<GLintptr, GLsizeiptr>::iterator next = freeRanges.lower_bound(offset);
+		if (next != freeRanges.end() && offset + size == next->first) {
+			size += next->second;
+			next = freeRanges.erase(next);
+		}
+		if (next != freeRanges.begin()) {
+			std::map<GLintptr, GLsizeiptr>::iterator previous = next;
+			--previous;
+			if (previous->first + previous->second == offset) {
+				previous->second += size;
+				return;
+			}
+		}
+		freeRanges[offset] = size;
+	}
+
+	void RangeAllocator::Grow(GLsizeiptr newCapacity)
+	{
+		if (newCapacity <= capacity) {
+			return;
+		}
+		GLsizeiptr oldCapacity = capacity;
+		capacity = newCapacity;
+		// counted as used until Free gives it back, merged with a free range at the end
+		used += newCapacity - oldCapacity;
+		Free(oldCapacity, newCapacity - oldCapacity);
+	}
+
+	GLsizeiptr RangeAllocator::GetCapacity() const
+	{
+		return capacity;
+	}
+
+	GLsizeiptr RangeAllocator::GetUsed() const
+	{
+		return used;
+	}
+
+	size_t RangeAllocator::GetFreeRanges() const
+	{
+		return freeRanges.size();
+	}
+
+	GLsizeiptr RangeAllocator::GetLargestFree() const
+	{
+		GLsizeiptr largest = 0;
+		for (std::map<GLintptr, GLsizeiptr>::const_iterator range = freeRanges.begin(); range != freeRanges.end(); ++range) {
+			largest = std::max(largest, range->second);
+		}
+		return largest;
+	}
+
+	GeometryArena::GeometryArena(bool packed) : packed(packed), vertexArray(0), vertexBuffer(0), indexBuffer(0)
+	{
+		glGenVertexArrays(1, &vertexArray);
+		GrowBuffer(vertexBuffer, 0, INITIAL_VERTICES * GetStride());
+		GrowBuffer(indexBuffer, 0, INITIAL_INDEX_BYTES);
+		vertices.Grow(INITIAL_VERTICES);
+		indices.Grow(INITIAL_INDEX_BYTES);
+		SetupVertexArray();
+	}
+
+	GeometryArena::~GeometryArena()
+	{
+		glDeleteVertexArrays(1, &vertexArray);
+		glDeleteBuffers(1, &vertexBuffer);
+		glDeleteBuffers(1, &indexBuffer);
+	}
+
+	// float and packed arenas, created on first use and never destroyed by exit - their buffers need the GL context
+	static GeometryArena* arenas[2] = { NULL, NULL };
+
+	// created on first use, which must be on the GL thread
+	GeometryArena& GeometryArena::Get(bool packed)
+	{
+		if (!arenas[packed]) {
+			arenas[packed] = new GeometryArena(packed);
+		}
+		return *arenas[packed];
+	}
+
+	void GeometryArena::Destroy()
+	{
+		for (int p = 0; p < 2; p++) {
+			delete arenas[p];
+			arenas[p] = NULL;
+		}
+	}
+
+	GeometryAllocation GeometryArena::Allocate(GLsizei vertexCount, GLsizeiptr indexBytes)
+	{
+		GeometryAllocation allocation;
+		allocation.packed = packed;
+		allocation.vertexCount = vertexCount;
+		// whole GLuints, so the next mesh may use 32-bit indices
+		allocation.indexBytes = (indexBytes + 3) & ~(GLsizeiptr)3;
+
+		GLintptr firstVertex = vertices.Allocate(vertexCount);
+		if (firstVertex < 0) {
+			GLsizeiptr capacity = vertices.GetCapacity();
+			GLsizeiptr newCapacity = std::max(capacity * 2, capacity + (GLsizeiptr)vertexCount);
+			GrowBuffer(vertexBuffer, capacity * GetStride(), newCapacity * GetStride());
+			vertices.Grow(newCapacity);
+			SetupVertexArray();
+			firstVertex = vertices.Allocate(vertexCount);
+		}
+		GLintptr indexOffset = indices.Allocate(allocation.indexBytes);
+		if (indexOffset < 0) {
+			GLsizeiptr capacity = indices.GetCapacity();
+			GLsizeiptr newCapacity = std::max(capacity * 2, capacity + allocation.indexBytes);
+			GrowBuffer(indexBuffer, capacity, newCapacity);
+			indices.Grow(newCapacity);
+			SetupVertexArray();
+			indexOffset = indices.Allocate(allocation.indexBytes);
+		}
+
+		allocation.firstVertex = (GLint)firstVertex;
+		allocation.indexOffset = indexOffset;
+		return allocation;
+	}
+
+	void GeometryArena::Release(const GeometryAllocation& allocation)
+	{
+		// the arena was never created (nothing uploaded) or is already destroyed
+		if (arenas[allocation.packed]) {
+			arenas[allocation.packed]->Free(allocation);
+		}
+	}
+
+	void GeometryArena::Free(const GeometryAllocation& allocation)
+	{
+		vertices.Free(allocation.firstVertex, allocation.vertexCount);
+		indices.Free(allocation.indexOffset, allocation.indexBytes);
+	}
+
+	GLuint GeometryArena::GetVertexArray() const
+	{
+		return vertexArray;
+	}
+
+	GLuint GeometryArena::GetVertexBuffer() const
+	{
+		return vertexBuffer;
+	}
+
+	GLuint GeometryArena::GetIndexBuffer() const
+	{
+		return indexBuffer;
+	}
+
+	GLsizei GeometryArena::GetStride() const
+	{
+		return packed ? sizeof(PackedVertex) : sizeof(Vertex);
+	}
+
+	GeometryArena::Stats GeometryArena::GetVertexStats() const
+	{
+		return MakeStats(vertices, GetStride());
+	}
+
+	GeometryArena::Stats GeometryArena::GetIndexStats() const
+	{
+		return MakeStats(indices, 1);
+	}
+
+	GeometryArena::Stats GeometryArena::MakeStats(const RangeAllocator& allocator, size_t unitBytes) const
+	{
+		Stats stats;
+		stats.capacityBytes = allocator.GetCapacity() * unitBytes;
+		stats.usedBytes = allocator.GetUsed() * unitBytes;
+		stats.freeRanges = allocator.GetFreeRanges();
+		stats.largestFreeBytes = allocator.GetLargestFree() * unitBytes;
+		size_t freeBytes = stats.capacityBytes - stats.usedBytes;
+		stats.fragmentation = freeBytes > 0 ? 1.0f - (float)stats.largestFreeBytes / freeBytes : 0.0f;
+		return stats;
+	}
+
+	void GeometryArena::PrintStats()
+	{
+		const double megabyte = 1024.0 * 1024.0;
+		const char* names[] = { "float", "packed" };
+		for (int p = 0; p < 2; p++) {
+			GeometryArena& arena = Get(p == 1);
+			Stats buffers[] = { arena.GetVertexStats(), arena.GetIndexStats() };
+			const char* kinds[] = { "vertices", "indices " };
+			for (int b = 0; b < 2; b++) {
+				std::cout << "Geometry arena " << names[p] << " " << kinds[b] << ": " << buffers[b].usedBytes / megabyte << " of "
+					<< buffers[b].capacityBytes / megabyte << " MB used, " << buffers[b].freeRanges << " free ranges, "
+					<< buffers[b].fragmentation * 100.0f << "% fragmented" << std::endl;
+			}
+		}
+	}
+
+	void GeometryArena::GrowBuffer(GLuint& buffer, GLsizeiptr oldBytes, GLsizeiptr newBytes)
+	{
+		GLuint grown;
+		glGenBuffers(1, &grown);
+		// the copy targets leave the element array binding of the bound vertex array alone
+		glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+		glBufferData(GL_COPY_WRITE_BUFFER, newBytes, NULL, GL_STATIC_DRAW);
+		if (buffer != 0) {
+			if (oldBytes > 0) {
+				glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+				glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			}
+			glDeleteBuffers(1, &buffer);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		buffer = grown;
+	}
+
+	void GeometryArena::SetupVertexArray()
+	{
+		// through the cache, which the draws rely on to know the bound vertex array
+		GLStateCache::BindVertexArray(vertexArray);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+		GLsizei stride = GetStride();
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glEnableVertexAttribArray(2);
+		if (packed) {
+			// normalized to [0, 1], the shaders scale them back
+			glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride, (GLvoid*)offsetof(PackedVertex, Position));
+			glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (GLvoid*)offsetof(PackedVertex, Normal));
+			glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (GLvoid*)offsetof(PackedVertex, TexCoords));
+		}
+		else {
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(Vertex, Position));
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(Vertex, Normal));
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(Vertex, TexCoords));
+		}
+
+		GLStateCache::BindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
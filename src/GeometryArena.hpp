@@ -0,0 +1,114 @@
+#ifndef GeometryArena_hpp
+#define GeometryArena_hpp
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <map>
+
+namespace gps {
+
+// Where the geometry of one mesh lives in the arena of its vertex format
+struct GeometryAllocation
+{
+    // PackedVertex or Vertex arena
+    bool packed;
+    // first vertex - the base vertex of the draws
+    GLint firstVertex;
+    GLsizei vertexCount;
+    // byte offset and size of the indices (GLushort or GLuint) in the index buffer
+    GLintptr indexOffset;
+    GLsizeiptr indexBytes;
+
+    GeometryAllocation();
+};
+
+// Ranges of a buffer handed out by first fit from a free-list ordered by offset.
+// Freed ranges are merged with their free neighbours, so the list only holds the holes between live ranges
+class RangeAllocator
+{
+public:
+    RangeAllocator();
+
+    // Start of a free range of `size` units, or -1 when none is large enough
+    GLintptr Allocate(GLsizeiptr size);
+    void Free(GLintptr offset, GLsizeiptr size);
+    // Appends [capacity, newCapacity) to the free space
+    void Grow(GLsizeiptr newCapacity);
+
+    GLsizeiptr GetCapacity() const;
+    GLsizeiptr GetUsed() const;
+    size_t GetFreeRanges() const;
+    GLsizeiptr GetLargestFree() const;
+
+private:
+    // offset -> size of each free range
+    std::map<GLintptr, GLsizeiptr> freeRanges;
+    GLsizeiptr capacity;
+    GLsizeiptr used;
+};
+
+// One vertex buffer, one index buffer and one vertex array shared by every mesh of a vertex format (float or
+// packed vertices). Meshes draw from their range with glDrawElementsBaseVertex, so consecutive draws need no
+// buffer or vertex array switch. The buffers grow (by copying) when full; only used on the GL thread
+class GeometryArena
+{
+public:
+    // Occupancy of one of the buffers, in bytes. Fragmentation is the part of the free space outside the
+    // largest hole - 0 when an allocation could use all of it
+    struct Stats
+    {
+        size_t capacityBytes;
+        size_t usedBytes;
+        size_t freeRanges;
+        size_t largestFreeBytes;
+        float fragmentation;
+    };
+
+    static GeometryArena& Get(bool packed);
+    // Deletes both arenas and their buffers - on the GL thread, before the context is destroyed and once
+    // every mesh is released. Ranges released after are dropped
+    static void Destroy();
+
+    // Space for the vertices and indices of one mesh, growing the buffers as needed
+    GeometryAllocation Allocate(GLsizei vertexCount, GLsizeiptr indexBytes);
+    // Returns the ranges of a mesh to the arena it came from
+    static void Release(const GeometryAllocation& allocation);
+
+    GLuint GetVertexArray() const;
+    GLuint GetVertexBuffer() const;
+    GLuint GetIndexBuffer() const;
+    GLsizei GetStride() const;
+
+    Stats GetVertexStats() const;
+    Stats GetIndexStats() const;
+    // Occupancy and fragmentation of both arenas
+    static void PrintStats();
+
+    ~GeometryArena();
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+private:
+    bool packed;
+    GLuint vertexArray;
+    GLuint vertexBuffer;
+    GLuint indexBuffer;
+    // in vertices
+    RangeAllocator vertices;
+    // in bytes
+    RangeAllocator indices;
+
+    explicit GeometryArena(bool packed);
+
+    void Free(const GeometryAllocation& allocation);
+    // Replaces `buffer` by one of `newBytes` holding its first `oldBytes`
+    static void GrowBuffer(GLuint& buffer, GLsizeiptr oldBytes, GLsizeiptr newBytes);
+    // Points the vertex array at the current buffers
+    void SetupVertexArray();
+    Stats MakeStats(const RangeAllocator& allocator, size_t unitBytes) const;
+};
+
+}
+
+#endif /* GeometryArena_hpp */
@@ -0,0 +1,401 @@
+#include "ImageProcessing.hpp"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define GPS_NEON 1
+#include <arm_neon.h>
+#elif defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GPS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC accepts AVX2 intrinsics in any function
+#define GPS_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define GPS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace gps {
+
+	// ---- instruction set selection ----
+
+	static ImageProcessing::InstructionSet detectInstructionSet() {
+#if defined(GPS_NEON)
+		return ImageProcessing::NEON;
+#elif defined(GPS_X86)
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		bool sse2 = (info[3] & (1 << 26)) != 0;
+		// AVX needs OS support for the YMM state
+		bool avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+		__cpuidex(info, 7, 0);
+		bool avx2 = avx && (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		bool sse2 = __builtin_cpu_supports("sse2") != 0;
+		bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+		if (avx2) {
+			return ImageProcessing::AVX2;
+		}
+		return sse2 ? ImageProcessing::SSE2 : ImageProcessing::SCALAR;
+#else
+		return ImageProcessing::SCALAR;
+#endif
+	}
+
+	static ImageProcessing::InstructionSet& currentInstructionSet() {
+		static ImageProcessing::InstructionSet set = detectInstructionSet();
+		return set;
+	}
+
+	ImageProcessing::InstructionSet ImageProcessing::GetInstructionSet() {
+		return currentInstructionSet();
+	}
+
+	bool ImageProcessing::IsSupported(InstructionSet set) {
+		static InstructionSet best = detectInstructionSet();
+		if (set == SCALAR || set == best) {
+			return true;
+		}
+		// AVX2 machines run SSE2 too
+		return set == SSE2 && best == AVX2;
+	}
+
+	void ImageProcessing::SetInstructionSet(InstructionSet set) {
+		currentInstructionSet() = IsSupported(set) ? set : SCALAR;
+	}
+
+	const char* ImageProcessing::GetName(InstructionSet set) {
+		switch (set) {
+		case SSE2:
+			return "SSE2";
+		case AVX2:
+			return "AVX2";
+		case NEON:
+			return "NEON";
+		default:
+			return "scalar";
+		}
+	}
+
+	// ---- row flip ----
+
+	// the byte loop TextureDecoder used originally
+	static void swapRowsScalar(unsigned char* top, unsigned char* bottom, size_t bytes) {
+		unsigned char temp = 0;
+		for (size_t col = 0; col < bytes; col++) {
+			temp = *top;
+			*top = *bottom;
+			*bottom = temp;
+			top++;
+			bottom++;
+		}
+	}
+
+#if defined(GPS_X86)
+	static void swapRowsSSE2(unsigned char* top, unsigned char* bottom, size_t bytes) {
+		size_t i = 0;
+		for (; i + 16 <= bytes; i += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i*)(top + i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(bottom + i));
+			_mm_storeu_si128((__m128i*)(top + i), b);
+			_mm_storeu_si128((__m128i*)(bottom + i), a);
+		}
+		swapRowsScalar(top + i, bottom + i, bytes - i);
+	}
+
+	GPS_TARGET_AVX2 static void swapRowsAVX2(unsigned char* top, unsigned char* bottom, size_t bytes) {
+		size_t i = 0;
+		for (; i + 32 <= bytes; i += 32) {
+			__m256i a = _mm256_loadu_si256((const __m256i*)(top + i));
+			__m256i b = _mm256_loadu_si256((const __m256i*)(bottom + i));
+			_mm256_storeu_si256((__m256i*)(top + i), b);
+			_mm256_storeu_si256((__m256i*)(bottom + i), a);
+		}
+		swapRowsSSE2(top + i, bottom + i, bytes - i);
+	}
+#endif
+
+#if defined(GPS_NEON)
+	static void swapRowsNEON(unsigned char* top, unsigned char* bottom, size_t bytes) {
+		size_t i = 0;
+		for (; i + 16 <= bytes; i += 16) {
+			uint8x16_t a = vld1q_u8(top + i);
+			uint8x16_t b = vld1q_u8(bottom + i);
+			vst1q_u8(top + i, b);
+			vst1q_u8(bottom + i, a);
+		}
+		swapRowsScalar(top + i, bottom + i, bytes - i);
+	}
+#endif
+
+	void ImageProcessing::FlipRows(unsigned char* pixels, int width, int height, int channels) {
+		void (*swapRows)(unsigned char*, unsigned char*, size_t) = swapRowsScalar;
+#if defined(GPS_X86)
+		if (GetInstructionSet() == AVX2) swapRows = swapRowsAVX2;
+		else if (GetInstructionSet() == SSE2) swapRows = swapRowsSSE2;
+#elif defined(GPS_NEON)
+		if (GetInstructionSet() == NEON) swapRows = swapRowsNEON;
+#endif
+
+		size_t rowBytes = (size_t)width * channels;
+		for (int row = 0; row < height / 2; row++) {
+			swapRows(pixels + row * rowBytes, pixels + (height - row - 1) * rowBytes, rowBytes);
+		}
+	}
+
+	// ---- RGB -> RGBA ----
+
+	static void expandScalar(const unsigned char* rgb, unsigned char* rgba, size_t texels) {
+		for (size_t i = 0; i < texels; i++) {
+			rgba[4 * i + 0] = rgb[3 * i + 0];
+			rgba[4 * i + 1] = rgb[3 * i + 1];
+			rgba[4 * i + 2] = rgb[3 * i + 2];
+			rgba[4 * i + 3] = 255;
+		}
+	}
+
+#if defined(GPS_X86)
+	// 4 texels per step: the 3-byte texels are moved to 4-byte slots with byte shifts and unpacks
+	static void expandSSE2(const unsigned char* rgb, unsigned char* rgba, size_t texels) {
+		const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+		size_t i = 0;
+		// each load reads 16 bytes for the 12 it uses
+		for (; i + 6 <= texels; i += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(rgb + 3 * i));
+			__m128i t01 = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+			__m128i t23 = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9));
+			__m128i t = _mm_unpacklo_epi64(t01, t23);
+			_mm_storeu_si128((__m128i*)(rgba + 4 * i), _mm_or_si128(t, alpha));
+		}
+		expandScalar(rgb + 3 * i, rgba + 4 * i, texels - i);
+	}
+
+	// 8 texels per step, one byte shuffle per 128-bit lane
+	GPS_TARGET_AVX2 static void expandAVX2(const unsigned char* rgb, unsigned char* rgba, size_t texels) {
+		const __m256i shuffle = _mm256_setr_epi8(
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+		size_t i = 0;
+		// the upper lane reads 16 bytes from texel i + 4
+		for (; i + 10 <= texels; i += 8) {
+			__m128i low = _mm_loadu_si128((const __m128i*)(rgb + 3 * i));
+			__m128i high = _mm_loadu_si128((const __m128i*)(rgb + 3 * i + 12));
+			__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+			v = _mm256_or_si256(_mm256_shuffle_epi8(v, shuffle), alpha);
+			_mm256_storeu_si256((__m256i*)(rgba + 4 * i), v);
+		}
+		expandSSE2(rgb + 3 * i, rgba + 4 * i, texels - i);
+	}
+#endif
+
+#if defined(GPS_NEON)
+	static void expandNEON(const unsigned char* rgb, unsigned char* rgba, size_t texels) {
+		size_t i = 0;
+		for (; i + 16 <= texels; i += 16) {
+			uint8x16x3_t v = vld3q_u8(rgb + 3 * i);
+			uint8x16x4_t out;
+			out.val[0] = v.val[0];
+			out.val[1] = v.val[1];
+			out.val[2] = v.val[2];
+			out.val[3] = vdupq_n_u8(255);
+			vst4q_u8(rgba + 4 * i, out);
+		}
+		expandScalar(rgb + 3 * i, rgba + 4 * i, texels - i);
+	}
+#endif
+
+	void ImageProcessing::ExpandRGBToRGBA(const unsigned char* rgb, unsigned char* rgba, size_t texels) {
+#if defined(GPS_X86)
+		if (GetInstructionSet() == AVX2) { expandAVX2(rgb, rgba, texels); return; }
+		if (GetInstructionSet() == SSE2) { expandSSE2(rgb, rgba, texels); return; }
+#elif defined(GPS_NEON)
+		if (GetInstructionSet() == NEON) { expandNEON(rgb, rgba, texels); return; }
+#endif
+		expandScalar(rgb, rgba, texels);
+	}
+
+	// ---- premultiplied alpha ----
+
+	// x / 255 rounded to nearest, exact for x <= 255 * 255
+	static inline unsigned char divide255(unsigned int x) {
+		x += 128;
+		return (unsigned char)((x + (x >> 8)) >> 8);
+	}
+
+	static void premultiplyScalar(unsigned char* rgba, size_t texels) {
+		for (size_t i = 0; i < texels; i++) {
+			unsigned int a = rgba[4 * i + 3];
+			rgba[4 * i + 0] = divide255(rgba[4 * i + 0] * a);
+			rgba[4 * i + 1] = divide255(rgba[4 * i + 1] * a);
+			rgba[4 * i + 2] = divide255(rgba[4 * i + 2] * a);
+		}
+	}
+
+#if defined(GPS_X86)
+	// 16-bit lanes: every channel is multiplied by its texel's alpha, the alpha lane by 255
+	static inline __m128i premultiply8SSE2(__m128i v) {
+		const __m128i colorMask = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+		const __m128i alphaLane = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+		const __m128i round = _mm_set1_epi16(128);
+		__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+		a = _mm_or_si128(_mm_and_si128(a, colorMask), alphaLane);
+		__m128i x = _mm_add_epi16(_mm_mullo_epi16(v, a), round);
+		return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+	}
+
+	static void premultiplySSE2(unsigned char* rgba, size_t texels) {
+		const __m128i zero = _mm_setzero_si128();
+		size_t i = 0;
+		for (; i + 4 <= texels; i += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(rgba + 4 * i));
+			__m128i low = premultiply8SSE2(_mm_unpacklo_epi8(v, zero));
+			__m128i high = premultiply8SSE2(_mm_unpackhi_epi8(v, zero));
+			_mm_storeu_si128((__m128i*)(rgba + 4 * i), _mm_packus_epi16(low, high));
+		}
+		premultiplyScalar(rgba + 4 * i, texels - i);
+	}
+
+	GPS_TARGET_AVX2 static inline __m256i premultiply16AVX2(__m256i v) {
+		const __m256i colorMask = _mm256_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0);
+		const __m256i alphaLane = _mm256_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255);
+		const __m256i round = _mm256_set1_epi16(128);
+		__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+		a = _mm256_or_si256(_mm256_and_si256(a, colorMask), alphaLane);
+		__m256i x = _mm256_add_epi16(_mm256_mullo_epi16(v, a), round);
+		return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+	}
+
+	// unpack and pack both work per 128-bit lane, so the texel order is preserved
+	GPS_TARGET_AVX2 static void premultiplyAVX2(unsigned char* rgba, size_t texels) {
+		const __m256i zero = _mm256_setzero_si256();
+		size_t i = 0;
+		for (; i + 8 <= texels; i += 8) {
+			__m256i v = _mm256_loadu_si256((const __m256i*)(rgba + 4 * i));
+			__m256i low = premultiply16AVX2(_mm256_unpacklo_epi8(v, zero));
+			__m256i high = premultiply16AVX2(_mm256_unpackhi_epi8(v, zero));
+			_mm256_storeu_si256((__m256i*)(rgba + 4 * i), _mm256_packus_epi16(low, high));
+		}
+		premultiplySSE2(rgba + 4 * i, texels - i);
+	}
+#endif
+
+#if defined(GPS_NEON)
+	static inline uint8x8_t divide255NEON(uint16x8_t x) {
+		// (x + round(x / 256) + 128) / 256, same result as divide255
+		return vraddhn_u16(x, vrshrq_n_u16(x, 8));
+	}
+
+	static void premultiplyNEON(unsigned char* rgba, size_t texels) {
+		size_t i = 0;
+		for (; i + 8 <= texels; i += 8) {
+			uint8x8x4_t v = vld4_u8(rgba + 4 * i);
+			v.val[0] = divide255NEON(vmull_u8(v.val[0], v.val[3]));
+			v.val[1] = divide255NEON(vmull_u8(v.val[1], v.val[3]));
+			v.val[2] = divide255NEON(vmull_u8(v.val[2], v.val[3]));
+			vst4_u8(rgba + 4 * i, v);
+		}
+		premultiplyScalar(rgba + 4 * i, texels - i);
+	}
+#endif
+
+	void ImageProcessing::PremultiplyAlpha(unsigned char* rgba, size_t texels) {
+#if defined(GPS_X86)
+		if (GetInstructionSet() == AVX2) { premultiplyAVX2(rgba, texels); return; }
+		if (GetInstructionSet() == SSE2) { premultiplySSE2(rgba, texels); return; }
+#elif defined(GPS_NEON)
+		if (GetInstructionSet() == NEON) { premultiplyNEON(rgba, texels); return; }
+#endif
+		premultiplyScalar(rgba, texels);
+	}
+
+	// ---- sRGB box filter ----
+
+	// Linear values are 16-bit fixed point, so the sum of a 2x2 quad indexes the 4096-entry
+	// table back to sRGB after a shift
+	struct SRGBTables
+	{
+		unsigned int toLinear[256];
+		unsigned int toSRGB[4096];
+
+		SRGBTables() {
+			for (int i = 0; i < 256; i++) {
+				float c = i / 255.0f;
+				float linear = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+				toLinear[i] = (unsigned int)(linear * 65535.0f + 0.5f);
+			}
+			for (int i = 0; i < 4096; i++) {
+				// center of the bucket of quad sums that map to i
+				float linear = (i * 64 + 32) / (4.0f * 65535.0f);
+				float s = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+				int v = (int)(s * 255.0f + 0.5f);
+				toSRGB[i] = (unsigned int)(v < 0 ? 0 : (v > 255 ? 255 : v));
+			}
+		}
+	};
+
+	static const SRGBTables& srgbTables() {
+		static SRGBTables tables;
+		return tables;
+	}
+
+	static inline void downsampleTexel(const SRGBTables& tables, const unsigned char* p0, const unsigned char* p1,
+		const unsigned char* p2, const unsigned char* p3, unsigned char* out) {
+		for (int k = 0; k < 3; k++) {
+			unsigned int sum = tables.toLinear[p0[k]] + tables.toLinear[p1[k]] + tables.toLinear[p2[k]] + tables.toLinear[p3[k]];
+			out[k] = (unsigned char)tables.toSRGB[sum >> 6];
+		}
+		out[3] = (unsigned char)((p0[3] + p1[3] + p2[3] + p3[3] + 2) >> 2);
+	}
+
+	static void downsampleRow(const SRGBTables& tables, const unsigned char* row0, const unsigned char* row1,
+		int width, int w, unsigned char* out) {
+		for (int x = 0; x < w; x++) {
+			int x0 = 2 * x < width ? 2 * x : width - 1;
+			int x1 = 2 * x + 1 < width ? 2 * x + 1 : width - 1;
+			downsampleTexel(tables, row0 + 4 * x0, row0 + 4 * x1, row1 + 4 * x0, row1 + 4 * x1, out + 4 * x);
+		}
+	}
+
+	void ImageProcessing::DownsampleSRGB(const unsigned char* rgba, int width, int height, unsigned char* output) {
+		const SRGBTables& tables = srgbTables();
+		int w = width > 1 ? width / 2 : 1;
+		int h = height > 1 ? height / 2 : 1;
+
+		for (int y = 0; y < h; y++) {
+			int y0 = 2 * y < height ? 2 * y : height - 1;
+			int y1 = 2 * y + 1 < height ? 2 * y + 1 : height - 1;
+			const unsigned char* row0 = rgba + (size_t)y0 * width * 4;
+			const unsigned char* row1 = rgba + (size_t)y1 * width * 4;
+			unsigned char* out = output + (size_t)y * w * 4;
+
+			// the table lookups dominate - an AVX2 gather version measured no faster, so every
+			// instruction set shares this loop
+			downsampleRow(tables, row0, row1, width, w, out);
+		}
+	}
+
+	std::vector<std::vector<unsigned char> > ImageProcessing::BuildMipChain(const unsigned char* rgba, int width, int height) {
+		std::vector<std::vector<unsigned char> > levels;
+		const unsigned char* source = rgba;
+		while (width > 1 || height > 1) {
+			int w = width > 1 ? width / 2 : 1;
+			int h = height > 1 ? height / 2 : 1;
+			std::vector<unsigned char> level((size_t)w * h * 4);
+			DownsampleSRGB(source, width, height, level.data());
+			levels.push_back(std::vector<unsigned char>());
+			levels.back().swap(level);
+			source = levels.back().data();
+			width = w;
+			height = h;
+		}
+		return levels;
+	}
+}
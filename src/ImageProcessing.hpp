@@ -0,0 +1,49 @@
+#ifndef ImageProcessing_hpp
+#define ImageProcessing_hpp
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+// Pixel kernels used while loading textures. The row flip, RGB->RGBA expansion and alpha
+// premultiplication have SSE2/AVX2/NEON versions picked at runtime from what the CPU supports;
+// all versions give identical results
+class ImageProcessing
+{
+public:
+    enum InstructionSet
+    {
+        SCALAR,
+        SSE2,
+        AVX2,
+        NEON
+    };
+
+    // Best instruction set of this CPU, or the one forced with SetInstructionSet
+    static InstructionSet GetInstructionSet();
+    // Forces the kernels to use `set` (clamped to what the CPU supports) - for benchmarks
+    static void SetInstructionSet(InstructionSet set);
+    static bool IsSupported(InstructionSet set);
+    static const char* GetName(InstructionSet set);
+
+    // Mirrors the image vertically in place
+    static void FlipRows(unsigned char* pixels, int width, int height, int channels);
+
+    // Adds an opaque alpha channel to `texels` RGB texels
+    static void ExpandRGBToRGBA(const unsigned char* rgb, unsigned char* rgba, size_t texels);
+
+    // Multiplies the color channels of RGBA texels by their alpha, rounded to nearest
+    static void PremultiplyAlpha(unsigned char* rgba, size_t texels);
+
+    // Half-size RGBA image (at least 1x1): 2x2 box filter on linear color, alpha averaged as is.
+    // `output` must hold max(width / 2, 1) * max(height / 2, 1) texels
+    static void DownsampleSRGB(const unsigned char* rgba, int width, int height, unsigned char* output);
+
+    // Levels 1..n of the mip chain of an sRGB RGBA image, down to 1x1
+    static std::vector<std::vector<unsigned char> > BuildMipChain(const unsigned char* rgba, int width, int height);
+};
+
+}
+
+#endif /* ImageProcessing_hpp */
@@ -0,0 +1,186 @@
+#include "IndirectRenderer.hpp"
+
+#include <cstring>
+
+namespace gps {
+
+	// texels of per-draw data for each mesh
+	static const int DRAW_DATA_TEXELS = 3;
+	static constexpr uint32_t INDIRECT_DRAW = UniformHash("indirectDraw");
+
+	static IndirectRenderer::Stats stats = {};
+	// commands of every batch, uploaded together - only used on the GL thread
+	static std::vector<DrawElementsIndirectCommand> commandData;
+
+	bool IndirectRenderer::IsMultiDrawSupported()
+	{
+		return GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+	}
+
+	const IndirectRenderer::Stats& IndirectRenderer::GetStats()
+	{
+		return stats;
+	}
+
+	void IndirectRenderer::ResetStats()
+	{
+		stats = Stats();
+	}
+
+	IndirectRenderer::IndirectRenderer() : builtAsset(NULL), builtVersion(0)
+	{
+		glGenBuffers(1, &drawDataBuffer);
+		glGenBuffers(1, &drawIndexBuffer);
+		glGenBuffers(1, &commandBuffer);
+		glGenTextures(1, &drawDataTexture);
+	}
+
+	IndirectRenderer::~IndirectRenderer()
+	{
+		glDeleteTextures(1, &drawDataTexture);
+		glDeleteBuffers(1, &drawDataBuffer);
+		glDeleteBuffers(1, &drawIndexBuffer);
+		glDeleteBuffers(1, &commandBuffer);
+	}
+
+	void IndirectRenderer::Build(const ModelAsset& asset)
+	{
+		if (builtAsset == &asset && builtVersion == asset.version) {
+			return;
+		}
+		builtAsset = &asset;
+		builtVersion = asset.version;
+
+		// meshes drawing from the same arena, with the same index type and texture arrays share a batch
+		struct BatchKey
+		{
+			bool packed;
+			GLenum indexType;
+			GLuint arrays[3];
+		};
+		std::vector<BatchKey> keys;
+		batches.clear();
+		batchOfMesh.assign(asset.meshes.size(), 0);
+
+		std::vector<glm::vec4> drawData(asset.meshes.size() * DRAW_DATA_TEXELS);
+		std::vector<GLint> drawIndices(asset.meshes.size());
+		for (size_t i = 0; i < asset.meshes.size(); i++) {
+			const gps::Mesh& mesh = asset.meshes[i];
+			BatchKey key;
+			key.packed = mesh.getAllocation().packed;
+			key.indexType = mesh.getIndexType();
+			memset(key.arrays, 0, sizeof(key.arrays));
+			// -1 when the mesh has no texture of the type, as with the layer uniforms
+			GLint layers[3] = { -1, -1, -1 };
+			for (size_t t = 0; t < mesh.textures.size(); t++) {
+				int unit = Mesh::GetTextureUnit(mesh.textures[t].type);
+				if (unit >= 0 && mesh.textures[t].id != 0) {
+					key.arrays[unit] = mesh.textures[t].id;
+					layers[unit] = mesh.textures[t].layer;
+				}
+			}
+
+			size_t batch = 0;
+			while (batch < keys.size() && (keys[batch].packed != key.packed || keys[batch].indexType != key.indexType ||
+				memcmp(keys[batch].arrays, key.arrays, sizeof(key.arrays)) != 0)) {
+				batch++;
+			}
+			if (batch == keys.size()) {
+				keys.push_back(key);
+				Batch added;
+				added.mesh = i;
+				batches.push_back(added);
+			}
+			batchOfMesh[i] = batch;
+
+			// what the shaders otherwise read from the uniforms Mesh::bind sets
+			const VertexQuantization& quantization = mesh.getQuantization();
+			int diffuse = Mesh::GetTextureUnit("diffuseTexture");
+			int specular = Mesh::GetTextureUnit("specularTexture");
+			drawData[i * DRAW_DATA_TEXELS + 0] = glm::vec4(quantization.positionOffset, (float)layers[diffuse]);
+			drawData[i * DRAW_DATA_TEXELS + 1] = glm::vec4(quantization.positionScale, (float)layers[specular]);
+			drawData[i * DRAW_DATA_TEXELS + 2] = glm::vec4(quantization.texCoordOffset.x, quantization.texCoordOffset.y,
+				quantization.texCoordScale.x, quantization.texCoordScale.y);
+			drawIndices[i] = (GLint)i;
+		}
+
+		glBindBuffer(GL_TEXTURE_BUFFER, drawDataBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, drawData.size() * sizeof(glm::vec4), drawData.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		GLStateCache::BindTexture(DRAW_DATA_UNIT, GL_TEXTURE_BUFFER, drawDataTexture);
+		GLStateCache::ActiveTexture(DRAW_DATA_UNIT);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawDataBuffer);
+
+		glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, drawIndices.size() * sizeof(GLint), drawIndices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	std::vector<DrawElementsIndirectCommand>& IndirectRenderer::GetCommands(size_t mesh)
+	{
+		return batches[batchOfMesh[mesh]].commands;
+	}
+
+	void IndirectRenderer::Submit(const gps::Shader& shader, ModelAsset& asset)
+	{
+		bool multiDraw = IsMultiDrawSupported();
+		shader.useShaderProgram();
+		GLint indirectDrawLoc = shader.GetUniform(INDIRECT_DRAW);
+		shader.SetUniform(indirectDrawLoc, 1);
+		GLStateCache::BindTexture(DRAW_DATA_UNIT, GL_TEXTURE_BUFFER, drawDataTexture);
+
+		if (multiDraw) {
+			commandData.clear();
+			for (size_t b = 0; b < batches.size(); b++) {
+				commandData.insert(commandData.end(), batches[b].commands.begin(), batches[b].commands.end());
+			}
+			// orphaned every pass - the commands follow the levels of detail and the meshlet culling
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, commandData.size() * sizeof(DrawElementsIndirectCommand), commandData.data(), GL_STREAM_DRAW);
+		}
+
+		size_t firstCommand = 0;
+		for (size_t b = 0; b < batches.size(); b++) {
+			std::vector<DrawElementsIndirectCommand>& commands = batches[b].commands;
+			if (commands.empty()) {
+				continue;
+			}
+			gps::Mesh& mesh = asset.meshes[batches[b].mesh];
+			GLenum indexType = mesh.getIndexType();
+			mesh.bind(shader);
+			stats.commands += commands.size();
+
+			if (multiDraw) {
+				// the mesh index of base instance i is drawIndices[i]
+				glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+				glVertexAttribIPointer(DRAW_INDEX_ATTRIBUTE, 1, GL_INT, 0, (GLvoid*)0);
+				glVertexAttribDivisor(DRAW_INDEX_ATTRIBUTE, 1);
+				glEnableVertexAttribArray(DRAW_INDEX_ATTRIBUTE);
+				glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+				glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, (GLvoid*)(firstCommand * sizeof(DrawElementsIndirectCommand)),
+					(GLsizei)commands.size(), 0);
+				glDisableVertexAttribArray(DRAW_INDEX_ATTRIBUTE);
+				stats.multiDraws++;
+			}
+			else {
+				// no base instance before GL 4.2 - the disabled attribute takes its current value instead
+				size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+				for (size_t c = 0; c < commands.size(); c++) {
+					glVertexAttribI1i(DRAW_INDEX_ATTRIBUTE, (GLint)commands[c].baseInstance);
+					glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)commands[c].count, indexType,
+						(GLvoid*)(commands[c].firstIndex * indexSize), commands[c].baseVertex);
+				}
+				stats.draws += commands.size();
+			}
+
+			firstCommand += commands.size();
+			commands.clear();
+		}
+
+		if (multiDraw) {
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		}
+		shader.SetUniform(indirectDrawLoc, 0);
+	}
+}
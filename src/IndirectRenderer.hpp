@@ -0,0 +1,76 @@
+#ifndef IndirectRenderer_hpp
+#define IndirectRenderer_hpp
+
+#include "AssetManager.hpp"
+#include "Mesh.hpp"
+#include "Shader.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+// Draws the meshes of a model from lists of DrawElementsIndirectCommand, one list per batch of meshes sharing
+// their vertex format, index type and texture arrays. The dequantization and texture layers of every mesh sit
+// in a texture buffer built once, which the shaders read at the base instance of the command (the mesh index).
+// Each batch is one glMultiDrawElementsIndirect on GL 4.3 (or with ARB_multi_draw_indirect and
+// ARB_base_instance), and a loop of glDrawElementsBaseVertex on the 4.1 context otherwise
+class IndirectRenderer
+{
+public:
+    // Unit of the samplerBuffer "drawData" - after the texture types and the shadow map
+    static const int DRAW_DATA_UNIT = 4;
+    // Vertex attribute carrying the mesh index to the shaders
+    static const GLuint DRAW_INDEX_ATTRIBUTE = 3;
+
+    static bool IsMultiDrawSupported();
+
+    // Commands submitted, in glMultiDrawElementsIndirect calls or, without them, single draws
+    struct Stats
+    {
+        size_t commands;
+        size_t multiDraws;
+        size_t draws;
+    };
+    static const Stats& GetStats();
+    static void ResetStats();
+
+    IndirectRenderer();
+    ~IndirectRenderer();
+    IndirectRenderer(const IndirectRenderer&) = delete;
+    IndirectRenderer& operator=(const IndirectRenderer&) = delete;
+
+    // Builds the batches and the per-draw data of the meshes of `asset`, unless they are up to date
+    void Build(const ModelAsset& asset);
+
+    // Commands of the batch of mesh `mesh`, to be drawn by the next Submit
+    std::vector<DrawElementsIndirectCommand>& GetCommands(size_t mesh);
+
+    // Draws and clears the commands of every batch with `shader`, which must read the per-draw data
+    void Submit(const gps::Shader& shader, ModelAsset& asset);
+
+private:
+    struct Batch
+    {
+        // mesh binding the textures and the vertex array for the batch
+        size_t mesh;
+        std::vector<DrawElementsIndirectCommand> commands;
+    };
+
+    std::vector<Batch> batches;
+    std::vector<size_t> batchOfMesh;
+    // what the batches were built from
+    const ModelAsset* builtAsset;
+    unsigned int builtVersion;
+
+    // 3 RGBA32F texels per mesh, seen through drawDataTexture
+    GLuint drawDataBuffer;
+    GLuint drawDataTexture;
+    // mesh index of every base instance, an instanced attribute
+    GLuint drawIndexBuffer;
+    GLuint commandBuffer;
+};
+
+}
+
+#endif /* IndirectRenderer_hpp */
@@ -0,0 +1,249 @@
+#include "Ktx2File.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace gps {
+
+	// Layout (https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html):
+	//   identifier, header, index, level index, data format descriptor, key/value data,
+	//   mip levels from the smallest to the largest
+	static const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+	struct Ktx2Header
+	{
+		uint32_t vkFormat;
+		uint32_t typeSize;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t layerCount;
+		uint32_t faceCount;
+		uint32_t levelCount;
+		uint32_t supercompressionScheme;
+		uint32_t dfdByteOffset;
+		uint32_t dfdByteLength;
+		uint32_t kvdByteOffset;
+		uint32_t kvdByteLength;
+		// 64-bit values in the file, split so the struct has no padding after kvdByteLength
+		uint32_t sgdByteOffset[2];
+		uint32_t sgdByteLength[2];
+	};
+
+	struct Ktx2Level
+	{
+		uint64_t byteOffset;
+		uint64_t byteLength;
+		uint64_t uncompressedByteLength;
+	};
+
+	static void appendU32(std::vector<unsigned char>& data, uint32_t value) {
+		for (int k = 0; k < 4; k++) {
+			data.push_back((unsigned char)((value >> (8 * k)) & 0xFF));
+		}
+	}
+
+	static void appendKeyValue(std::vector<unsigned char>& data, std::string key, std::string value) {
+		appendU32(data, (uint32_t)(key.size() + 1 + value.size() + 1));
+		data.insert(data.end(), key.begin(), key.end());
+		data.push_back(0);
+		data.insert(data.end(), value.begin(), value.end());
+		data.push_back(0);
+		while (data.size() % 4 != 0) {
+			data.push_back(0);
+		}
+	}
+
+	// Basic data format descriptor of the BC1/BC3 sRGB formats
+	static std::vector<unsigned char> basicDescriptor(uint32_t vkFormat) {
+		bool alpha = vkFormat == Ktx2File::VK_FORMAT_BC3_SRGB_BLOCK;
+		uint32_t samples = alpha ? 2 : 1;
+		uint32_t blockSize = 24 + 16 * samples;
+
+		std::vector<unsigned char> data;
+		appendU32(data, 4 + blockSize);                 // dfdTotalSize
+		appendU32(data, 0);                             // vendorId (Khronos), descriptorType (basic)
+		appendU32(data, 2 | (blockSize << 16));         // versionNumber, descriptorBlockSize
+		// colorModel (BC1A / BC3), colorPrimaries (BT709), transferFunction (sRGB), flags
+		appendU32(data, (alpha ? 130 : 128) | (1 << 8) | (2 << 16));
+		appendU32(data, 3 | (3 << 8));                  // texelBlockDimension 4x4x1x1
+		appendU32(data, Ktx2File::GetBlockBytes(vkFormat)); // bytesPlane0
+		appendU32(data, 0);                             // bytesPlane4-7
+		if (alpha) {
+			// alpha block (linear), then color block
+			appendU32(data, 0 | (63 << 16) | ((15 | 0x10) << 24));
+			appendU32(data, 0);
+			appendU32(data, 0);
+			appendU32(data, 0xFFFFFFFF);
+			appendU32(data, 64 | (63 << 16));
+		}
+		else {
+			appendU32(data, 0 | (63 << 16));
+		}
+		appendU32(data, 0);
+		appendU32(data, 0);
+		appendU32(data, 0xFFFFFFFF);
+		return data;
+	}
+
+	Ktx2File::Ktx2File() : vkFormat(0), width(0), height(0), orientation("rd")
+	{
+	}
+
+	uint32_t Ktx2File::GetBlockBytes(uint32_t vkFormat) {
+		switch (vkFormat) {
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+			return 8;
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	bool Ktx2File::Read(std::string fileName) {
+		std::ifstream file(fileName.c_str(), std::ios::binary);
+		if (!file) {
+			return false;
+		}
+		std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+		Ktx2Header header;
+		if (data.size() < sizeof(KTX2_IDENTIFIER) + sizeof(Ktx2Header) ||
+			memcmp(data.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+			fprintf(stderr, "ERROR: %s is not a KTX2 file\n", fileName.c_str());
+			return false;
+		}
+		memcpy(&header, data.data() + sizeof(KTX2_IDENTIFIER), sizeof(Ktx2Header));
+
+		// only what the converter writes: one 2D image with its full mip chain, no supercompression
+		uint32_t blockBytes = GetBlockBytes(header.vkFormat);
+		if (blockBytes == 0 || header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth != 0 ||
+			header.layerCount > 1 || header.faceCount != 1 || header.supercompressionScheme != 0) {
+			fprintf(stderr, "ERROR: unsupported KTX2 layout in %s\n", fileName.c_str());
+			return false;
+		}
+		uint32_t fullChain = 1;
+		for (uint32_t size = header.pixelWidth > header.pixelHeight ? header.pixelWidth : header.pixelHeight; size > 1; size >>= 1) {
+			fullChain++;
+		}
+		if (header.levelCount != fullChain) {
+			fprintf(stderr, "ERROR: %s has %u mip levels, %u expected for %ux%u\n", fileName.c_str(), header.levelCount, fullChain,
+				header.pixelWidth, header.pixelHeight);
+			return false;
+		}
+
+		size_t levelIndexOffset = sizeof(KTX2_IDENTIFIER) + sizeof(Ktx2Header);
+		if (levelIndexOffset + header.levelCount * sizeof(Ktx2Level) > data.size()) {
+			return false;
+		}
+
+		vkFormat = header.vkFormat;
+		width = header.pixelWidth;
+		height = header.pixelHeight;
+		levels.assign(header.levelCount, std::vector<unsigned char>());
+		for (uint32_t level = 0; level < header.levelCount; level++) {
+			Ktx2Level entry;
+			memcpy(&entry, data.data() + levelIndexOffset + level * sizeof(Ktx2Level), sizeof(Ktx2Level));
+			// the uploads read whole 4x4 blocks - a short level would read past its data
+			uint64_t levelWidth = header.pixelWidth >> level ? header.pixelWidth >> level : 1;
+			uint64_t levelHeight = header.pixelHeight >> level ? header.pixelHeight >> level : 1;
+			uint64_t levelBytes = ((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * blockBytes;
+			if (entry.byteLength != levelBytes || entry.byteOffset > data.size() || entry.byteLength > data.size() - entry.byteOffset) {
+				fprintf(stderr, "ERROR: level %u of %s is not %llu bytes\n", level, fileName.c_str(), (unsigned long long)levelBytes);
+				levels.clear();
+				return false;
+			}
+			levels[level].assign(data.begin() + (size_t)entry.byteOffset, data.begin() + (size_t)(entry.byteOffset + entry.byteLength));
+		}
+
+		orientation = "rd";
+		size_t offset = header.kvdByteOffset;
+		size_t end = (size_t)header.kvdByteOffset + header.kvdByteLength;
+		while (end <= data.size() && offset + 4 <= end) {
+			uint32_t length;
+			memcpy(&length, data.data() + offset, 4);
+			if (offset + 4 + length > end) {
+				break;
+			}
+			// the key and the value each end with a NUL inside the entry - a malformed one is skipped
+			const char* entry = (const char*)data.data() + offset + 4;
+			const char* keyEnd = (const char*)memchr(entry, 0, length);
+			if (keyEnd) {
+				std::string key(entry, keyEnd - entry);
+				const char* value = keyEnd + 1;
+				size_t valueLength = length - (size_t)(value - entry);
+				const char* valueEnd = (const char*)memchr(value, 0, valueLength);
+				if (key == "KTXorientation" && valueEnd) {
+					orientation = std::string(value, valueEnd - value);
+				}
+			}
+			offset = (offset + 4 + length + 3) & ~(size_t)3;
+		}
+
+		return true;
+	}
+
+	bool Ktx2File::Write(std::string fileName) const {
+		uint32_t blockBytes = GetBlockBytes(vkFormat);
+		if (blockBytes == 0 || levels.empty()) {
+			return false;
+		}
+
+		std::vector<unsigned char> descriptor = basicDescriptor(vkFormat);
+		std::vector<unsigned char> keyValues;
+		appendKeyValue(keyValues, "KTXorientation", orientation);
+		appendKeyValue(keyValues, "KTXwriter", "gps TextureConverter");
+
+		Ktx2Header header;
+		header.vkFormat = vkFormat;
+		header.typeSize = 1;
+		header.pixelWidth = width;
+		header.pixelHeight = height;
+		header.pixelDepth = 0;
+		header.layerCount = 0;
+		header.faceCount = 1;
+		header.levelCount = (uint32_t)levels.size();
+		header.supercompressionScheme = 0;
+		header.dfdByteOffset = (uint32_t)(sizeof(KTX2_IDENTIFIER) + sizeof(Ktx2Header) + levels.size() * sizeof(Ktx2Level));
+		header.dfdByteLength = (uint32_t)descriptor.size();
+		header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+		header.kvdByteLength = (uint32_t)keyValues.size();
+		header.sgdByteOffset[0] = header.sgdByteOffset[1] = 0;
+		header.sgdByteLength[0] = header.sgdByteLength[1] = 0;
+
+		// levels are stored smallest first, each aligned to the block size
+		std::vector<Ktx2Level> levelIndex(levels.size());
+		uint64_t offset = header.kvdByteOffset + header.kvdByteLength;
+		for (size_t i = levels.size(); i-- > 0;) {
+			offset = (offset + blockBytes - 1) / blockBytes * blockBytes;
+			levelIndex[i].byteOffset = offset;
+			levelIndex[i].byteLength = levels[i].size();
+			levelIndex[i].uncompressedByteLength = levels[i].size();
+			offset += levels[i].size();
+		}
+
+		std::ofstream file(fileName.c_str(), std::ios::binary | std::ios::trunc);
+		if (!file) {
+			fprintf(stderr, "ERROR: could not write %s\n", fileName.c_str());
+			return false;
+		}
+		file.write((const char*)KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+		file.write((const char*)&header, sizeof(Ktx2Header));
+		file.write((const char*)levelIndex.data(), levelIndex.size() * sizeof(Ktx2Level));
+		file.write((const char*)descriptor.data(), descriptor.size());
+		file.write((const char*)keyValues.data(), keyValues.size());
+
+		uint64_t position = header.kvdByteOffset + header.kvdByteLength;
+		static const char padding[16] = { 0 };
+		for (size_t i = levels.size(); i-- > 0;) {
+			file.write(padding, (std::streamsize)(levelIndex[i].byteOffset - position));
+			file.write((const char*)levels[i].data(), levels[i].size());
+			position = levelIndex[i].byteOffset + levels[i].size();
+		}
+
+		return (bool)file;
+	}
+}
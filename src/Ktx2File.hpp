@@ -0,0 +1,37 @@
+#ifndef Ktx2File_hpp
+#define Ktx2File_hpp
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+// Minimal KTX2 container: one 2D image with its mip chain, no supercompression
+class Ktx2File
+{
+public:
+    // Vulkan format ids used by the texture pipeline
+    static const uint32_t VK_FORMAT_BC1_RGB_SRGB_BLOCK = 132;
+    static const uint32_t VK_FORMAT_BC3_SRGB_BLOCK = 138;
+
+    uint32_t vkFormat;
+    uint32_t width;
+    uint32_t height;
+    // "ru" when the first row is the bottom of the image (GL convention), "rd" otherwise
+    std::string orientation;
+    // Level 0 is the full size image
+    std::vector<std::vector<unsigned char> > levels;
+
+    Ktx2File();
+
+    bool Read(std::string fileName);
+    bool Write(std::string fileName) const;
+
+    // Bytes per 4x4 block, 0 for formats this reader does not know
+    static uint32_t GetBlockBytes(uint32_t vkFormat);
+};
+
+}
+
+#endif /* Ktx2File_hpp */
@@ -1,71 +1,346 @@
 #include "Mesh.hpp"
 namespace gps {
 
+	VertexQuantization::VertexQuantization() : packed(false), positionOffset(0.0f), positionScale(1.0f), texCoordOffset(0.0f), texCoordScale(1.0f)
+	{
+	}
+
+	MeshData::MeshData() : indexType(GL_UNSIGNED_INT), boundsCenter(0.0f), boundsRadius(0.0f), externalVertices(NULL), externalVertexCount(0), externalIndices(NULL), externalIndexCount(0)
+	{
+	}
+
+	const Vertex* MeshData::GetVertices() const {
+		return externalVertices ? externalVertices : vertices.data();
+	}
+
+	GLsizei MeshData::GetVertexCount() const {
+		return externalVertices ? externalVertexCount : (GLsizei)vertices.size();
+	}
+
+	const void* MeshData::GetVertexData() const {
+		return packedVertices.empty() ? (const void*)GetVertices() : (const void*)packedVertices.data();
+	}
+
+	GLsizeiptr MeshData::GetVertexDataSize() const {
+		return packedVertices.empty() ? (GLsizeiptr)GetVertexCount() * sizeof(Vertex) : (GLsizeiptr)packedVertices.size() * sizeof(PackedVertex);
+	}
+
+	const void* MeshData::GetIndexData() const {
+		if (externalIndices) {
+			return externalIndices;
+		}
+		return indexType == GL_UNSIGNED_SHORT ? (const void*)shortIndices.data() : (const void*)indices.data();
+	}
+
+	GLsizeiptr MeshData::GetIndexDataSize() const {
+		return (GLsizeiptr)GetIndexCount() * (indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+	}
+
+	GLsizei MeshData::GetIndexCount() const {
+		if (externalIndices) {
+			return externalIndexCount;
+		}
+		return indexType == GL_UNSIGNED_SHORT ? (GLsizei)shortIndices.size() : (GLsizei)indices.size();
+	}
+
+	size_t MeshData::GetMemoryBytes() const {
+		return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(GLuint) +
+			shortIndices.capacity() * sizeof(GLushort) + packedVertices.capacity() * sizeof(PackedVertex);
+	}
+
+	ClusterView::ClusterView() : eye(0.0f, 0.0f, 0.0f, 1.0f), cones(false)
+	{
+		for (int p = 0; p < 6; p++) {
+			planes[p] = glm::vec4(0.0f);
+		}
+	}
+
+	// Planes of the clip volume -w <= x, y, z <= w (Gribb and Hartmann)
+	ClusterView::ClusterView(const glm::mat4& viewProjection, const glm::vec4& eye) : eye(eye), cones(true)
+	{
+		glm::vec4 rows[4];
+		for (int r = 0; r < 4; r++) {
+			rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+		}
+		for (int axis = 0; axis < 3; axis++) {
+			planes[axis * 2 + 0] = rows[3] + rows[axis];
+			planes[axis * 2 + 1] = rows[3] - rows[axis];
+		}
+	}
+
+	ClusterView ClusterView::ToObjectSpace(const glm::mat4& model) const
+	{
+		ClusterView view;
+		// a plane p of world space points x is transpose(model) * p for the object space points model^-1 * x
+		glm::mat4 transposed = glm::transpose(model);
+		for (int p = 0; p < 6; p++) {
+			view.planes[p] = transposed * planes[p];
+		}
+		view.eye = glm::inverse(model) * eye;
+		view.cones = cones && glm::determinant(glm::mat3(model)) > 0.0f;
+		return view;
+	}
+
+	bool ClusterView::IsOutside(const Meshlet& meshlet) const
+	{
+		for (int p = 0; p < 6; p++) {
+			glm::vec3 normal(planes[p]);
+			if (glm::dot(normal, meshlet.center) + planes[p].w < -meshlet.radius * glm::length(normal)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool ClusterView::IsBackfacing(const Meshlet& meshlet) const
+	{
+		if (!cones || meshlet.coneCutoff > 1.0f) {
+			return false;
+		}
+		glm::vec3 direction = eye.w != 0.0f ? meshlet.coneApex - glm::vec3(eye) / eye.w : glm::vec3(eye);
+		float length = glm::length(direction);
+		if (length == 0.0f) {
+			return false;
+		}
+		return glm::dot(direction, meshlet.coneAxis) >= meshlet.coneCutoff * length;
+	}
+
 	/* Mesh Constructor */
 	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures)
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		this->vertices = std::move(vertices);
+		this->indices = std::move(indices);
+		this->textures = std::move(textures);
+		this->indexType = GL_UNSIGNED_INT;
 
-		this->setupMesh();
+		this->setupMesh(this->vertices.data(), (GLsizei)this->vertices.size(), this->indices.data(), (GLsizei)this->indices.size());
+	}
+
+	Mesh::Mesh(const void* vertexData, GLsizei vertexCount, const VertexQuantization& quantization,
+		const void* indexData, GLsizei indexCount, GLenum indexType, std::vector<Texture> textures)
+	{
+		this->textures = std::move(textures);
+		this->quantization = quantization;
+		this->indexType = indexType;
+
+		this->setupMesh(vertexData, vertexCount, indexData, indexCount);
 	}
 	
 	Buffers Mesh::getBuffers() {
-	    return this->buffers;
+		const GeometryArena& arena = GeometryArena::Get(this->allocation.packed);
+		Buffers buffers;
+		buffers.VAO = arena.GetVertexArray();
+		buffers.VBO = arena.GetVertexBuffer();
+		buffers.EBO = arena.GetIndexBuffer();
+		buffers.baseVertex = this->allocation.firstVertex;
+		buffers.indexOffset = this->allocation.indexOffset;
+		return buffers;
+	}
+
+	const GeometryAllocation& Mesh::getAllocation() const {
+		return this->allocation;
+	}
+
+	GLenum Mesh::getIndexType() const {
+		return this->indexType;
+	}
+
+	const VertexQuantization& Mesh::getQuantization() const {
+		return this->quantization;
 	}
 
 	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)
+	void Mesh::Draw(const gps::Shader& shader, int lod)
+	{
+		this->bind(shader);
+		size_t indexSize = this->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		glDrawElementsBaseVertex(GL_TRIANGLES, this->lods[lod].indexCount, this->indexType,
+			(GLvoid*)(this->allocation.indexOffset + this->lods[lod].firstIndex * indexSize), this->allocation.firstVertex);
+	}
+
+	// Runs of visible meshlets of the last DrawClusters - only used on the GL thread
+	static std::vector<DrawElementsIndirectCommand> clusterCommands;
+	static std::vector<GLsizei> clusterCounts;
+	static std::vector<const GLvoid*> clusterOffsets;
+	static std::vector<GLint> clusterBaseVertices;
+
+	void Mesh::DrawClusters(const gps::Shader& shader, const ClusterView& view,
+		size_t& outsideClusters, size_t& backfacingClusters, size_t& culledTriangles)
+	{
+		clusterCommands.clear();
+		AppendClusterCommands(view, 0, clusterCommands, outsideClusters, backfacingClusters, culledTriangles);
+		if (clusterCommands.empty()) {
+			return;
+		}
+
+		size_t indexSize = this->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		clusterCounts.resize(clusterCommands.size());
+		clusterOffsets.resize(clusterCommands.size());
+		clusterBaseVertices.resize(clusterCommands.size());
+		for (size_t c = 0; c < clusterCommands.size(); c++) {
+			clusterCounts[c] = (GLsizei)clusterCommands[c].count;
+			clusterOffsets[c] = (const GLvoid*)(clusterCommands[c].firstIndex * indexSize);
+			clusterBaseVertices[c] = clusterCommands[c].baseVertex;
+		}
+		this->bind(shader);
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, clusterCounts.data(), this->indexType, clusterOffsets.data(),
+			(GLsizei)clusterCounts.size(), clusterBaseVertices.data());
+	}
+
+	void Mesh::AppendCommand(int lod, GLuint drawIndex, std::vector<DrawElementsIndirectCommand>& commands) const
+	{
+		size_t indexSize = this->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		DrawElementsIndirectCommand command;
+		command.count = (GLuint)this->lods[lod].indexCount;
+		command.instanceCount = 1;
+		command.firstIndex = (GLuint)(this->allocation.indexOffset / indexSize) + this->lods[lod].firstIndex;
+		command.baseVertex = this->allocation.firstVertex;
+		command.baseInstance = drawIndex;
+		commands.push_back(command);
+	}
+
+	void Mesh::AppendClusterCommands(const ClusterView& view, GLuint drawIndex, std::vector<DrawElementsIndirectCommand>& commands,
+		size_t& outsideClusters, size_t& backfacingClusters, size_t& culledTriangles) const
+	{
+		size_t indexSize = this->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		GLuint firstIndex = (GLuint)(this->allocation.indexOffset / indexSize);
+		size_t firstCommand = commands.size();
+		GLuint runEnd = 0;
+		for (size_t m = 0; m < this->meshlets.size(); m++) {
+			const Meshlet& meshlet = this->meshlets[m];
+			if (view.IsOutside(meshlet)) {
+				outsideClusters++;
+				culledTriangles += meshlet.indexCount / 3;
+				continue;
+			}
+			if (view.IsBackfacing(meshlet)) {
+				backfacingClusters++;
+				culledTriangles += meshlet.indexCount / 3;
+				continue;
+			}
+
+			// neighbouring visible meshlets are drawn as one range
+			if (commands.size() > firstCommand && meshlet.firstIndex == runEnd) {
+				commands.back().count += meshlet.indexCount;
+			}
+			else {
+				DrawElementsIndirectCommand command;
+				command.count = (GLuint)meshlet.indexCount;
+				command.instanceCount = 1;
+				command.firstIndex = firstIndex + meshlet.firstIndex;
+				command.baseVertex = this->allocation.firstVertex;
+				command.baseInstance = drawIndex;
+				commands.push_back(command);
+			}
+			runEnd = meshlet.firstIndex + meshlet.indexCount;
+		}
+	}
+
+	// one texture unit per type, the layer uniform of each is the type name + "Layer"
+	static const char* const TEXTURE_TYPES[] = { "ambientTexture", "diffuseTexture", "specularTexture" };
+	static constexpr uint32_t TEXTURE_LAYERS[] = { UniformHash("ambientTextureLayer"), UniformHash("diffuseTextureLayer"), UniformHash("specularTextureLayer") };
+	static constexpr uint32_t POSITION_OFFSET = UniformHash("positionOffset");
+	static constexpr uint32_t POSITION_SCALE = UniformHash("positionScale");
+	static constexpr uint32_t TEX_COORD_OFFSET = UniformHash("texCoordOffset");
+	static constexpr uint32_t TEX_COORD_SCALE = UniformHash("texCoordScale");
+	static constexpr uint32_t OCTAHEDRAL_NORMALS = UniformHash("octahedralNormals");
+	static const int TEXTURE_UNITS = 3;
+
+	int Mesh::GetTextureUnit(const std::string& type)
+	{
+		for (int unit = 0; unit < TEXTURE_UNITS; unit++) {
+			if (type == TEXTURE_TYPES[unit]) {
+				return unit;
+			}
+		}
+		return -1;
+	}
+
+	void Mesh::bind(const gps::Shader& shader)
 	{
 		shader.useShaderProgram();
 
-		//set textures
-		for (GLuint i = 0; i < textures.size(); i++)
+		// -1 tells the shader the mesh has no texture of that type
+		GLint layers[TEXTURE_UNITS] = { -1, -1, -1 };
+		// a shader that samples no texture of a type (the depth pass) needs nothing bound for it
+		GLint layerLocations[TEXTURE_UNITS];
+		for (int unit = 0; unit < TEXTURE_UNITS; unit++) {
+			layerLocations[unit] = shader.GetUniform(TEXTURE_LAYERS[unit]);
+		}
+		for (size_t i = 0; i < textures.size(); i++)
 		{
-			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
-			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
-		}
-
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
-
-        for(GLuint i = 0; i < this->textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, 0);
-        }
-
-    }
-
-	// Initializes all the buffer objects/arrays
-	void Mesh::setupMesh(){
-		// Create buffers/arrays
-		glGenVertexArrays(1, &this->buffers.VAO);
-		glGenBuffers(1, &this->buffers.VBO);
-		glGenBuffers(1, &this->buffers.EBO);
-
-		glBindVertexArray(this->buffers.VAO);
-		// Load data into vertex buffers
-		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
-
-		// Set the vertex attribute pointers
-		// Vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-		// Vertex Normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-		// Vertex Texture Coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
-
-		glBindVertexArray(0);
+			int unit = GetTextureUnit(this->textures[i].type);
+			if (unit < 0 || layerLocations[unit] < 0 || this->textures[i].id == 0) {
+				continue;
+			}
+			layers[unit] = this->textures[i].layer;
+			GLStateCache::BindTexture(unit, GL_TEXTURE_2D_ARRAY, this->textures[i].id);
+		}
+		for (int unit = 0; unit < TEXTURE_UNITS; unit++) {
+			if (layerLocations[unit] >= 0) {
+				shader.SetUniform(layerLocations[unit], layers[unit]);
+			}
+		}
+
+		// identity for float vertices
+		shader.SetUniform(shader.GetUniform(POSITION_OFFSET), this->quantization.positionOffset);
+		shader.SetUniform(shader.GetUniform(POSITION_SCALE), this->quantization.positionScale);
+		shader.SetUniform(shader.GetUniform(TEX_COORD_OFFSET), this->quantization.texCoordOffset);
+		shader.SetUniform(shader.GetUniform(TEX_COORD_SCALE), this->quantization.texCoordScale);
+		shader.SetUniform(shader.GetUniform(OCTAHEDRAL_NORMALS), (GLint)this->quantization.packed);
+
+		// the same vertex array for every mesh of the format
+		GLStateCache::BindVertexArray(GeometryArena::Get(this->allocation.packed).GetVertexArray());
+	}
+
+	size_t Mesh::ReleaseGeometry(GeometryRetention retention) {
+		size_t before = GetGeometryBytes();
+		if (retention == GEOMETRY_POSITIONS && !this->vertices.empty()) {
+			std::vector<glm::vec3> positions(this->vertices.size());
+			for (size_t v = 0; v < this->vertices.size(); v++) {
+				positions[v] = this->vertices[v].Position;
+			}
+			this->positions.swap(positions);
+		}
+		if (retention != GEOMETRY_KEEP) {
+			// swap with empty vectors - clear() keeps the capacity
+			std::vector<Vertex>().swap(this->vertices);
+		}
+		if (retention == GEOMETRY_DISCARD) {
+			std::vector<GLuint>().swap(this->indices);
+			std::vector<glm::vec3>().swap(this->positions);
+		}
+		size_t after = GetGeometryBytes();
+		return before > after ? before - after : 0;
+	}
+
+	size_t Mesh::GetGeometryBytes() const {
+		return this->vertices.capacity() * sizeof(Vertex) + this->indices.capacity() * sizeof(GLuint) +
+			this->positions.capacity() * sizeof(glm::vec3);
+	}
+
+	// Places the geometry in the arena of its vertex format
+	void Mesh::setupMesh(const void* vertexData, GLsizei vertexCount, const void* indexData, GLsizei indexCount){
+		this->indexCount = indexCount;
+		MeshLod full = { 0, indexCount, 0.0f };
+		this->lods.assign(1, full);
+		this->boundsCenter = glm::vec3(0.0f);
+		this->boundsRadius = 0.0f;
+
+		GeometryArena& arena = GeometryArena::Get(this->quantization.packed);
+		size_t indexSize = this->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		this->allocation = arena.Allocate(vertexCount, (GLsizeiptr)indexCount * indexSize);
+
+		// the copy target leaves the element array binding of the bound vertex array alone
+		if (vertexData) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, arena.GetVertexBuffer());
+			glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)this->allocation.firstVertex * arena.GetStride(),
+				(GLsizeiptr)vertexCount * arena.GetStride(), vertexData);
+		}
+		if (indexData) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, arena.GetIndexBuffer());
+			glBufferSubData(GL_COPY_WRITE_BUFFER, this->allocation.indexOffset, (GLsizeiptr)indexCount * indexSize, indexData);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
 	}
 }
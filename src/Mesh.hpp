@@ -5,8 +5,10 @@
 #include "glm.hpp"
 
 #include "Shader.hpp"
+#include "GeometryArena.hpp"
 
 #include <string>
+#include <utility>
 #include <vector>
 
 
@@ -19,9 +21,33 @@ struct Vertex
     glm::vec2 TexCoords;
 };
 
+// 16-byte vertex: position in unorm16 relative to the bounds of the model, octahedral normal in 2x unorm16
+// and texture coordinates in unorm16 relative to their range in the mesh. The shaders dequantize it
+struct PackedVertex
+{
+    // w is unused, it keeps the normal 4-byte aligned
+    GLushort Position[4];
+    GLushort Normal[2];
+    GLushort TexCoords[2];
+};
+
+// Maps packed vertices back to object space - offset 0 and scale 1 for float vertices
+struct VertexQuantization
+{
+    bool packed;
+    glm::vec3 positionOffset;
+    glm::vec3 positionScale;
+    glm::vec2 texCoordOffset;
+    glm::vec2 texCoordScale;
+
+    VertexQuantization();
+};
+
 struct Texture
 {
+    // GL_TEXTURE_2D_ARRAY holding the texture, and its layer in it
     GLuint id;
+    GLint layer;
     //ambientTexture, diffuseTexture, specularTexture
     std::string type;
     std::string path;
@@ -34,31 +60,202 @@ struct Material
         glm::vec3 specular;
     };
 
+// Range of the index buffer drawn at one level of detail
+struct MeshLod
+{
+    GLuint firstIndex;
+    GLsizei indexCount;
+    // How far (object space units) the surface may be from the full detail one
+    float error;
+};
+
+// Cluster of consecutive full detail triangles, culled as a whole when it is off screen or faces away
+struct Meshlet
+{
+    GLuint firstIndex;
+    GLsizei indexCount;
+    // bounding sphere (object space)
+    glm::vec3 center;
+    float radius;
+    // normal cone: every triangle faces away from an eye for which dot(normalize(coneApex - eye), coneAxis) >= coneCutoff.
+    // The cutoff is over 1 when the normals are too spread out for that to happen
+    glm::vec3 coneApex;
+    glm::vec3 coneAxis;
+    float coneCutoff;
+};
+
+// View the meshlets are culled against
+struct ClusterView
+{
+    // frustum planes, dot(plane, (p, 1)) >= 0 inside
+    glm::vec4 planes[6];
+    // eye position (w = 1) or, for orthographic views, the viewing direction (w = 0)
+    glm::vec4 eye;
+    // false when the transform mirrors the geometry, which turns the front faces into back faces
+    bool cones;
+
+    ClusterView();
+    ClusterView(const glm::mat4& viewProjection, const glm::vec4& eye);
+
+    // The same view in the object space of geometry drawn with `model`
+    ClusterView ToObjectSpace(const glm::mat4& model) const;
+
+    bool IsOutside(const Meshlet& meshlet) const;
+    bool IsBackfacing(const Meshlet& meshlet) const;
+};
+
+// CPU-side geometry of one mesh, built before the GL upload (possibly off the GL thread)
+struct MeshData
+{
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    // GL_UNSIGNED_SHORT once the indices fit 16 bits and have been moved to shortIndices
+    GLenum indexType;
+    std::vector<GLushort> shortIndices;
+    // Only type and path are set - ids are resolved when the mesh is uploaded
+    std::vector<Texture> textures;
+    // Vertices uploaded instead of the float ones when they are not empty
+    std::vector<PackedVertex> packedVertices;
+    VertexQuantization quantization;
+    // Levels of detail, full detail first - empty when the whole index buffer is the only level
+    std::vector<MeshLod> lods;
+    // Clusters covering the full detail level, empty when the mesh has none
+    std::vector<Meshlet> meshlets;
+    // Bounding sphere of the vertices
+    glm::vec3 boundsCenter;
+    float boundsRadius;
+
+    // Geometry stored outside the vectors (e.g. in a mapped cache file), NULL when the vectors are used
+    const Vertex* externalVertices;
+    GLsizei externalVertexCount;
+    // GLuint or GLushort values, as given by indexType
+    const void* externalIndices;
+    GLsizei externalIndexCount;
+
+    MeshData();
+
+    const Vertex* GetVertices() const;
+    GLsizei GetVertexCount() const;
+    // What goes to the vertex buffer - the packed vertices if there are any, the float ones otherwise
+    const void* GetVertexData() const;
+    GLsizeiptr GetVertexDataSize() const;
+    // What goes to the index buffer - indexType values
+    const void* GetIndexData() const;
+    GLsizeiptr GetIndexDataSize() const;
+    GLsizei GetIndexCount() const;
+
+    // System memory taken by the vectors - not by the external geometry
+    size_t GetMemoryBytes() const;
+};
+
+// One draw of glMultiDrawElementsIndirect - the layout is fixed by GL
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    // in indices from the start of the index buffer
+    GLuint firstIndex;
+    GLint baseVertex;
+    // picks the per-draw data of the draw (see gps::IndirectRenderer)
+    GLuint baseInstance;
+};
+
+// What a mesh keeps of its geometry in system memory once it is on the GPU
+enum GeometryRetention
+{
+    // only the GL buffers remain
+    GEOMETRY_DISCARD,
+    GEOMETRY_KEEP,
+    // positions and indices, e.g. for collision or picking
+    GEOMETRY_POSITIONS
+};
+
+// Vertex array and buffers of the arena holding a mesh - shared by every mesh of its vertex format
 struct Buffers {
     GLuint VAO;
     GLuint VBO;
     GLuint EBO;
+    // first vertex of the mesh in VBO, and byte offset of its indices in EBO
+    GLint baseVertex;
+    GLintptr indexOffset;
 };
 
 class Mesh
 {
 public:
+    // Levels of detail a mesh can have, including the full detail one
+    static const size_t MAX_LODS = 4;
+
+    // Texture unit of each texture type (0 ambient, 1 diffuse, 2 specular), -1 for an unknown one.
+    // The sampler2DArray uniforms named after the types must be set to these units
+    static int GetTextureUnit(const std::string& type);
+
+    // CPU copy of the geometry - empty unless the mesh was built from vectors or kept by its model
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
+    // vertex positions, when only those are kept
+    std::vector<glm::vec3> positions;
     std::vector<Texture> textures;
+    // One level covering all the indices unless set from the MeshData
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+    glm::vec3 boundsCenter;
+    float boundsRadius;
 
+	// Takes over the vectors - pass them with std::move to avoid copying the geometry
 	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
 
+	// Uploads the geometry straight from external memory (e.g. a mapped cache file) without keeping a CPU copy.
+	// `vertexData` holds Vertex or, when `quantization.packed` is set, PackedVertex structures.
+	// `indexData` holds GLuint or GLushort values, as given by `indexType`.
+	// With NULL data the ranges are only allocated, to be filled later by a gps::Uploader
+	Mesh(const void* vertexData, GLsizei vertexCount, const VertexQuantization& quantization,
+	     const void* indexData, GLsizei indexCount, GLenum indexType, std::vector<Texture> textures);
+
+	// Move-only: the ranges of the arena have a single owner (the ModelAsset releases them)
+	Mesh(Mesh&& other) = default;
+	Mesh& operator=(Mesh&& other) = default;
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+
+	// The names may change from one call to the next, as the arena grows
 	Buffers getBuffers();
+	const GeometryAllocation& getAllocation() const;
+
+	void Draw(const gps::Shader& shader, int lod = 0);
+
+	// Draws the full detail level without the meshlets `view` rejects, as one glMultiDrawElementsBaseVertex
+	// over the runs of visible ones. Adds the rejected meshlets and their triangles to the counts
+	void DrawClusters(const gps::Shader& shader, const ClusterView& view,
+	                  size_t& outsideClusters, size_t& backfacingClusters, size_t& culledTriangles);
+
+	// Appends the command drawing level `lod`, with `drawIndex` as its base instance
+	void AppendCommand(int lod, GLuint drawIndex, std::vector<DrawElementsIndirectCommand>& commands) const;
+	// Appends one command per run of full detail meshlets `view` does not reject - what DrawClusters draws
+	void AppendClusterCommands(const ClusterView& view, GLuint drawIndex, std::vector<DrawElementsIndirectCommand>& commands,
+	                           size_t& outsideClusters, size_t& backfacingClusters, size_t& culledTriangles) const;
+
+	GLenum getIndexType() const;
+	const VertexQuantization& getQuantization() const;
+
+	// Sets the program, textures, layers, dequantization uniforms and vertex array for a draw. Nothing is
+	// unbound after, and gps::GLStateCache skips what the previous mesh already set
+	void bind(const gps::Shader& shader);
 
-	void Draw(gps::Shader shader);
+	// Frees what `retention` does not keep of the CPU copy of the geometry - returns the bytes released
+	size_t ReleaseGeometry(GeometryRetention retention);
+	// System memory taken by vertices, indices and positions
+	size_t GetGeometryBytes() const;
 
 private:
     /*  Render data  */
-    Buffers buffers;
+    GeometryAllocation allocation;
+    GLsizei indexCount;
+    GLenum indexType;
+    VertexQuantization quantization;
 
-	// Initializes all the buffer objects/arrays
-	void setupMesh();
+	// Takes the ranges of the mesh from the arena of its vertex format, and fills them when given the data
+	void setupMesh(const void* vertexData, GLsizei vertexCount, const void* indexData, GLsizei indexCount);
 
 };
 
@@ -0,0 +1,455 @@
+#include "MeshCache.hpp"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace gps {
+
+	bool MeshCache::enabled = true;
+
+	// Layout of the cache file:
+	//   Header
+	//   for each .mtl library of the .obj: MaterialFile, path, padding to 4 bytes
+	//   for each mesh: MeshHeader, levels of detail, meshlets, vertices, indices (16 or 32 bits), textures (type and path strings), padding to 4 bytes
+	struct SourceStamp
+	{
+		uint64_t size;
+		int64_t modifiedTime;
+		uint64_t hash;
+	};
+
+	struct CacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		SourceStamp source;
+		uint32_t meshCount;
+		uint32_t materialFileCount;
+	};
+
+	// the materials and texture paths of the meshes come from the .mtl files - the cache is only as current as they are
+	struct CacheMaterialFile
+	{
+		SourceStamp source;
+		uint32_t pathLength;
+		uint32_t reserved;
+	};
+
+	struct CacheMeshHeader
+	{
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t textureCount;
+		uint32_t lodCount;
+		// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+		uint32_t indexType;
+		uint32_t meshletCount;
+		// bounding sphere center and radius
+		float bounds[4];
+	};
+
+	static const char CACHE_MAGIC[4] = { 'G', 'P', 'S', 'M' };
+
+	MeshCache::MeshCache() : data(NULL), size(0)
+#ifdef _WIN32
+		, fileHandle(NULL), mappingHandle(NULL)
+#endif
+	{
+	}
+
+	MeshCache::~MeshCache() {
+		Close();
+	}
+
+	std::vector<MeshData>& MeshCache::GetMeshes() {
+		return meshes;
+	}
+
+	size_t MeshCache::GetMappedSize() const {
+		return size;
+	}
+
+	std::string MeshCache::GetCachePath(std::string objFileName) {
+		return objFileName + ".meshcache";
+	}
+
+	bool MeshCache::GetSourceStamp(std::string objFileName, uint64_t& fileSize, int64_t& modifiedTime) {
+		struct stat info;
+		if (stat(objFileName.c_str(), &info) != 0) {
+			return false;
+		}
+		fileSize = (uint64_t)info.st_size;
+		modifiedTime = (int64_t)info.st_mtime;
+		return true;
+	}
+
+	// FNV-1a over the whole file
+	uint64_t MeshCache::HashFile(std::string fileName) {
+		std::ifstream file(fileName.c_str(), std::ios::binary);
+		uint64_t hash = 14695981039346656037ULL;
+		char buffer[64 * 1024];
+		while (file) {
+			file.read(buffer, sizeof(buffer));
+			std::streamsize n = file.gcount();
+			for (std::streamsize i = 0; i < n; i++) {
+				hash ^= (unsigned char)buffer[i];
+				hash *= 1099511628211ULL;
+			}
+		}
+		return hash;
+	}
+
+	bool MeshCache::Open(std::string objFileName) {
+		Close();
+
+		if (!enabled) {
+			return false;
+		}
+
+		if (!Map(GetCachePath(objFileName))) {
+			return false;
+		}
+
+		if (!Parse(objFileName)) {
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	bool MeshCache::Map(std::string fileName) {
+#ifdef _WIN32
+		// shared for writing too, for UpdateSourceTime
+		HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+			CloseHandle(file);
+			return false;
+		}
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL) {
+			CloseHandle(file);
+			return false;
+		}
+		void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (view == NULL) {
+			CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+		this->fileHandle = file;
+		this->mappingHandle = mapping;
+		this->data = (const unsigned char*)view;
+		this->size = (size_t)fileSize.QuadPart;
+#else
+		int fd = open(fileName.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			close(fd);
+			return false;
+		}
+		void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (view == MAP_FAILED) {
+			return false;
+		}
+		this->data = (const unsigned char*)view;
+		this->size = (size_t)info.st_size;
+#endif
+		return true;
+	}
+
+	void MeshCache::Close() {
+		meshes.clear();
+		if (data == NULL) {
+			return;
+		}
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+		CloseHandle((HANDLE)mappingHandle);
+		CloseHandle((HANDLE)fileHandle);
+		mappingHandle = NULL;
+		fileHandle = NULL;
+#else
+		munmap((void*)data, size);
+#endif
+		data = NULL;
+		size = 0;
+	}
+
+	bool MeshCache::Parse(std::string objFileName) {
+		if (size < sizeof(CacheHeader)) {
+			return false;
+		}
+
+		CacheHeader header;
+		memcpy(&header, data, sizeof(CacheHeader));
+		if (memcmp(header.magic, CACHE_MAGIC, 4) != 0 || header.version != VERSION) {
+			std::cout << "Mesh cache : outdated format, rebuilding" << std::endl;
+			return false;
+		}
+
+		if (!IsSourceCurrent(objFileName, objFileName, offsetof(CacheHeader, source))) {
+			return false;
+		}
+
+		size_t offset = sizeof(CacheHeader);
+		for (uint32_t f = 0; f < header.materialFileCount; f++) {
+			if (offset + sizeof(CacheMaterialFile) > size) {
+				return false;
+			}
+			CacheMaterialFile materialFile;
+			memcpy(&materialFile, data + offset, sizeof(CacheMaterialFile));
+			size_t pathOffset = offset + sizeof(CacheMaterialFile);
+			if (materialFile.pathLength > size - pathOffset) {
+				return false;
+			}
+			std::string path((const char*)(data + pathOffset), materialFile.pathLength);
+			if (!IsSourceCurrent(path, objFileName, offset + offsetof(CacheMaterialFile, source))) {
+				return false;
+			}
+			offset = (pathOffset + materialFile.pathLength + 3) & ~(size_t)3;
+		}
+
+		for (uint32_t m = 0; m < header.meshCount; m++) {
+			if (offset + sizeof(CacheMeshHeader) > size) {
+				return false;
+			}
+			CacheMeshHeader meshHeader;
+			memcpy(&meshHeader, data + offset, sizeof(CacheMeshHeader));
+			offset += sizeof(CacheMeshHeader);
+
+			// a damaged file makes the draws read outside the index buffer - parsing the .obj again is cheaper
+			if (meshHeader.lodCount == 0 || meshHeader.lodCount > Mesh::MAX_LODS) {
+				return false;
+			}
+			size_t lodBytes = (size_t)meshHeader.lodCount * sizeof(MeshLod);
+			size_t meshletBytes = (size_t)meshHeader.meshletCount * sizeof(Meshlet);
+			size_t vertexBytes = (size_t)meshHeader.vertexCount * sizeof(Vertex);
+			if (meshHeader.indexType != GL_UNSIGNED_SHORT && meshHeader.indexType != GL_UNSIGNED_INT) {
+				return false;
+			}
+			size_t indexBytes = (size_t)meshHeader.indexCount * (meshHeader.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+			if (offset + lodBytes + meshletBytes + vertexBytes + indexBytes > size) {
+				return false;
+			}
+
+			MeshData mesh;
+			mesh.boundsCenter = glm::vec3(meshHeader.bounds[0], meshHeader.bounds[1], meshHeader.bounds[2]);
+			mesh.boundsRadius = meshHeader.bounds[3];
+			mesh.lods.resize(meshHeader.lodCount);
+			memcpy(mesh.lods.data(), data + offset, lodBytes);
+			offset += lodBytes;
+			mesh.meshlets.resize(meshHeader.meshletCount);
+			memcpy(mesh.meshlets.data(), data + offset, meshletBytes);
+			offset += meshletBytes;
+			for (size_t l = 0; l < mesh.lods.size(); l++) {
+				if (mesh.lods[l].indexCount < 0 || mesh.lods[l].firstIndex > meshHeader.indexCount ||
+					(uint32_t)mesh.lods[l].indexCount > meshHeader.indexCount - mesh.lods[l].firstIndex) {
+					return false;
+				}
+			}
+			// the meshlets split the full detail level
+			const MeshLod& full = mesh.lods[0];
+			for (size_t k = 0; k < mesh.meshlets.size(); k++) {
+				const Meshlet& meshlet = mesh.meshlets[k];
+				if (meshlet.indexCount < 0 || meshlet.firstIndex < full.firstIndex ||
+					meshlet.firstIndex - full.firstIndex > (GLuint)full.indexCount ||
+					(GLuint)meshlet.indexCount > (GLuint)full.indexCount - (meshlet.firstIndex - full.firstIndex)) {
+					return false;
+				}
+			}
+			mesh.externalVertices = (const Vertex*)(data + offset);
+			mesh.externalVertexCount = (GLsizei)meshHeader.vertexCount;
+			offset += vertexBytes;
+			mesh.externalIndices = data + offset;
+			mesh.indexType = (GLenum)meshHeader.indexType;
+			mesh.externalIndexCount = (GLsizei)meshHeader.indexCount;
+			offset += indexBytes;
+
+			for (uint32_t t = 0; t < meshHeader.textureCount; t++) {
+				std::string strings[2];
+				for (int k = 0; k < 2; k++) {
+					uint32_t length;
+					if (offset + sizeof(uint32_t) > size) {
+						return false;
+					}
+					memcpy(&length, data + offset, sizeof(uint32_t));
+					offset += sizeof(uint32_t);
+					if (offset + length > size) {
+						return false;
+					}
+					strings[k].assign((const char*)(data + offset), length);
+					offset += length;
+				}
+
+				gps::Texture texture;
+				texture.id = 0;
+				texture.layer = 0;
+				texture.type = strings[0];
+				texture.path = strings[1];
+				mesh.textures.push_back(texture);
+			}
+			offset = (offset + 3) & ~(size_t)3;
+
+			meshes.push_back(mesh);
+		}
+
+		return true;
+	}
+
+	// Cheap check first - falls back to the content hash when only the timestamp changed
+	bool MeshCache::IsSourceCurrent(std::string sourceFileName, std::string objFileName, size_t stampOffset) {
+		SourceStamp stamp;
+		memcpy(&stamp, data + stampOffset, sizeof(SourceStamp));
+
+		uint64_t sourceSize;
+		int64_t sourceModifiedTime;
+		if (!GetSourceStamp(sourceFileName, sourceSize, sourceModifiedTime) || sourceSize != stamp.size) {
+			std::cout << "Mesh cache : " << sourceFileName << " changed, rebuilding" << std::endl;
+			return false;
+		}
+		if (sourceModifiedTime != stamp.modifiedTime) {
+			if (HashFile(sourceFileName) != stamp.hash) {
+				std::cout << "Mesh cache : " << sourceFileName << " changed, rebuilding" << std::endl;
+				return false;
+			}
+			// same content, e.g. after a checkout - so the next runs skip the hash
+			UpdateSourceTime(GetCachePath(objFileName), stampOffset + offsetof(SourceStamp, modifiedTime), sourceModifiedTime);
+		}
+		return true;
+	}
+
+	// Only the stamp field is written, in place - the mapping already holds its copy of the stamp
+	void MeshCache::UpdateSourceTime(std::string cachePath, size_t fieldOffset, int64_t modifiedTime) {
+		std::fstream file(cachePath.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(fieldOffset);
+		file.write((const char*)&modifiedTime, sizeof(modifiedTime));
+		if (!file) {
+			fprintf(stderr, "WARNING: could not update mesh cache %s\n", cachePath.c_str());
+		}
+	}
+
+	bool MeshCache::Write(std::string objFileName, const std::vector<std::string>& materialFiles, const std::vector<gps::MeshData>& meshes) {
+		if (!enabled) {
+			return false;
+		}
+
+		CacheHeader header;
+		memcpy(header.magic, CACHE_MAGIC, 4);
+		header.version = VERSION;
+		if (!GetSourceStamp(objFileName, header.source.size, header.source.modifiedTime)) {
+			return false;
+		}
+		header.source.hash = HashFile(objFileName);
+		header.meshCount = (uint32_t)meshes.size();
+		header.materialFileCount = (uint32_t)materialFiles.size();
+
+		std::vector<CacheMaterialFile> stamps(materialFiles.size());
+		for (size_t f = 0; f < materialFiles.size(); f++) {
+			if (!GetSourceStamp(materialFiles[f], stamps[f].source.size, stamps[f].source.modifiedTime)) {
+				return false;
+			}
+			stamps[f].source.hash = HashFile(materialFiles[f]);
+			stamps[f].pathLength = (uint32_t)materialFiles[f].size();
+			stamps[f].reserved = 0;
+		}
+
+		// write to a temporary file first so an interrupted run never leaves a truncated cache
+		std::string cachePath = GetCachePath(objFileName);
+		std::string tempPath = cachePath + ".tmp";
+		std::ofstream file(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+		if (!file) {
+			fprintf(stderr, "WARNING: could not write mesh cache %s\n", cachePath.c_str());
+			return false;
+		}
+
+		static const char padding[4] = { 0, 0, 0, 0 };
+		file.write((const char*)&header, sizeof(CacheHeader));
+		size_t offset = sizeof(CacheHeader);
+		for (size_t f = 0; f < materialFiles.size(); f++) {
+			file.write((const char*)&stamps[f], sizeof(CacheMaterialFile));
+			file.write(materialFiles[f].data(), materialFiles[f].size());
+			offset += sizeof(CacheMaterialFile) + materialFiles[f].size();
+			size_t aligned = (offset + 3) & ~(size_t)3;
+			file.write(padding, aligned - offset);
+			offset = aligned;
+		}
+
+		for (size_t m = 0; m < meshes.size(); m++) {
+			const gps::MeshData& mesh = meshes[m];
+			size_t vertexBytes = (size_t)mesh.GetVertexCount() * sizeof(Vertex);
+			size_t indexBytes = (size_t)mesh.GetIndexDataSize();
+
+			CacheMeshHeader meshHeader;
+			meshHeader.vertexCount = (uint32_t)mesh.GetVertexCount();
+			meshHeader.indexCount = (uint32_t)mesh.GetIndexCount();
+			meshHeader.textureCount = (uint32_t)mesh.textures.size();
+			meshHeader.lodCount = (uint32_t)mesh.lods.size();
+			meshHeader.indexType = (uint32_t)mesh.indexType;
+			meshHeader.meshletCount = (uint32_t)mesh.meshlets.size();
+			meshHeader.bounds[0] = mesh.boundsCenter.x;
+			meshHeader.bounds[1] = mesh.boundsCenter.y;
+			meshHeader.bounds[2] = mesh.boundsCenter.z;
+			meshHeader.bounds[3] = mesh.boundsRadius;
+			size_t lodBytes = mesh.lods.size() * sizeof(MeshLod);
+			size_t meshletBytes = mesh.meshlets.size() * sizeof(Meshlet);
+			file.write((const char*)&meshHeader, sizeof(CacheMeshHeader));
+			file.write((const char*)mesh.lods.data(), lodBytes);
+			file.write((const char*)mesh.meshlets.data(), meshletBytes);
+			file.write((const char*)mesh.GetVertices(), vertexBytes);
+			file.write((const char*)mesh.GetIndexData(), indexBytes);
+			offset += sizeof(CacheMeshHeader) + lodBytes + meshletBytes + vertexBytes + indexBytes;
+
+			for (size_t t = 0; t < mesh.textures.size(); t++) {
+				const std::string* strings[2] = { &mesh.textures[t].type, &mesh.textures[t].path };
+				for (int k = 0; k < 2; k++) {
+					uint32_t length = (uint32_t)strings[k]->size();
+					file.write((const char*)&length, sizeof(uint32_t));
+					file.write(strings[k]->data(), length);
+					offset += sizeof(uint32_t) + length;
+				}
+			}
+
+			// keep the next vertex array 4-byte aligned in the mapping
+			size_t aligned = (offset + 3) & ~(size_t)3;
+			file.write(padding, aligned - offset);
+			offset = aligned;
+		}
+		file.close();
+
+		if (!file) {
+			remove(tempPath.c_str());
+			fprintf(stderr, "WARNING: could not write mesh cache %s\n", cachePath.c_str());
+			return false;
+		}
+
+		remove(cachePath.c_str());
+		if (rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+			remove(tempPath.c_str());
+			return false;
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,65 @@
+#ifndef MeshCache_hpp
+#define MeshCache_hpp
+
+#include "Mesh.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+// Versioned binary cache of the final vertex/index arrays of an .obj model,
+// stored next to the .obj file as "<name>.obj.meshcache"
+class MeshCache
+{
+public:
+    // Bump whenever the layout of the cache file, or how the meshes in it are built, changes
+    static const uint32_t VERSION = 7;
+    // Set to false to always parse the .obj file (e.g. to compare load times)
+    static bool enabled;
+
+    MeshCache();
+    ~MeshCache();
+    MeshCache(const MeshCache&) = delete;
+    MeshCache& operator=(const MeshCache&) = delete;
+
+    // Maps the cache file of the given .obj and checks that it is still valid for it
+    bool Open(std::string objFileName);
+    // Unmaps the cache file - the external pointers of the meshes become invalid
+    void Close();
+
+    // Meshes whose geometry points into the mapped pages
+    std::vector<MeshData>& GetMeshes();
+    // Bytes of the file mapped by Open, 0 when closed
+    size_t GetMappedSize() const;
+
+    // Writes the cache file of the given .obj from the meshes built by the parser, stamped with the .obj file
+    // and the .mtl libraries it reads
+    static bool Write(std::string objFileName, const std::vector<std::string>& materialFiles, const std::vector<gps::MeshData>& meshes);
+
+private:
+    const unsigned char* data;
+    size_t size;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+    std::vector<MeshData> meshes;
+
+    bool Map(std::string fileName);
+    bool Parse(std::string objFileName);
+    // Whether `sourceFileName` still matches the stamp at `stampOffset` of the mapped cache of `objFileName`
+    bool IsSourceCurrent(std::string sourceFileName, std::string objFileName, size_t stampOffset);
+
+    static std::string GetCachePath(std::string objFileName);
+    // Size, modification time and content hash of the source .obj file
+    static bool GetSourceStamp(std::string objFileName, uint64_t& fileSize, int64_t& modifiedTime);
+    static uint64_t HashFile(std::string fileName);
+    // Stores a new source modification time, at `fieldOffset`, in a cache file that is still valid
+    static void UpdateSourceTime(std::string cachePath, size_t fieldOffset, int64_t modifiedTime);
+};
+
+}
+
+#endif /* MeshCache_hpp */
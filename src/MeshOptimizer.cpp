@@ -0,0 +1,371 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+	VertexCacheStats::VertexCacheStats() : misses(0), triangles(0), vertices(0)
+	{
+	}
+
+	double VertexCacheStats::GetACMR() const {
+		return triangles ? (double)misses / triangles : 0.0;
+	}
+
+	double VertexCacheStats::GetATVR() const {
+		return vertices ? (double)misses / vertices : 0.0;
+	}
+
+	VertexCacheStats& VertexCacheStats::operator+=(const VertexCacheStats& other) {
+		misses += other.misses;
+		triangles += other.triangles;
+		vertices += other.vertices;
+		return *this;
+	}
+
+	VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const GLuint* indices, size_t indexCount, size_t vertexCount) {
+		VertexCacheStats stats;
+		stats.triangles = indexCount / 3;
+
+		// a vertex is in the FIFO cache while fewer than CACHE_SIZE misses happened since it was loaded
+		std::vector<size_t> loadedAt(vertexCount, 0);
+		std::vector<bool> referenced(vertexCount, false);
+		size_t time = CACHE_SIZE + 1;
+		for (size_t i = 0; i < indexCount; i++) {
+			GLuint v = indices[i];
+			if (time - loadedAt[v] > CACHE_SIZE) {
+				loadedAt[v] = time++;
+				stats.misses++;
+			}
+			if (!referenced[v]) {
+				referenced[v] = true;
+				stats.vertices++;
+			}
+		}
+
+		return stats;
+	}
+
+	// Scoring of "Linear-Speed Vertex Cache Optimisation" (Tom Forsyth, 2006)
+	static const int SCORE_CACHE_SIZE = 32;
+	static const int MAX_VALENCE = 64;
+
+	struct VertexScoreTable
+	{
+		float cache[SCORE_CACHE_SIZE];
+		float valence[MAX_VALENCE];
+
+		VertexScoreTable() {
+			for (int i = 0; i < SCORE_CACHE_SIZE; i++) {
+				// the last triangle's vertices get a fixed score, so the strip does not just turn back on itself
+				cache[i] = i < 3 ? 0.75f : std::pow(1.0f - (float)(i - 3) / (SCORE_CACHE_SIZE - 3), 1.5f);
+			}
+			for (int i = 0; i < MAX_VALENCE; i++) {
+				// favours vertices with few triangles left, so lone triangles are not left behind
+				valence[i] = i == 0 ? 0.0f : 2.0f / std::sqrt((float)i);
+			}
+		}
+	};
+
+	static float vertexScore(const VertexScoreTable& table, int cachePosition, unsigned liveTriangles) {
+		if (liveTriangles == 0) {
+			return -1.0f;
+		}
+		float score = cachePosition >= 0 ? table.cache[cachePosition] : 0.0f;
+		return score + (liveTriangles < MAX_VALENCE ? table.valence[liveTriangles] : 2.0f / std::sqrt((float)liveTriangles));
+	}
+
+	void MeshOptimizer::OptimizeVertexCache(GLuint* indices, size_t indexCount, size_t vertexCount) {
+		static const VertexScoreTable table;
+		size_t triangleCount = indexCount / 3;
+		if (triangleCount == 0) {
+			return;
+		}
+
+		// triangles using each vertex; the live ones are kept at the front of each list
+		std::vector<unsigned> liveTriangles(vertexCount, 0);
+		for (size_t i = 0; i < triangleCount * 3; i++) {
+			liveTriangles[indices[i]]++;
+		}
+		std::vector<size_t> adjacencyOffset(vertexCount + 1, 0);
+		for (size_t v = 0; v < vertexCount; v++) {
+			adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+		}
+		std::vector<size_t> adjacency(triangleCount * 3);
+		std::vector<size_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++) {
+			adjacency[fill[indices[i]]++] = i / 3;
+		}
+
+		std::vector<int> cachePosition(vertexCount, -1);
+		std::vector<float> score(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			score[v] = vertexScore(table, -1, liveTriangles[v]);
+		}
+		std::vector<float> triangleScore(triangleCount);
+		std::vector<bool> emitted(triangleCount, false);
+		size_t bestTriangle = 0;
+		for (size_t t = 0; t < triangleCount; t++) {
+			triangleScore[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+			if (triangleScore[t] > triangleScore[bestTriangle]) {
+				bestTriangle = t;
+			}
+		}
+
+		std::vector<GLuint> output;
+		output.reserve(triangleCount * 3);
+		std::vector<GLuint> cache;
+		std::vector<GLuint> newCache;
+		cache.reserve(SCORE_CACHE_SIZE + 3);
+		newCache.reserve(SCORE_CACHE_SIZE + 3);
+		size_t cursor = 0;
+
+		while (output.size() < triangleCount * 3) {
+			if (bestTriangle == (size_t)-1) {
+				// dead end - no triangle touches the cache, restart from the next one in the input order
+				while (emitted[cursor]) {
+					cursor++;
+				}
+				bestTriangle = cursor;
+			}
+
+			const GLuint* triangle = indices + 3 * bestTriangle;
+			emitted[bestTriangle] = true;
+			newCache.clear();
+			for (int k = 0; k < 3; k++) {
+				GLuint v = triangle[k];
+				output.push_back(v);
+
+				size_t* first = &adjacency[adjacencyOffset[v]];
+				size_t* last = first + liveTriangles[v];
+				std::iter_swap(std::find(first, last, bestTriangle), last - 1);
+				liveTriangles[v]--;
+
+				if (std::find(newCache.begin(), newCache.end(), v) == newCache.end()) {
+					newCache.push_back(v);
+				}
+			}
+
+			// the triangle's vertices move to the front, the rest are pushed back
+			size_t front = newCache.size();
+			for (size_t i = 0; i < cache.size(); i++) {
+				if (std::find(newCache.begin(), newCache.begin() + front, cache[i]) == newCache.begin() + front) {
+					newCache.push_back(cache[i]);
+				}
+			}
+			for (size_t i = 0; i < newCache.size(); i++) {
+				GLuint v = newCache[i];
+				cachePosition[v] = i < SCORE_CACHE_SIZE ? (int)i : -1;
+				score[v] = vertexScore(table, cachePosition[v], liveTriangles[v]);
+			}
+
+			// rescore the triangles around the cache and pick the best one
+			bestTriangle = (size_t)-1;
+			float bestScore = -1.0f;
+			for (size_t i = 0; i < newCache.size(); i++) {
+				GLuint v = newCache[i];
+				for (size_t a = 0; a < liveTriangles[v]; a++) {
+					size_t t = adjacency[adjacencyOffset[v] + a];
+					triangleScore[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+					if (triangleScore[t] > bestScore) {
+						bestScore = triangleScore[t];
+						bestTriangle = t;
+					}
+				}
+			}
+
+			if (newCache.size() > SCORE_CACHE_SIZE) {
+				newCache.resize(SCORE_CACHE_SIZE);
+			}
+			cache.swap(newCache);
+		}
+
+		std::copy(output.begin(), output.end(), indices);
+	}
+
+	struct TriangleCluster
+	{
+		size_t first;
+		size_t count;
+		float sortKey;
+
+		bool operator<(const TriangleCluster& other) const {
+			return sortKey > other.sortKey;
+		}
+	};
+
+	void MeshOptimizer::OptimizeOverdraw(GLuint* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, float threshold) {
+		size_t triangleCount = indexCount / 3;
+		if (triangleCount < 2) {
+			return;
+		}
+
+		// Clusters break where the cache order starts over (all three corners miss), and within those
+		// wherever the cluster's own ACMR, counted from a cold cache, is already close to that of the mesh.
+		// Drawing the clusters in any order then costs at most `threshold` times more vertex shading
+		VertexCacheStats before = AnalyzeVertexCache(indices, indexCount, vertexCount);
+		std::vector<TriangleCluster> clusters;
+		std::vector<size_t> loadedAt(vertexCount, 0);
+		size_t time = CACHE_SIZE + 1;
+		size_t clusterStart = 0;
+		size_t clusterMisses = 0;
+		for (size_t t = 0; t < triangleCount; t++) {
+			int misses = 0;
+			for (int k = 0; k < 3; k++) {
+				GLuint v = indices[3 * t + k];
+				if (time - loadedAt[v] > CACHE_SIZE) {
+					loadedAt[v] = time++;
+					misses++;
+				}
+			}
+
+			if (misses == 3 && t > clusterStart) {
+				TriangleCluster cluster = { clusterStart, t - clusterStart, 0.0f };
+				clusters.push_back(cluster);
+				clusterStart = t;
+				clusterMisses = 0;
+			}
+			clusterMisses += misses;
+
+			size_t count = t + 1 - clusterStart;
+			if ((double)clusterMisses <= threshold * before.GetACMR() * count) {
+				TriangleCluster cluster = { clusterStart, count, 0.0f };
+				clusters.push_back(cluster);
+				clusterStart = t + 1;
+				clusterMisses = 0;
+				// the next cluster may follow any other one
+				time += CACHE_SIZE + 1;
+			}
+		}
+		if (clusterStart < triangleCount) {
+			TriangleCluster cluster = { clusterStart, triangleCount - clusterStart, 0.0f };
+			clusters.push_back(cluster);
+		}
+		if (clusters.size() < 2) {
+			return;
+		}
+
+		// Clusters on the outside of the mesh, facing away from its center, are drawn first
+		glm::vec3 meshCenter(0.0f);
+		float meshArea = 0.0f;
+		std::vector<glm::vec3> clusterCenter(clusters.size(), glm::vec3(0.0f));
+		std::vector<glm::vec3> clusterNormal(clusters.size(), glm::vec3(0.0f));
+		for (size_t c = 0; c < clusters.size(); c++) {
+			float clusterArea = 0.0f;
+			for (size_t t = clusters[c].first; t < clusters[c].first + clusters[c].count; t++) {
+				const glm::vec3& p0 = vertices[indices[3 * t]].Position;
+				const glm::vec3& p1 = vertices[indices[3 * t + 1]].Position;
+				const glm::vec3& p2 = vertices[indices[3 * t + 2]].Position;
+				glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+				float area = glm::length(normal);
+				glm::vec3 center = (p0 + p1 + p2) * (area / 3.0f);
+				clusterCenter[c] += center;
+				clusterNormal[c] += normal;
+				clusterArea += area;
+				meshCenter += center;
+				meshArea += area;
+			}
+			if (clusterArea > 0.0f) {
+				clusterCenter[c] /= clusterArea;
+			}
+		}
+		if (meshArea > 0.0f) {
+			meshCenter /= meshArea;
+		}
+		for (size_t c = 0; c < clusters.size(); c++) {
+			float length = glm::length(clusterNormal[c]);
+			clusters[c].sortKey = length > 0.0f ? glm::dot(clusterCenter[c] - meshCenter, clusterNormal[c] / length) : 0.0f;
+		}
+		std::stable_sort(clusters.begin(), clusters.end());
+
+		std::vector<GLuint> sorted;
+		sorted.reserve(triangleCount * 3);
+		for (size_t c = 0; c < clusters.size(); c++) {
+			sorted.insert(sorted.end(), indices + 3 * clusters[c].first, indices + 3 * (clusters[c].first + clusters[c].count));
+		}
+
+		VertexCacheStats after = AnalyzeVertexCache(sorted.data(), sorted.size(), vertexCount);
+		if (after.GetACMR() <= threshold * before.GetACMR()) {
+			std::copy(sorted.begin(), sorted.end(), indices);
+		}
+	}
+
+	void MeshOptimizer::OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+		const GLuint unused = (GLuint)-1;
+		std::vector<GLuint> remap(vertices.size(), unused);
+		std::vector<Vertex> reordered;
+		reordered.reserve(vertices.size());
+
+		for (size_t i = 0; i < indices.size(); i++) {
+			GLuint& index = remap[indices[i]];
+			if (index == unused) {
+				index = (GLuint)reordered.size();
+				reordered.push_back(vertices[indices[i]]);
+			}
+			indices[i] = index;
+		}
+
+		vertices.swap(reordered);
+	}
+
+	void MeshOptimizer::Optimize(MeshData& mesh) {
+		if (mesh.externalVertices || mesh.indices.size() < 3) {
+			return;
+		}
+		mesh.indices.resize(mesh.indices.size() / 3 * 3);
+
+		OptimizeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+		OptimizeOverdraw(mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.vertices.size(), 1.05f);
+		OptimizeVertexFetch(mesh.vertices, mesh.indices);
+	}
+
+	std::vector<MeshData> MeshOptimizer::Split(const MeshData& mesh, size_t maxVertices) {
+		std::vector<MeshData> parts;
+		const Vertex* vertices = mesh.GetVertices();
+		size_t vertexCount = (size_t)mesh.GetVertexCount();
+		if (mesh.externalIndices || maxVertices < 3) {
+			return parts;
+		}
+
+		// remap[v] is the index of v in the current part, valid while owner[v] is that part
+		std::vector<GLuint> remap(vertexCount);
+		std::vector<size_t> owner(vertexCount, (size_t)-1);
+		size_t triangleCount = mesh.indices.size() / 3;
+		for (size_t t = 0; t < triangleCount; t++) {
+			const GLuint* triangle = &mesh.indices[t * 3];
+			size_t added = 0;
+			for (int k = 0; k < 3; k++) {
+				if (parts.empty() || owner[triangle[k]] != parts.size() - 1) {
+					added++;
+				}
+			}
+			if (parts.empty() || parts.back().vertices.size() + added > maxVertices) {
+				parts.push_back(MeshData());
+				parts.back().textures = mesh.textures;
+			}
+
+			MeshData& part = parts.back();
+			for (int k = 0; k < 3; k++) {
+				GLuint v = triangle[k];
+				if (owner[v] != parts.size() - 1) {
+					owner[v] = parts.size() - 1;
+					remap[v] = (GLuint)part.vertices.size();
+					part.vertices.push_back(vertices[v]);
+				}
+				part.indices.push_back(remap[v]);
+			}
+		}
+		return parts;
+	}
+
+	bool MeshOptimizer::ShrinkIndices(MeshData& mesh) {
+		if (mesh.externalIndices || mesh.indexType == GL_UNSIGNED_SHORT || (size_t)mesh.GetVertexCount() > MAX_SHORT_VERTICES) {
+			return mesh.indexType == GL_UNSIGNED_SHORT;
+		}
+		mesh.shortIndices.assign(mesh.indices.begin(), mesh.indices.end());
+		std::vector<GLuint>().swap(mesh.indices);
+		mesh.indexType = GL_UNSIGNED_SHORT;
+		return true;
+	}
+}
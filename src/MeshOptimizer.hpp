@@ -0,0 +1,67 @@
+#ifndef MeshOptimizer_hpp
+#define MeshOptimizer_hpp
+
+#include "Mesh.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+// Post-transform vertex cache efficiency of an index buffer, measured on a simulated FIFO cache
+struct VertexCacheStats
+{
+    size_t misses;
+    size_t triangles;
+    // vertices referenced by the index buffer
+    size_t vertices;
+
+    VertexCacheStats();
+
+    // Average cache miss ratio - vertex shader runs per triangle, 0.5 at best for large meshes, 3 at worst
+    double GetACMR() const;
+    // Average transformed vertex ratio - vertex shader runs per vertex, 1 at best
+    double GetATVR() const;
+
+    VertexCacheStats& operator+=(const VertexCacheStats& other);
+};
+
+// Load-time reordering of indexed triangle lists: triangles for the post-transform vertex cache
+// (Forsyth), then clusters of them for less overdraw (Sander et al., "Fast Triangle Reordering for
+// Vertex Locality and Reduced Overdraw"), then vertices in order of first use for fetch locality.
+// None of the passes changes what is drawn
+class MeshOptimizer
+{
+public:
+    // Size of the FIFO cache used for the statistics
+    static const int CACHE_SIZE = 16;
+
+    static VertexCacheStats AnalyzeVertexCache(const GLuint* indices, size_t indexCount, size_t vertexCount);
+
+    // Reorders the triangles to reuse recently transformed vertices
+    static void OptimizeVertexCache(GLuint* indices, size_t indexCount, size_t vertexCount);
+
+    // Sorts clusters of the (cache optimized) triangles so outward facing ones are drawn first,
+    // as long as the ACMR does not grow by more than `threshold`
+    static void OptimizeOverdraw(GLuint* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, float threshold);
+
+    // Renumbers the vertices in order of first use and drops unreferenced ones
+    static void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+    // All of the above on the geometry in the vectors of `mesh`
+    static void Optimize(MeshData& mesh);
+
+    // Most vertices a mesh can have for GL_UNSIGNED_SHORT indices (0xFFFF is left out, it is the restart index)
+    static const size_t MAX_SHORT_VERTICES = 65535;
+
+    // Cuts the (optimized) triangles of `mesh` into consecutive runs that each use at most `maxVertices`
+    // vertices, every part with its own vertices in order of first use. The parts share the textures
+    static std::vector<MeshData> Split(const MeshData& mesh, size_t maxVertices);
+
+    // Moves the indices of `mesh` to its shortIndices if it has few enough vertices
+    static bool ShrinkIndices(MeshData& mesh);
+};
+
+}
+
+#endif /* MeshOptimizer_hpp */
@@ -0,0 +1,329 @@
+#include "MeshSimplifier.hpp"
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+
+namespace gps {
+
+	// Sum of the squared distances to the planes of the triangles around a vertex, weighted by area
+	struct Quadric
+	{
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+		double weight;
+
+		Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0), weight(0) {
+		}
+
+		void AddPlane(const glm::vec3& normal, float d, float area) {
+			double a = normal.x, b = normal.y, c = normal.z;
+			a2 += area * a * a; ab += area * a * b; ac += area * a * c; ad += area * a * d;
+			b2 += area * b * b; bc += area * b * c; bd += area * b * d;
+			c2 += area * c * c; cd += area * c * d;
+			d2 += area * (double)d * d;
+			weight += area;
+		}
+
+		void Add(const Quadric& other) {
+			a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+			b2 += other.b2; bc += other.bc; bd += other.bd;
+			c2 += other.c2; cd += other.cd;
+			d2 += other.d2;
+			weight += other.weight;
+		}
+
+		// Mean squared distance of `p` to the planes
+		double Error(const glm::vec3& p) const {
+			double x = p.x, y = p.y, z = p.z;
+			double e = a2 * x * x + b2 * y * y + c2 * z * z + 2.0 * (ab * x * y + ac * x * z + bc * y * z)
+				+ 2.0 * (ad * x + bd * y + cd * z) + d2;
+			return weight > 0.0 ? std::fabs(e) / weight : 0.0;
+		}
+	};
+
+	struct Collapse
+	{
+		double cost;
+		uint32_t from;
+		uint32_t to;
+		// versions of both ends when the cost was taken - a later collapse into either makes it stale
+		uint32_t version;
+		uint32_t toVersion;
+
+		bool operator<(const Collapse& other) const {
+			// std::priority_queue keeps the largest on top
+			return cost > other.cost;
+		}
+	};
+
+	// Error of the vertex left at `to` against the planes of both ends: a collapse is only cheap when `to`
+	// lies on the surface around `from` and still on its own
+	static double collapseCost(const std::vector<Quadric>& quadrics, const std::vector<glm::vec3>& positions, uint32_t from, uint32_t to) {
+		Quadric merged = quadrics[from];
+		merged.Add(quadrics[to]);
+		return merged.Error(positions[to]);
+	}
+
+	struct PositionHash
+	{
+		size_t operator()(const glm::vec3& p) const {
+			uint32_t bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+		}
+	};
+
+	std::vector<GLuint> MeshSimplifier::Simplify(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+		size_t targetIndexCount, float maxError, float* resultError) {
+		size_t triangleCount = indexCount / 3;
+		std::vector<GLuint> triangles(indices, indices + triangleCount * 3);
+		*resultError = 0.0f;
+
+		// Vertices at the same position (split by normals or texture coordinates) collapse as one
+		std::unordered_map<glm::vec3, uint32_t, PositionHash> positionIds;
+		std::vector<uint32_t> positionOf(vertexCount);
+		std::vector<glm::vec3> positions;
+		for (size_t v = 0; v < vertexCount; v++) {
+			std::pair<std::unordered_map<glm::vec3, uint32_t, PositionHash>::iterator, bool> inserted =
+				positionIds.insert(std::make_pair(vertices[v].Position, (uint32_t)positions.size()));
+			if (inserted.second) {
+				positions.push_back(vertices[v].Position);
+			}
+			positionOf[v] = inserted.first->second;
+		}
+		size_t positionCount = positions.size();
+
+		std::vector<Quadric> quadrics(positionCount);
+		std::vector<std::vector<uint32_t> > positionTriangles(positionCount);
+		std::vector<std::vector<GLuint> > wedges(positionCount);
+		std::vector<bool> alive(triangleCount, true);
+		std::unordered_map<uint64_t, int> edgeTriangles;
+		size_t liveTriangles = 0;
+
+		for (size_t t = 0; t < triangleCount; t++) {
+			uint32_t p[3] = { positionOf[triangles[3 * t]], positionOf[triangles[3 * t + 1]], positionOf[triangles[3 * t + 2]] };
+			if (p[0] == p[1] || p[1] == p[2] || p[0] == p[2]) {
+				alive[t] = false;
+				continue;
+			}
+			liveTriangles++;
+
+			glm::vec3 normal = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+			float area = glm::length(normal);
+			if (area > 0.0f) {
+				normal /= area;
+			}
+			for (int k = 0; k < 3; k++) {
+				quadrics[p[k]].AddPlane(normal, -glm::dot(normal, positions[p[0]]), area);
+				positionTriangles[p[k]].push_back((uint32_t)t);
+				GLuint v = triangles[3 * t + k];
+				if (std::find(wedges[p[k]].begin(), wedges[p[k]].end(), v) == wedges[p[k]].end()) {
+					wedges[p[k]].push_back(v);
+				}
+				uint32_t a = std::min(p[k], p[(k + 1) % 3]);
+				uint32_t b = std::max(p[k], p[(k + 1) % 3]);
+				edgeTriangles[((uint64_t)a << 32) | b]++;
+			}
+		}
+
+		// Borders (and non-manifold edges) stay where they are, so holes do not open up
+		std::vector<bool> locked(positionCount, false);
+		for (std::unordered_map<uint64_t, int>::iterator it = edgeTriangles.begin(); it != edgeTriangles.end(); ++it) {
+			if (it->second != 2) {
+				locked[(uint32_t)(it->first >> 32)] = true;
+				locked[(uint32_t)(it->first & 0xFFFFFFFF)] = true;
+			}
+		}
+
+		std::vector<uint32_t> version(positionCount, 0);
+		std::vector<bool> removed(positionCount, false);
+		std::priority_queue<Collapse> queue;
+		for (size_t t = 0; t < triangleCount; t++) {
+			if (!alive[t]) {
+				continue;
+			}
+			for (int k = 0; k < 3; k++) {
+				uint32_t a = positionOf[triangles[3 * t + k]];
+				uint32_t b = positionOf[triangles[3 * t + (k + 1) % 3]];
+				if (!locked[a]) {
+					Collapse collapse = { collapseCost(quadrics, positions, a, b), a, b, 0, 0 };
+					queue.push(collapse);
+				}
+			}
+		}
+
+		double maxCost = (double)maxError * maxError;
+		std::unordered_map<GLuint, GLuint> wedgeMap;
+		while (!queue.empty() && liveTriangles * 3 > targetIndexCount) {
+			Collapse collapse = queue.top();
+			queue.pop();
+			if (collapse.cost > maxCost) {
+				break;
+			}
+			uint32_t from = collapse.from;
+			uint32_t to = collapse.to;
+			if (removed[from] || removed[to] || locked[from] || collapse.version != version[from] ||
+				collapse.toVersion != version[to]) {
+				continue;
+			}
+
+			// Every vertex at `from` moves to the vertex at `to` it shares an edge with - a collapse that
+			// would tear a texture or normal seam apart is skipped
+			wedgeMap.clear();
+			bool valid = true;
+			for (size_t i = 0; i < wedges[from].size() && valid; i++) {
+				GLuint wedge = wedges[from][i];
+				GLuint target = (GLuint)-1;
+				for (size_t j = 0; j < positionTriangles[from].size() && valid; j++) {
+					uint32_t t = positionTriangles[from][j];
+					if (!alive[t] || (triangles[3 * t] != wedge && triangles[3 * t + 1] != wedge && triangles[3 * t + 2] != wedge)) {
+						continue;
+					}
+					for (int k = 0; k < 3; k++) {
+						GLuint v = triangles[3 * t + k];
+						if (positionOf[v] == to) {
+							valid = target == (GLuint)-1 || target == v;
+							target = v;
+						}
+					}
+				}
+				if (target == (GLuint)-1) {
+					valid = valid && wedges[to].size() == 1;
+					target = wedges[to][0];
+				}
+				wedgeMap[wedge] = target;
+			}
+
+			// Triangles that would flip over are not allowed either
+			for (size_t j = 0; j < positionTriangles[from].size() && valid; j++) {
+				uint32_t t = positionTriangles[from][j];
+				if (!alive[t]) {
+					continue;
+				}
+				glm::vec3 before[3];
+				glm::vec3 after[3];
+				bool degenerate = false;
+				for (int k = 0; k < 3; k++) {
+					uint32_t p = positionOf[triangles[3 * t + k]];
+					before[k] = positions[p];
+					after[k] = p == from ? positions[to] : positions[p];
+					degenerate = degenerate || p == to;
+				}
+				if (degenerate) {
+					continue;
+				}
+				glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+				glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+				valid = glm::dot(n0, n1) > 0.0f;
+			}
+			if (!valid) {
+				continue;
+			}
+
+			for (size_t j = 0; j < positionTriangles[from].size(); j++) {
+				uint32_t t = positionTriangles[from][j];
+				if (!alive[t]) {
+					continue;
+				}
+				bool degenerate = false;
+				for (int k = 0; k < 3; k++) {
+					GLuint& v = triangles[3 * t + k];
+					if (positionOf[v] == from) {
+						v = wedgeMap[v];
+					}
+					else if (positionOf[v] == to) {
+						degenerate = true;
+					}
+				}
+				if (degenerate) {
+					alive[t] = false;
+					liveTriangles--;
+				}
+				else {
+					positionTriangles[to].push_back(t);
+				}
+			}
+			positionTriangles[from].clear();
+			quadrics[to].Add(quadrics[from]);
+			removed[from] = true;
+			version[to]++;
+			*resultError = std::max(*resultError, (float)std::sqrt(collapse.cost));
+
+			// the collapses out of `to` changed with its quadric, the ones into `from` now lead to `to`
+			for (size_t j = 0; j < positionTriangles[to].size(); j++) {
+				uint32_t t = positionTriangles[to][j];
+				if (!alive[t]) {
+					continue;
+				}
+				for (int k = 0; k < 3; k++) {
+					uint32_t other = positionOf[triangles[3 * t + k]];
+					if (other == to) {
+						continue;
+					}
+					if (!locked[to]) {
+						Collapse outward = { collapseCost(quadrics, positions, to, other), to, other, version[to], version[other] };
+						queue.push(outward);
+					}
+					if (!locked[other]) {
+						Collapse inward = { collapseCost(quadrics, positions, other, to), other, to, version[other], version[to] };
+						queue.push(inward);
+					}
+				}
+			}
+		}
+
+		std::vector<GLuint> result;
+		result.reserve(liveTriangles * 3);
+		for (size_t t = 0; t < triangleCount; t++) {
+			if (alive[t]) {
+				result.insert(result.end(), triangles.begin() + 3 * t, triangles.begin() + 3 * t + 3);
+			}
+		}
+		return result;
+	}
+
+	void MeshSimplifier::BuildLods(MeshData& mesh) {
+		mesh.lods.clear();
+		if (mesh.vertices.empty()) {
+			return;
+		}
+
+		glm::vec3 minimum = mesh.vertices[0].Position;
+		glm::vec3 maximum = minimum;
+		for (size_t v = 1; v < mesh.vertices.size(); v++) {
+			minimum = glm::min(minimum, mesh.vertices[v].Position);
+			maximum = glm::max(maximum, mesh.vertices[v].Position);
+		}
+		mesh.boundsCenter = (minimum + maximum) * 0.5f;
+		mesh.boundsRadius = 0.0f;
+		for (size_t v = 0; v < mesh.vertices.size(); v++) {
+			mesh.boundsRadius = std::max(mesh.boundsRadius, glm::length(mesh.vertices[v].Position - mesh.boundsCenter));
+		}
+
+		MeshLod full = { 0, (GLsizei)mesh.indices.size(), 0.0f };
+		mesh.lods.push_back(full);
+
+		// each level is simplified from the previous one; past a tenth of the mesh size the shape is gone
+		float maxError = mesh.boundsRadius * 0.1f;
+		while (mesh.lods.size() < Mesh::MAX_LODS) {
+			const MeshLod& previous = mesh.lods.back();
+			size_t target = (size_t)previous.indexCount / 6 * 3;
+			float error;
+			std::vector<GLuint> simplified = Simplify(mesh.vertices.data(), mesh.vertices.size(),
+				mesh.indices.data() + previous.firstIndex, previous.indexCount, target, maxError, &error);
+			// stop when the simplifier gets stuck (borders, seams or the error bound)
+			if (simplified.empty() || simplified.size() > (size_t)previous.indexCount * 85 / 100) {
+				break;
+			}
+			MeshOptimizer::OptimizeVertexCache(simplified.data(), simplified.size(), mesh.vertices.size());
+
+			MeshLod lod = { (GLuint)mesh.indices.size(), (GLsizei)simplified.size(), previous.error + error };
+			mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+			mesh.lods.push_back(lod);
+		}
+	}
+}
@@ -0,0 +1,31 @@
+#ifndef MeshSimplifier_hpp
+#define MeshSimplifier_hpp
+
+#include "Mesh.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+// Quadric error metric simplification (Garland and Heckbert, "Surface Simplification Using Quadric
+// Error Metrics") by edge collapses onto existing vertices, so every level of detail is only a new
+// index buffer over the vertices of the full mesh. Vertices split by normal or texture seams move
+// together; mesh borders are kept
+class MeshSimplifier
+{
+public:
+    // Triangles of a coarser version of the given ones, with at most `targetIndexCount` indices if
+    // that can be reached without moving the surface more than `maxError` (object space units).
+    // `resultError` receives the largest error of the collapses done
+    static std::vector<GLuint> Simplify(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+                                        size_t targetIndexCount, float maxError, float* resultError);
+
+    // Computes the bounds of `mesh` and appends up to Mesh::MAX_LODS - 1 coarser index ranges,
+    // each about half of the previous one, to its indices
+    static void BuildLods(MeshData& mesh);
+};
+
+}
+
+#endif /* MeshSimplifier_hpp */
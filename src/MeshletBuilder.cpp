@@ -0,0 +1,114 @@
+#include "MeshletBuilder.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+	void MeshletBuilder::Build(MeshData& mesh) {
+		mesh.meshlets.clear();
+		if (mesh.externalVertices || mesh.lods.empty()) {
+			return;
+		}
+
+		const MeshLod& full = mesh.lods[0];
+		// owner[v] is the meshlet v was last added to, so each vertex is counted once per meshlet
+		std::vector<size_t> owner(mesh.vertices.size(), (size_t)-1);
+		size_t meshletVertices = 0;
+		GLuint first = full.firstIndex;
+		GLuint end = full.firstIndex + (GLuint)full.indexCount;
+		for (GLuint i = first; i + 2 < end; i += 3) {
+			size_t added = 0;
+			for (int k = 0; k < 3; k++) {
+				added += owner[mesh.indices[i + k]] != mesh.meshlets.size() ? 1 : 0;
+			}
+			if (i > first && (meshletVertices + added > MAX_VERTICES || (i - first) / 3 == MAX_TRIANGLES)) {
+				mesh.meshlets.push_back(ComputeBounds(mesh.vertices.data(), &mesh.indices[first], i - first));
+				mesh.meshlets.back().firstIndex = first;
+				first = i;
+				meshletVertices = 0;
+				added = 3;
+			}
+			for (int k = 0; k < 3; k++) {
+				owner[mesh.indices[i + k]] = mesh.meshlets.size();
+			}
+			meshletVertices += added;
+		}
+		if (end - first >= 3) {
+			mesh.meshlets.push_back(ComputeBounds(mesh.vertices.data(), &mesh.indices[first], end - first));
+			mesh.meshlets.back().firstIndex = first;
+		}
+	}
+
+	Meshlet MeshletBuilder::ComputeBounds(const Vertex* vertices, const GLuint* indices, size_t indexCount) {
+		Meshlet meshlet;
+		meshlet.firstIndex = 0;
+		meshlet.indexCount = (GLsizei)indexCount;
+
+		// sphere around the center of the box - within a few percent of the smallest one for clusters this size
+		glm::vec3 boxMin = vertices[indices[0]].Position;
+		glm::vec3 boxMax = boxMin;
+		for (size_t i = 1; i < indexCount; i++) {
+			boxMin = glm::min(boxMin, vertices[indices[i]].Position);
+			boxMax = glm::max(boxMax, vertices[indices[i]].Position);
+		}
+		meshlet.center = (boxMin + boxMax) * 0.5f;
+		meshlet.radius = 0.0f;
+		for (size_t i = 0; i < indexCount; i++) {
+			meshlet.radius = std::max(meshlet.radius, glm::distance(vertices[indices[i]].Position, meshlet.center));
+		}
+
+		// the cone is built from the geometric normals, whose winding decides what the rasterizer culls
+		std::vector<glm::vec3> normals;
+		normals.reserve(indexCount / 3);
+		glm::vec3 axis(0.0f);
+		for (size_t i = 0; i + 2 < indexCount; i += 3) {
+			const glm::vec3& p0 = vertices[indices[i + 0]].Position;
+			glm::vec3 normal = glm::cross(vertices[indices[i + 1]].Position - p0, vertices[indices[i + 2]].Position - p0);
+			float area = glm::length(normal);
+			if (area > 0.0f) {
+				normals.push_back(normal / area);
+				axis += normal / area;
+			}
+			else {
+				// keeps normals[] aligned with the triangles
+				normals.push_back(glm::vec3(0.0f));
+			}
+		}
+
+		meshlet.coneApex = meshlet.center;
+		meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+		meshlet.coneCutoff = 2.0f;
+		float axisLength = glm::length(axis);
+		if (axisLength == 0.0f) {
+			return meshlet;
+		}
+		axis /= axisLength;
+
+		// widest angle between the axis and a normal - past 90 degrees some triangle always faces the eye
+		float minDot = 1.0f;
+		for (size_t t = 0; t < normals.size(); t++) {
+			if (normals[t] != glm::vec3(0.0f)) {
+				minDot = std::min(minDot, glm::dot(normals[t], axis));
+			}
+		}
+		if (minDot <= 0.0f) {
+			return meshlet;
+		}
+
+		// apex behind the plane of every triangle, so any eye inside the cone sees only back faces
+		float maxT = 0.0f;
+		for (size_t t = 0; t < normals.size(); t++) {
+			if (normals[t] == glm::vec3(0.0f)) {
+				continue;
+			}
+			const glm::vec3& p0 = vertices[indices[t * 3]].Position;
+			maxT = std::max(maxT, glm::dot(meshlet.center - p0, normals[t]) / glm::dot(axis, normals[t]));
+		}
+		meshlet.coneApex = meshlet.center - axis * maxT;
+		meshlet.coneAxis = axis;
+		// the eye direction may be up to 90 degrees minus the widest normal angle from the axis
+		meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+		return meshlet;
+	}
+}
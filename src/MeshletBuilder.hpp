@@ -0,0 +1,29 @@
+#ifndef MeshletBuilder_hpp
+#define MeshletBuilder_hpp
+
+#include "Mesh.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+// Cuts the full detail triangles of a mesh into meshlets (clusters) small enough to be culled one by one:
+// bounding spheres for the view frustum, normal cones for the clusters that face away from the eye
+class MeshletBuilder
+{
+public:
+    static const size_t MAX_VERTICES = 64;
+    static const size_t MAX_TRIANGLES = 124;
+
+    // Meshlets of consecutive triangles of the full detail range of `mesh`, which the vertex cache and
+    // overdraw passes have already grouped by locality and orientation. Uses the 32-bit indices
+    static void Build(MeshData& mesh);
+
+    // Bounding sphere and normal cone of the given triangles
+    static Meshlet ComputeBounds(const Vertex* vertices, const GLuint* indices, size_t indexCount);
+};
+
+}
+
+#endif /* MeshletBuilder_hpp */
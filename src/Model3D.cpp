@@ -2,232 +2,1295 @@
 
 namespace gps {
 
+	// Key identifying a unique face corner of an .obj shape
+	struct VertexKey
+	{
+		int vertexIndex;
+		int normalIndex;
+		int texcoordIndex;
+
+		bool operator==(const VertexKey& other) const {
+			return vertexIndex == other.vertexIndex && normalIndex == other.normalIndex && texcoordIndex == other.texcoordIndex;
+		}
+	};
+
+	struct VertexKeyHash
+	{
+		size_t operator()(const VertexKey& key) const {
+			size_t h = std::hash<int>()(key.vertexIndex);
+			h ^= std::hash<int>()(key.normalIndex) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			h ^= std::hash<int>()(key.texcoordIndex) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			return h;
+		}
+	};
+
+	// Entry of the table that welds the face corners of a material bucket
+	struct WeldSlot
+	{
+		VertexKey key;
+		GLuint index;
+	};
+
+	// index of a WeldSlot that holds no corner yet
+	static const GLuint EMPTY_SLOT = 0xFFFFFFFF;
+
+	bool Model3D::compressedTextures = true;
+	bool Model3D::quantizedVertices = true;
+	bool Model3D::hotReload = false;
+	float Model3D::lodBias = 1.0f;
+	float Model3D::lodPixelError = 1.0f;
+
+	// fraction of the allowed error a level has to be past before the selection changes
+	static const float LOD_HYSTERESIS = 0.25f;
+	static glm::mat4 lodView(1.0f);
+	// pixels covered by one world unit at distance 1
+	static float lodPixelsPerUnit = 0.0f;
+	static Model3D::LodStats lodStats = {};
+
+	bool Model3D::clusterCulling = true;
+	static ClusterView cullView;
+	static Model3D::ClusterStats clusterStats = {};
+
+	static double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+		return elapsed.count();
+	}
+
+	// Mixes `size` bytes into `hash` a word at a time - only has to tell a changed mesh from an unchanged one
+	static uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8) {
+			uint64_t word;
+			memcpy(&word, bytes + i, 8);
+			hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+			hash ^= hash >> 32;
+		}
+		for (; i < size; i++) {
+			hash = (hash ^ bytes[i]) * 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	// Everything UploadMeshStep copies from the MeshData into the Mesh, levels of detail and meshlets aside,
+	// which are built from the same vertices and indices
+	static uint64_t hashMesh(const MeshData& mesh) {
+		uint64_t hash = 14695981039346656037ULL;
+		hash = hashBytes(hash, mesh.GetVertexData(), (size_t)mesh.GetVertexDataSize());
+		hash = hashBytes(hash, mesh.GetIndexData(), (size_t)mesh.GetIndexDataSize());
+		const VertexQuantization& quantization = mesh.quantization;
+		float ranges[] = { quantization.positionOffset.x, quantization.positionOffset.y, quantization.positionOffset.z,
+			quantization.positionScale.x, quantization.positionScale.y, quantization.positionScale.z,
+			quantization.texCoordOffset.x, quantization.texCoordOffset.y, quantization.texCoordScale.x, quantization.texCoordScale.y };
+		hash = hashBytes(hash, ranges, sizeof(ranges));
+		uint32_t formats[] = { quantization.packed ? 1u : 0u, (uint32_t)mesh.indexType };
+		hash = hashBytes(hash, formats, sizeof(formats));
+		for (size_t t = 0; t < mesh.textures.size(); t++) {
+			hash = hashBytes(hash, mesh.textures[t].type.c_str(), mesh.textures[t].type.size() + 1);
+			hash = hashBytes(hash, mesh.textures[t].path.c_str(), mesh.textures[t].path.size() + 1);
+		}
+		return hash;
+	}
+
+	// "models/foo/bar.png" -> "models/foo/bar.ktx2", written by tools/TextureConverter
+	static std::string compressedTexturePath(std::string path) {
+		size_t dot = path.find_last_of('.');
+		size_t slash = path.find_last_of("/\\");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+			return path + ".ktx2";
+		}
+		return path.substr(0, dot) + ".ktx2";
+	}
+
+	// Reads the .ktx2 next to a texture, when it is stored bottom row first like the images decoded with
+	// flipVertically - the blocks are not flipped here, a .ktx2 written top row first is left to the source image
+	static bool readCompressedTexture(std::string path, gps::Ktx2File& ktx) {
+		std::string ktxPath = compressedTexturePath(path);
+		if (!ktx.Read(ktxPath)) {
+			return false;
+		}
+		if (ktx.orientation.compare(0, 2, "ru") != 0) {
+			std::cerr << "WARNING: " << ktxPath << " has orientation \"" << ktx.orientation << "\", \"ru\" expected - decoding "
+				<< path << " instead" << std::endl;
+			ktx.levels.clear();
+			return false;
+		}
+		return true;
+	}
+
+	// Size, format and mip count of the array a prepared texture goes into - false when there is nothing to upload
+	static bool describeTexture(const Model3D::PendingTexture& texture, TextureArray& layout) {
+		if (!texture.compressed.levels.empty()) {
+			const gps::Ktx2File& ktx = texture.compressed;
+			layout.width = (GLsizei)ktx.width;
+			layout.height = (GLsizei)ktx.height;
+			layout.levels = (GLint)ktx.levels.size();
+			layout.internalFormat = ktx.vkFormat == Ktx2File::VK_FORMAT_BC1_RGB_SRGB_BLOCK ?
+				GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+			return true;
+		}
+		const DecodedImage& image = texture.image;
+		if (!image.pixels) {
+			return false;
+		}
+		layout.width = image.width;
+		layout.height = image.height;
+		layout.levels = 1 + (GLint)image.mipLevels.size();
+		if (image.mipLevels.empty()) {
+			// the whole chain, left to glGenerateMipmap
+			for (int size = std::max(image.width, image.height); size > 1; size >>= 1) {
+				layout.levels++;
+			}
+		}
+		layout.internalFormat = GL_SRGB;
+		return true;
+	}
+
+	static bool sameLayout(const TextureArray& a, const TextureArray& b) {
+		return a.width == b.width && a.height == b.height && a.levels == b.levels && a.internalFormat == b.internalFormat;
+	}
+
+	Model3D::Model3D() : geometryRetention(GEOMETRY_DISCARD), loadTimings()
+	{
+	}
+
+	void Model3D::SetGeometryRetention(GeometryRetention retention)
+	{
+		geometryRetention = retention;
+	}
+
 	void Model3D::LoadModel(std::string fileName)
 	{
         std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
-		ReadOBJ(fileName, basePath);
+		LoadModel(fileName, basePath);
 	}
 
     void Model3D::LoadModel(std::string fileName, std::string basePath)
 	{
-		ReadOBJ(fileName, basePath);
+		Prepare(fileName, basePath);
+		UploadPending(std::chrono::high_resolution_clock::time_point::max(), NULL);
+	}
+
+	// Parses the model and decodes its textures - does not touch GL, so it can run on a loader thread
+	void Model3D::Prepare(std::string fileName, std::string basePath)
+	{
+		this->fileName = fileName;
+		this->basePath = basePath;
+		StartPending();
+
+		// an identical model is already loaded - share its meshes and textures
+		pending->asset = AssetManager::Get().FindModel(fileName);
+		pending->shared = pending->asset != NULL;
+		if (pending->shared) {
+			std::cout << "Loaded " << fileName << " (shared)" << std::endl;
+			return;
+		}
+
+		pending->asset = std::make_shared<gps::ModelAsset>();
+		AssetManager::Get().AddModel(fileName, pending->asset);
+		if (!PrepareAsset(true)) {
+			// the scene cannot do without its models
+			exit(1);
+		}
+	}
+
+	bool Model3D::PrepareReload()
+	{
+		if (!IsLoaded() || pending) {
+			return false;
+		}
+
+		StartPending();
+		pending->asset = std::make_shared<gps::ModelAsset>();
+		pending->reloadTarget = asset;
+		// the .obj file or one of its .mtl libraries changed, so the cache is out of date - parse, which rewrites it
+		// a file caught mid-save fails to parse - the next change event brings it back
+		if (!PrepareAsset(false) || pending->meshes.empty()) {
+			std::cerr << "ERROR: could not reload " << fileName << ", keeping the loaded version" << std::endl;
+			pending.reset();
+			return false;
+		}
+		pending->reusedMeshes.assign(pending->meshes.size(), -1);
+		return true;
+	}
+
+	void Model3D::StartPending()
+	{
+		loadTimings = LoadTimings();
+		pending.reset(new PendingUpload());
+		pending->fileName = fileName;
+		pending->start = std::chrono::high_resolution_clock::now();
+		pending->shared = false;
+		pending->cached = false;
+		pending->nextTexture = 0;
+		pending->nextMesh = 0;
+		pending->uploadedLevel = 0;
+		pending->uploadedRows = 0;
+		pending->uploadedBytes = 0;
+	}
+
+	bool Model3D::PrepareAsset(bool useCache)
+	{
+		std::chrono::high_resolution_clock::time_point stageStart = std::chrono::high_resolution_clock::now();
+		pending->cached = useCache && ReadCache(fileName);
+		if (pending->cached) {
+			loadTimings.cache = millisecondsSince(stageStart);
+		}
+		else {
+			if (!ReadOBJ(fileName, basePath)) {
+				return false;
+			}
+			MeshCache::Write(fileName, pending->materialFiles, pending->meshes);
+		}
+		if (quantizedVertices) {
+			stageStart = std::chrono::high_resolution_clock::now();
+			QuantizeMeshes();
+			loadTimings.quantize = millisecondsSince(stageStart);
+		}
+		if (hotReload) {
+			pending->asset->meshHashes.resize(pending->meshes.size());
+			for (size_t i = 0; i < pending->meshes.size(); i++) {
+				pending->asset->meshHashes[i] = hashMesh(pending->meshes[i]);
+			}
+		}
+
+		std::vector<std::string> texturePaths;
+		for (size_t i = 0; i < pending->meshes.size(); i++) {
+			for (size_t t = 0; t < pending->meshes[i].textures.size(); t++) {
+				texturePaths.push_back(pending->meshes[i].textures[t].path);
+			}
+		}
+		stageStart = std::chrono::high_resolution_clock::now();
+		PrepareTextures(texturePaths);
+		loadTimings.textureDecode = millisecondsSince(stageStart);
+		return true;
+	}
+
+	// Uploads the prepared textures and meshes until the deadline passes (at least one step per call).
+	// Without an uploader everything is uploaded directly with glTexImage2D/glBufferData
+	bool Model3D::UploadPending(std::chrono::high_resolution_clock::time_point deadline, gps::Uploader* uploader)
+	{
+		if (!pending) {
+			return IsLoaded();
+		}
+
+		std::chrono::high_resolution_clock::time_point uploadStart = std::chrono::high_resolution_clock::now();
+		do {
+			if (pending->nextTexture < pending->textures.size()) {
+				UploadTextureStep(uploader);
+			}
+			else if (pending->nextMesh < pending->meshes.size()) {
+				UploadMeshStep(uploader);
+			}
+			else if (pending->reloadTarget) {
+				SwapReload();
+				pending.reset();
+				loadTimings.upload += millisecondsSince(uploadStart);
+				return true;
+			}
+			else {
+				// only now visible to Draw - Prepare may have run on another thread
+				asset = pending->asset;
+				if (!pending->shared) {
+					asset->loaded = true;
+
+					// the parsed vectors or the mapped cache go away with `pending`
+					size_t freedBytes = pending->cache.GetMappedSize();
+					for (size_t i = 0; i < pending->meshes.size(); i++) {
+						freedBytes += pending->meshes[i].GetMemoryBytes();
+					}
+					size_t keptBytes = 0;
+					for (size_t i = 0; i < asset->meshes.size(); i++) {
+						keptBytes += asset->meshes[i].GetGeometryBytes();
+					}
+					AssetManager::Get().AddGeometryMemory(freedBytes, keptBytes);
+
+					const double megabyte = 1024.0 * 1024.0;
+					std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - pending->start;
+					std::cout << "Loaded " << pending->fileName << " in " << elapsed.count() << " ms ("
+						<< (pending->cached ? "mesh cache" : "parsed .obj") << ", " << asset->meshes.size() << " draws, "
+						<< freedBytes / megabyte << " MB of CPU geometry freed, " << keptBytes / megabyte << " MB kept)" << std::endl;
+				}
+
+				pending.reset();
+				loadTimings.upload += millisecondsSince(uploadStart);
+				return true;
+			}
+		} while (std::chrono::high_resolution_clock::now() < deadline);
+
+		loadTimings.upload += millisecondsSince(uploadStart);
+		return false;
+	}
+
+	// On the GL thread, between frames: every model drawing the asset switches to the new meshes at once
+	void Model3D::SwapReload()
+	{
+		std::shared_ptr<gps::ModelAsset>& target = pending->reloadTarget;
+		std::vector<bool> kept(target->meshes.size(), false);
+		std::vector<gps::Mesh> meshes;
+		meshes.reserve(pending->meshes.size());
+		size_t nextUploaded = 0;
+		for (size_t i = 0; i < pending->meshes.size(); i++) {
+			int reused = pending->reusedMeshes[i];
+			if (reused >= 0) {
+				meshes.push_back(std::move(target->meshes[reused]));
+				kept[reused] = true;
+			}
+			else {
+				meshes.push_back(std::move(pending->asset->meshes[nextUploaded++]));
+			}
+		}
+
+		// the replaced meshes go to the temporary asset, which deletes their buffers as `pending` goes away.
+		// Moved-from meshes still hold the names of their buffers, so none may stay in an asset
+		std::vector<gps::Mesh> replaced;
+		for (size_t i = 0; i < kept.size(); i++) {
+			if (!kept[i]) {
+				replaced.push_back(std::move(target->meshes[i]));
+			}
+		}
+		target->meshes.swap(meshes);
+		pending->asset->meshes.swap(replaced);
+		meshes.clear();
+		replaced.clear();
+		target->meshHashes.swap(pending->asset->meshHashes);
+		// textures no longer referenced are released with the temporary asset
+		target->loadedTextures.swap(pending->asset->loadedTextures);
+		target->version++;
+
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - pending->start;
+		std::cout << "Reloaded " << fileName << " in " << elapsed.count() << " ms (" << nextUploaded << " of "
+			<< target->meshes.size() << " meshes uploaded, the others unchanged)" << std::endl;
+	}
+
+	bool Model3D::IsLoaded()
+	{
+		return asset && asset->loaded;
+	}
+
+	const Model3D::LoadTimings& Model3D::GetLoadTimings()
+	{
+		return loadTimings;
 	}
 	
+	void Model3D::SetLodView(const glm::mat4& view, const glm::mat4& projection, int viewportHeight)
+	{
+		lodView = view;
+		lodPixelsPerUnit = projection[1][1] * viewportHeight * 0.5f;
+	}
+
+	const Model3D::LodStats& Model3D::GetLodStats()
+	{
+		return lodStats;
+	}
+
+	void Model3D::ResetLodStats()
+	{
+		lodStats = LodStats();
+	}
+
+	void Model3D::SetCullView(const glm::mat4& viewProjection, const glm::vec4& eye)
+	{
+		cullView = ClusterView(viewProjection, eye);
+	}
+
+	const Model3D::ClusterStats& Model3D::GetClusterStats()
+	{
+		return clusterStats;
+	}
+
+	void Model3D::ResetClusterStats()
+	{
+		clusterStats = ClusterStats();
+	}
+
+	// Coarsest level of `mesh` whose error projects to less than the allowed pixels, moving from `current`
+	static int selectLod(const gps::Mesh& mesh, const glm::mat4& model, float scale, int current)
+	{
+		int count = (int)mesh.lods.size();
+		if (count <= 1 || Model3D::lodBias <= 0.0f) {
+			return 0;
+		}
+
+		glm::vec3 center = glm::vec3(lodView * model * glm::vec4(mesh.boundsCenter, 1.0f));
+		float distance = glm::length(center) - mesh.boundsRadius * scale;
+		if (distance <= 0.0f) {
+			// the camera is inside the bounds
+			return 0;
+		}
+
+		// object space error -> pixels
+		float pixelsPerError = scale * lodPixelsPerUnit / distance;
+		float allowed = Model3D::lodPixelError * Model3D::lodBias;
+		int lod = std::min(current, count - 1);
+		while (lod > 0 && mesh.lods[lod].error * pixelsPerError > allowed * (1.0f + LOD_HYSTERESIS)) {
+			lod--;
+		}
+		while (lod + 1 < count && mesh.lods[lod + 1].error * pixelsPerError < allowed * (1.0f - LOD_HYSTERESIS)) {
+			lod++;
+		}
+		return lod;
+	}
+
 	// Draw each mesh from the model
-	void Model3D::Draw(gps::Shader shaderProgram)
+	void Model3D::Draw(const gps::Shader& shaderProgram)
 	{
-		for (int i = 0; i < meshes.size(); i++)
-			meshes[i].Draw(shaderProgram);
+		if (!IsLoaded()) {
+			return;
+		}
+
+		meshLods.assign(asset->meshes.size(), 0);
+		for (size_t i = 0; i < asset->meshes.size(); i++) {
+			asset->meshes[i].Draw(shaderProgram);
+			lodStats.draws[0]++;
+			lodStats.triangles[0] += asset->meshes[i].lods[0].indexCount / 3;
+		}
+	}
+
+	void Model3D::Draw(const gps::Shader& shaderProgram, const glm::mat4& model)
+	{
+		if (!IsLoaded()) {
+			return;
+		}
+		DrawMeshes(shaderProgram, model, NULL);
+	}
+
+	void Model3D::DrawIndirect(const gps::Shader& shaderProgram, const glm::mat4& model)
+	{
+		if (!IsLoaded()) {
+			return;
+		}
+		if (!indirect) {
+			indirect.reset(new IndirectRenderer());
+		}
+		indirect->Build(*asset);
+		DrawMeshes(shaderProgram, model, indirect.get());
+		indirect->Submit(shaderProgram, *asset);
+	}
+
+	size_t Model3D::GetMeshCount()
+	{
+		return IsLoaded() ? asset->meshes.size() : 0;
+	}
+
+	const gps::Mesh& Model3D::GetMesh(size_t mesh)
+	{
+		return asset->meshes[mesh];
+	}
+
+	// largest scale of the model matrix, for the bounding spheres
+	static float maxScale(const glm::mat4& model)
+	{
+		return std::sqrt(std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+			std::max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])), glm::dot(glm::vec3(model[2]), glm::vec3(model[2])))));
+	}
+
+	void Model3D::DrawMesh(const gps::Shader& shaderProgram, const glm::mat4& model, size_t mesh)
+	{
+		if (!IsLoaded() || mesh >= asset->meshes.size()) {
+			return;
+		}
+		meshLods.resize(asset->meshes.size(), 0);
+		DrawMeshAt(shaderProgram, model, maxScale(model), cullView.ToObjectSpace(model), mesh, NULL);
+	}
+
+	void Model3D::DrawMeshes(const gps::Shader& shaderProgram, const glm::mat4& model, gps::IndirectRenderer* indirectRenderer)
+	{
+		float scale = maxScale(model);
+		ClusterView objectView = cullView.ToObjectSpace(model);
+
+		meshLods.resize(asset->meshes.size(), 0);
+		for (size_t i = 0; i < asset->meshes.size(); i++) {
+			DrawMeshAt(shaderProgram, model, scale, objectView, i, indirectRenderer);
+		}
+	}
+
+	void Model3D::DrawMeshAt(const gps::Shader& shaderProgram, const glm::mat4& model, float scale, const ClusterView& objectView,
+		size_t i, gps::IndirectRenderer* indirectRenderer)
+	{
+		gps::Mesh& mesh = asset->meshes[i];
+		int lod = selectLod(mesh, model, scale, meshLods[i]);
+		meshLods[i] = lod;
+		lodStats.draws[lod]++;
+		if (lod == 0 && clusterCulling && !mesh.meshlets.empty()) {
+			size_t culledTriangles = 0;
+			if (indirectRenderer) {
+				mesh.AppendClusterCommands(objectView, (GLuint)i, indirectRenderer->GetCommands(i),
+					clusterStats.outside, clusterStats.backfacing, culledTriangles);
+			}
+			else {
+				mesh.DrawClusters(shaderProgram, objectView, clusterStats.outside, clusterStats.backfacing, culledTriangles);
+			}
+			clusterStats.clusters += mesh.meshlets.size();
+			clusterStats.culledTriangles += culledTriangles;
+			lodStats.triangles[0] += mesh.lods[0].indexCount / 3 - culledTriangles;
+			return;
+		}
+		if (indirectRenderer) {
+			mesh.AppendCommand(lod, (GLuint)i, indirectRenderer->GetCommands(i));
+		}
+		else {
+			mesh.Draw(shaderProgram, lod);
+		}
+		lodStats.triangles[lod] += mesh.lods[lod].indexCount / 3;
+	}
+
+	void Model3D::GetDrawnLods(int& finest, int& coarsest)
+	{
+		finest = -1;
+		coarsest = -1;
+		for (size_t i = 0; i < meshLods.size(); i++) {
+			finest = finest == -1 ? meshLods[i] : std::min(finest, meshLods[i]);
+			coarsest = std::max(coarsest, meshLods[i]);
+		}
+	}
+
+	// Uploads one texture into its layer, or one slice of it when streaming through the uploader
+	void Model3D::UploadTextureStep(gps::Uploader* uploader)
+	{
+		PendingTexture& pendingTexture = pending->textures[pending->nextTexture];
+		DecodedImage& image = pendingTexture.image;
+		gps::Ktx2File& ktx = pendingTexture.compressed;
+		std::shared_ptr<TextureArray> array = pendingTexture.texture->array;
+
+		if (!array) {
+			fprintf(stderr, "ERROR: could not load %s\n", image.path.c_str());
+			TextureDecoder::Free(image);
+			pending->nextTexture++;
+			return;
+		}
+		// the first texture of an array to come up allocates all its layers
+		if (array->id == 0) {
+			CreateTextureArray(*array);
+		}
+		pendingTexture.texture->id = array->id;
+
+		if (!uploader) {
+			UploadTextureLayer(pendingTexture);
+			pending->nextTexture++;
+			return;
+		}
+
+		bool compressed = !ktx.levels.empty();
+		GLint levelCount = compressed ? (GLint)ktx.levels.size() : 1 + (GLint)image.mipLevels.size();
+		GLint level = pending->uploadedLevel;
+		GLint layer = pendingTexture.texture->layer;
+		GLsizei width = std::max(array->width >> level, 1);
+		GLsizei height = std::max(array->height >> level, 1);
+		int rows;
+		if (compressed) {
+			pending->uploadedRows += uploader->UploadCompressedRows(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_2D_ARRAY, array->id, level, layer,
+				array->internalFormat, width, height, (GLsizei)Ktx2File::GetBlockBytes(ktx.vkFormat), ktx.levels[level].data(),
+				pending->uploadedRows);
+			rows = (height + 3) / 4;
+		}
+		else {
+			const unsigned char* levelPixels = level == 0 ? image.pixels : image.mipLevels[level - 1].data();
+			pending->uploadedRows += uploader->UploadTextureRows(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_2D_ARRAY, array->id, level, layer,
+				width, height, 4, levelPixels, pending->uploadedRows);
+			rows = height;
+		}
+
+		if (pending->uploadedRows >= rows) {
+			pending->uploadedRows = 0;
+			pending->uploadedLevel++;
+		}
+
+		if (pending->uploadedLevel >= levelCount) {
+			if (!compressed && image.mipLevels.empty()) {
+				glBindTexture(GL_TEXTURE_2D_ARRAY, array->id);
+				glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+				glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+			}
+			TextureDecoder::Free(image);
+			ktx.levels.clear();
+			pending->uploadedLevel = 0;
+			pending->nextTexture++;
+		}
+	}
+
+	// Allocates every level of every layer, the pixels follow layer by layer
+	void Model3D::CreateTextureArray(TextureArray& array)
+	{
+		bool compressed = array.internalFormat != GL_SRGB;
+		GLsizei blockBytes = array.internalFormat == GL_COMPRESSED_SRGB_S3TC_DXT1_EXT ? 8 : 16;
+
+		glGenTextures(1, &array.id);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+		size_t gpuBytes = 0;
+		size_t uncompressedBytes = 0;
+		for (GLint level = 0; level < array.levels; level++) {
+			GLsizei width = std::max(array.width >> level, 1);
+			GLsizei height = std::max(array.height >> level, 1);
+			if (compressed) {
+				GLsizei layerBytes = ((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, array.internalFormat, width, height, array.layers, 0,
+					layerBytes * array.layers, NULL);
+				gpuBytes += (size_t)layerBytes * array.layers;
+			}
+			else {
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_SRGB, width, height, array.layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+				gpuBytes += (size_t)width * height * 4 * array.layers;
+			}
+			uncompressedBytes += (size_t)width * height * 4 * array.layers;
+		}
+
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, array.levels - 1);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		AssetManager::Get().AddTextureMemory(gpuBytes, uncompressedBytes);
+	}
+
+	// Uploads every level of a texture into its layer at once, and frees the CPU copy
+	void Model3D::UploadTextureLayer(PendingTexture& pendingTexture)
+	{
+		DecodedImage& image = pendingTexture.image;
+		gps::Ktx2File& ktx = pendingTexture.compressed;
+		const TextureArray& array = *pendingTexture.texture->array;
+		GLint layer = pendingTexture.texture->layer;
+
+		glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+		if (!ktx.levels.empty()) {
+			for (GLint level = 0; level < (GLint)ktx.levels.size(); level++) {
+				glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, std::max(array.width >> level, 1),
+					std::max(array.height >> level, 1), 1, array.internalFormat, (GLsizei)ktx.levels[level].size(), ktx.levels[level].data());
+			}
+		}
+		else {
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, array.width, array.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels);
+			// mips were filtered by the decoder threads
+			for (size_t i = 0; i < image.mipLevels.size(); i++) {
+				GLint level = (GLint)i + 1;
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, std::max(array.width >> level, 1), std::max(array.height >> level, 1), 1,
+					GL_RGBA, GL_UNSIGNED_BYTE, image.mipLevels[i].data());
+			}
+			if (image.mipLevels.empty()) {
+				glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+			}
+		}
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		TextureDecoder::Free(image);
+		ktx.levels.clear();
+	}
+
+	// Creates one mesh, or streams one slice of its vertex/index data when using the uploader
+	void Model3D::UploadMeshStep(gps::Uploader* uploader)
+	{
+		MeshData& data = pending->meshes[pending->nextMesh];
+
+		if (pending->uploadedBytes == 0) {
+			// a reload keeps the GL buffers of the meshes that did not change
+			if (pending->reloadTarget && !pending->asset->meshHashes.empty()) {
+				const std::vector<uint64_t>& loadedHashes = pending->reloadTarget->meshHashes;
+				std::vector<int>::iterator claimed = pending->reusedMeshes.begin() + pending->nextMesh;
+				for (size_t m = 0; m < loadedHashes.size(); m++) {
+					if (loadedHashes[m] == pending->asset->meshHashes[pending->nextMesh] &&
+						std::find(pending->reusedMeshes.begin(), claimed, (int)m) == claimed) {
+						*claimed = (int)m;
+						pending->nextMesh++;
+						return;
+					}
+				}
+			}
+			if (pending->nextMesh == 0) {
+				pending->asset->meshes.reserve(pending->meshes.size());
+			}
+			std::vector<gps::Texture> textures;
+			textures.reserve(data.textures.size());
+			for (size_t t = 0; t < data.textures.size(); t++) {
+				textures.push_back(LoadTexture(data.textures[t].path, data.textures[t].type));
+			}
+
+			if (!uploader) {
+				// the vertex data (or the mapped cache pages) go straight to glBufferData
+				pending->asset->meshes.emplace_back(data.GetVertexData(), data.GetVertexCount(), data.quantization,
+					data.GetIndexData(), data.GetIndexCount(), data.indexType, std::move(textures));
+			}
+			else {
+				pending->asset->meshes.emplace_back((const void*)NULL, data.GetVertexCount(), data.quantization, (const void*)NULL,
+					data.GetIndexCount(), data.indexType, std::move(textures));
+			}
+
+			gps::Mesh& mesh = pending->asset->meshes.back();
+			if (geometryRetention != GEOMETRY_DISCARD) {
+				const Vertex* vertices = data.GetVertices();
+				mesh.vertices.assign(vertices, vertices + data.GetVertexCount());
+				if (data.indexType == GL_UNSIGNED_SHORT) {
+					const GLushort* indices = (const GLushort*)data.GetIndexData();
+					mesh.indices.assign(indices, indices + data.GetIndexCount());
+				}
+				else {
+					const GLuint* indices = (const GLuint*)data.GetIndexData();
+					mesh.indices.assign(indices, indices + data.GetIndexCount());
+				}
+				mesh.ReleaseGeometry(geometryRetention);
+			}
+			if (!data.lods.empty()) {
+				mesh.lods = data.lods;
+			}
+			mesh.meshlets = data.meshlets;
+			mesh.boundsCenter = data.boundsCenter;
+			mesh.boundsRadius = data.boundsRadius;
+
+			if (!uploader) {
+				pending->nextMesh++;
+				return;
+			}
+		}
+
+		Buffers buffers = pending->asset->meshes.back().getBuffers();
+		GLsizeiptr vertexBytes = data.GetVertexDataSize();
+		GLsizeiptr indexBytes = data.GetIndexDataSize();
+		GLsizeiptr vertexStride = data.quantization.packed ? sizeof(PackedVertex) : sizeof(Vertex);
+
+		if (pending->uploadedBytes < vertexBytes) {
+			pending->uploadedBytes += uploader->UploadBuffer(buffers.VBO, (GLintptr)buffers.baseVertex * vertexStride + pending->uploadedBytes,
+				vertexBytes - pending->uploadedBytes, (const char*)data.GetVertexData() + pending->uploadedBytes);
+		}
+		else {
+			GLsizeiptr offset = pending->uploadedBytes - vertexBytes;
+			pending->uploadedBytes += uploader->UploadBuffer(buffers.EBO, buffers.indexOffset + offset,
+				indexBytes - offset, (const char*)data.GetIndexData() + offset);
+		}
+
+		if (pending->uploadedBytes >= vertexBytes + indexBytes) {
+			pending->uploadedBytes = 0;
+			pending->nextMesh++;
+		}
+	}
+
+	// Takes the meshes from the binary cache of the .obj file, if it is up to date
+	bool Model3D::ReadCache(std::string fileName) {
+
+		if (!pending->cache.Open(fileName)) {
+			return false;
+		}
+
+		std::cout << "Loading : " << fileName << " (mesh cache)" << std::endl;
+		// the geometry stays in the mapped pages until it is uploaded
+		pending->meshes = pending->cache.GetMeshes();
+
+		return true;
 	}
 
 	// Does the parsing of the .obj file and fills in the data structure
-	void Model3D::ReadOBJ(std::string fileName, std::string basePath){
+	bool Model3D::ReadOBJ(std::string fileName, std::string basePath){
 
         std::cout << "Loading : " << fileName << std::endl;
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
-		int materialId;
 
 		std::string err;
-		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		std::chrono::high_resolution_clock::time_point stageStart = std::chrono::high_resolution_clock::now();
+		bool ret = ObjParser::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE, ThreadPool::Shared(),
+			&pending->materialFiles);
+		loadTimings.parse = millisecondsSince(stageStart);
+		stageStart = std::chrono::high_resolution_clock::now();
 
 		if (!err.empty()) { // `err` may contain warning message.
 			std::cerr << err << std::endl;
 		}
 
 		if (!ret) {
-			exit(1);
+			std::cerr << "ERROR: could not read " << fileName << std::endl;
+			return false;
 		}
 
 		std::cout << "# of shapes    : " << shapes.size() << std::endl;
 		std::cout << "# of materials : " << materials.size() << std::endl;
 
+		size_t firstMesh = pending->meshes.size();
+		BuildMeshes(attrib, shapes, materials, basePath, pending->meshes);
+		loadTimings.build = millisecondsSince(stageStart);
+
+		OptimizeMeshes(firstMesh);
+		return true;
+	}
+
+	void Model3D::BuildMeshes(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes,
+		const std::vector<tinyobj::material_t>& materials, std::string basePath, std::vector<MeshData>& meshes) {
+		int materialId;
+
+		// Faces are grouped by material across all shapes, so each material is drawn with one call.
+		// Buckets are created in order of first use; faces without a material share the last slot.
+		// A first pass only counts the corners of each bucket, so everything below is sized exactly
+		std::vector<int> bucketOfMaterial(materials.size() + 1, -1);
+		std::vector<int> bucketMaterial;
+		std::vector<size_t> bucketCorners;
+		size_t firstMesh = meshes.size();
+
+		for (size_t s = 0; s < shapes.size(); s++) {
+			for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
+				materialId = f < shapes[s].mesh.material_ids.size() ? shapes[s].mesh.material_ids[f] : -1;
+				if (materialId < 0 || materialId >= (int)materials.size()) {
+					materialId = -1;
+				}
+				int& bucket = bucketOfMaterial[materialId == -1 ? materials.size() : materialId];
+				if (bucket == -1) {
+					bucket = (int)bucketMaterial.size();
+					bucketMaterial.push_back(materialId);
+					bucketCorners.push_back(0);
+				}
+				bucketCorners[bucket] += shapes[s].mesh.num_face_vertices[f];
+			}
+		}
+
+		// Maps each (vertex, normal, texcoord) index triple to its slot in the vertices of its bucket,
+		// so that corners shared between faces are stored only once. One open addressing table per bucket,
+		// all in a single scratch allocation, with at least 1.25 slots per corner (at most 80% full)
+		std::vector<size_t> tableStart(bucketMaterial.size() + 1, 0);
+		std::vector<int> tableShift(bucketMaterial.size());
+		for (size_t b = 0; b < bucketMaterial.size(); b++) {
+			int bits = 1;
+			while (((size_t)1 << bits) < bucketCorners[b] + bucketCorners[b] / 4) {
+				bits++;
+			}
+			tableShift[b] = 64 - bits;
+			tableStart[b + 1] = tableStart[b] + ((size_t)1 << bits);
+		}
+		WeldSlot emptySlot = { { 0, 0, 0 }, EMPTY_SLOT };
+		std::vector<WeldSlot> weldArena(tableStart.back(), emptySlot);
+		std::vector<GLuint> uniqueCount(bucketMaterial.size(), 0);
+
+		meshes.resize(firstMesh + bucketMaterial.size());
+		for (size_t b = 0; b < bucketMaterial.size(); b++) {
+			meshes[firstMesh + b].indices.reserve(bucketCorners[b]);
+		}
+
 		// Loop over shapes
 		for (size_t s = 0; s < shapes.size(); s++) {
-			std::vector<gps::Vertex> vertices;
-			std::vector<GLuint> indices;
-			std::vector<gps::Texture> textures;
 
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
 			for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
 				int fv = shapes[s].mesh.num_face_vertices[f];
 
-				//gps::Texture currentTexture = LoadTexture("index1.png", "ambientTexture");
-				//textures.push_back(currentTexture);
+				materialId = f < shapes[s].mesh.material_ids.size() ? shapes[s].mesh.material_ids[f] : -1;
+				if (materialId < 0 || materialId >= (int)materials.size()) {
+					materialId = -1;
+				}
+				int bucket = bucketOfMaterial[materialId == -1 ? materials.size() : materialId];
+				std::vector<GLuint>& indices = meshes[firstMesh + bucket].indices;
+				WeldSlot* table = &weldArena[tableStart[bucket]];
+				size_t mask = tableStart[bucket + 1] - tableStart[bucket] - 1;
 
 				// Loop over vertices in the face.
 				for (size_t v = 0; v < fv; v++) {
 					// access to vertex
 					tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
 
-					float vx = attrib.vertices[3 * idx.vertex_index + 0];
-					float vy = attrib.vertices[3 * idx.vertex_index + 1];
-					float vz = attrib.vertices[3 * idx.vertex_index + 2];
-					float nx = attrib.normals[3 * idx.normal_index + 0];
-					float ny = attrib.normals[3 * idx.normal_index + 1];
-					float nz = attrib.normals[3 * idx.normal_index + 2];
-					float tx = 0.0f;
-					float ty = 0.0f;
-					if (idx.texcoord_index != -1) {
-						tx = attrib.texcoords[2 * idx.texcoord_index + 0];
-						ty = attrib.texcoords[2 * idx.texcoord_index + 1];
+					VertexKey key = { idx.vertex_index, idx.normal_index, idx.texcoord_index };
+					// Fibonacci hashing spreads the combined hash over the table, then linear probing
+					size_t slot = (size_t)(((uint64_t)VertexKeyHash()(key) * 11400714819323198485ULL) >> tableShift[bucket]);
+					while (table[slot].index != EMPTY_SLOT && !(table[slot].key == key)) {
+						slot = (slot + 1) & mask;
+					}
+					if (table[slot].index == EMPTY_SLOT) {
+						table[slot].key = key;
+						table[slot].index = uniqueCount[bucket]++;
 					}
 
-					glm::vec3 vertexPosition(vx, vy, vz);
-					glm::vec3 vertexNormal(nx, ny, nz);
-					glm::vec2 vertexTexCoords(tx, ty);
+					indices.push_back(table[slot].index);
+				}
+
+				index_offset += fv;
+			}
+		}
 
-					gps::Vertex currentVertex;
-					currentVertex.Position = vertexPosition;
-					currentVertex.Normal = vertexNormal;
-					currentVertex.TexCoords = vertexTexCoords;
+		// The vertices are only built now that their number is known
+		for (size_t b = 0; b < bucketMaterial.size(); b++) {
+			std::vector<gps::Vertex>& vertices = meshes[firstMesh + b].vertices;
+			vertices.resize(uniqueCount[b]);
 
-					vertices.push_back(currentVertex);
+			for (size_t slot = tableStart[b]; slot < tableStart[b + 1]; slot++) {
+				if (weldArena[slot].index == EMPTY_SLOT) {
+					continue;
+				}
+				const VertexKey& key = weldArena[slot].key;
 
-					indices.push_back(index_offset + v);
+				float vx = attrib.vertices[3 * key.vertexIndex + 0];
+				float vy = attrib.vertices[3 * key.vertexIndex + 1];
+				float vz = attrib.vertices[3 * key.vertexIndex + 2];
+				float nx = attrib.normals[3 * key.normalIndex + 0];
+				float ny = attrib.normals[3 * key.normalIndex + 1];
+				float nz = attrib.normals[3 * key.normalIndex + 2];
+				float tx = 0.0f;
+				float ty = 0.0f;
+				if (key.texcoordIndex != -1) {
+					tx = attrib.texcoords[2 * key.texcoordIndex + 0];
+					ty = attrib.texcoords[2 * key.texcoordIndex + 1];
 				}
 
-				index_offset += fv;
+				gps::Vertex& currentVertex = vertices[weldArena[slot].index];
+				currentVertex.Position = glm::vec3(vx, vy, vz);
+				currentVertex.Normal = glm::vec3(nx, ny, nz);
+				currentVertex.TexCoords = glm::vec2(tx, ty);
 			}
+		}
+		std::vector<WeldSlot>().swap(weldArena);
 
-			// get material id
-			// Only try to read materials if the .mtl file is present
-			int a = shapes[s].mesh.material_ids.size();
-			if (a > 0 && materials.size()>0) {
-				materialId = shapes[s].mesh.material_ids[0];
-				if (materialId != -1) {
-					gps::Material currentMaterial;
-					currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
-					currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
-					currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
-
-					//ambient texture
-					std::string ambientTexturePath = materials[materialId].ambient_texname;
-					if (!ambientTexturePath.empty())
-					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + ambientTexturePath, "ambientTexture");
-						textures.push_back(currentTexture);
-					}
+		for (size_t b = 0; b < bucketMaterial.size(); b++) {
+			MeshData& mesh = meshes[firstMesh + b];
+			materialId = bucketMaterial[b];
 
-					//diffuse texture
-					std::string diffuseTexturePath = materials[materialId].diffuse_texname;
-					if (!diffuseTexturePath.empty())
-					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + diffuseTexturePath, "diffuseTexture");
-						textures.push_back(currentTexture);
-					}
+			std::cout << "# of vertices  : " << (materialId == -1 ? std::string("(no material)") : materials[materialId].name)
+				<< " " << bucketCorners[b] << " -> " << mesh.vertices.size() << " (welded)" << std::endl;
 
-					//specular texture
-					std::string specularTexturePath = materials[materialId].specular_texname;
-					if (!specularTexturePath.empty())
-					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + specularTexturePath, "specularTexture");
-						textures.push_back(currentTexture);
-					}
+			if (materialId == -1) {
+				continue;
+			}
+
+			// resolved to GL textures once the decoded images are uploaded
+			std::string texturePaths[3] = { materials[materialId].ambient_texname, materials[materialId].diffuse_texname, materials[materialId].specular_texname };
+			const char* textureTypes[3] = { "ambientTexture", "diffuseTexture", "specularTexture" };
+			for (int t = 0; t < 3; t++) {
+				if (!texturePaths[t].empty()) {
+					gps::Texture currentTexture;
+					currentTexture.id = 0;
+					currentTexture.layer = 0;
+					currentTexture.type = textureTypes[t];
+					currentTexture.path = basePath + texturePaths[t];
+					mesh.textures.push_back(currentTexture);
+				}
+			}
+		}
+
+		std::cout << "# of draws     : " << shapes.size() << " shapes -> " << bucketMaterial.size() << " materials" << std::endl;
+	}
+
+	// Reorders the parsed meshes for the vertex cache, overdraw and vertex fetch and builds their levels of detail,
+	// one mesh per worker. Done before the mesh cache is written, so cached models load already optimized
+	void Model3D::OptimizeMeshes(size_t firstMesh) {
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		size_t count = pending->meshes.size() - firstMesh;
+		std::vector<VertexCacheStats> before(count);
+		std::vector<VertexCacheStats> after(count);
+		// the meshes that come out of each one, more than one when it is too big for 16-bit indices
+		std::vector<std::vector<MeshData> > parts(count);
+		std::vector<std::future<void> > jobs;
+
+		for (size_t i = 0; i < count; i++) {
+			MeshData* mesh = &pending->meshes[firstMesh + i];
+			VertexCacheStats* meshBefore = &before[i];
+			VertexCacheStats* meshAfter = &after[i];
+			std::vector<MeshData>* meshParts = &parts[i];
+			jobs.push_back(ThreadPool::Shared().Enqueue([mesh, meshBefore, meshAfter, meshParts]() {
+				*meshBefore = MeshOptimizer::AnalyzeVertexCache(mesh->indices.data(), mesh->indices.size(), mesh->vertices.size());
+				MeshOptimizer::Optimize(*mesh);
+				if (mesh->vertices.size() > MeshOptimizer::MAX_SHORT_VERTICES) {
+					*meshParts = MeshOptimizer::Split(*mesh, MeshOptimizer::MAX_SHORT_VERTICES);
+				}
+				else {
+					meshParts->push_back(MeshData());
+					std::swap(meshParts->back(), *mesh);
+				}
+
+				// the cut edges become borders, which the simplifier keeps, so the parts' LODs still match up
+				for (size_t p = 0; p < meshParts->size(); p++) {
+					MeshData& part = (*meshParts)[p];
+					*meshAfter += MeshOptimizer::AnalyzeVertexCache(part.indices.data(), part.indices.size(), part.vertices.size());
+					MeshSimplifier::BuildLods(part);
+					MeshletBuilder::Build(part);
+					MeshOptimizer::ShrinkIndices(part);
+				}
+			}));
+		}
+
+		VertexCacheStats totalBefore;
+		VertexCacheStats totalAfter;
+		size_t lodTriangles[Mesh::MAX_LODS] = { 0 };
+		size_t splitMeshes = 0;
+		// the jobs work on the meshes in place, so they only get replaced by the parts once all are done
+		for (size_t i = 0; i < count; i++) {
+			jobs[i].wait();
+		}
+		pending->meshes.resize(firstMesh);
+		for (size_t i = 0; i < count; i++) {
+			totalBefore += before[i];
+			totalAfter += after[i];
+			splitMeshes += parts[i].size() > 1 ? 1 : 0;
+
+			for (size_t p = 0; p < parts[i].size(); p++) {
+				// meshes with fewer levels count their coarsest one for the rest
+				const std::vector<MeshLod>& lods = parts[i][p].lods;
+				for (size_t lod = 0; lod < Mesh::MAX_LODS && !lods.empty(); lod++) {
+					lodTriangles[lod] += lods[std::min(lod, lods.size() - 1)].indexCount / 3;
 				}
+				pending->meshes.push_back(MeshData());
+				std::swap(pending->meshes.back(), parts[i][p]);
+			}
+		}
+
+		size_t shortMeshes = 0;
+		size_t meshlets = 0;
+		size_t meshletTriangles = 0;
+		for (size_t i = firstMesh; i < pending->meshes.size(); i++) {
+			shortMeshes += pending->meshes[i].indexType == GL_UNSIGNED_SHORT ? 1 : 0;
+			meshlets += pending->meshes[i].meshlets.size();
+			for (size_t m = 0; m < pending->meshes[i].meshlets.size(); m++) {
+				meshletTriangles += pending->meshes[i].meshlets[m].indexCount / 3;
 			}
+		}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+		loadTimings.optimize = elapsed.count();
+		std::cout << "# vertex cache : ACMR " << totalBefore.GetACMR() << " -> " << totalAfter.GetACMR()
+			<< ", ATVR " << totalBefore.GetATVR() << " -> " << totalAfter.GetATVR() << std::endl;
+		std::cout << "# of triangles : ";
+		for (size_t lod = 0; lod < Mesh::MAX_LODS; lod++) {
+			std::cout << (lod ? " / " : "") << "LOD" << lod << " " << lodTriangles[lod];
 		}
+		std::cout << " (optimized in " << elapsed.count() << " ms)" << std::endl;
+		std::cout << "# 16-bit index : " << shortMeshes << "/" << pending->meshes.size() - firstMesh << " meshes ("
+			<< splitMeshes << " split for it)" << std::endl;
+		std::cout << "# of meshlets  : " << meshlets << " (" << (meshlets ? (double)meshletTriangles / meshlets : 0.0)
+			<< " triangles each on average)" << std::endl;
+	}
+
+	// Packs the vertices of every mesh to 16 bytes on a grid over the bounds of the whole model.
+	// The cache keeps the float vertices, so the packing can be turned off without rebuilding it
+	void Model3D::QuantizeMeshes() {
+		if (pending->meshes.empty()) {
+			return;
+		}
+
+		glm::vec3 boundsMin(FLT_MAX);
+		glm::vec3 boundsMax(-FLT_MAX);
+		for (size_t i = 0; i < pending->meshes.size(); i++) {
+			const Vertex* vertices = pending->meshes[i].GetVertices();
+			for (GLsizei v = 0; v < pending->meshes[i].GetVertexCount(); v++) {
+				boundsMin = glm::min(boundsMin, vertices[v].Position);
+				boundsMax = glm::max(boundsMax, vertices[v].Position);
+			}
+		}
+
+		QuantizationError error;
+		size_t packed = 0;
+		for (size_t i = 0; i < pending->meshes.size(); i++) {
+			if (VertexQuantizer::Quantize(pending->meshes[i], boundsMin, boundsMax, error)) {
+				packed++;
+			}
+			else {
+				fprintf(stderr, "WARNING: %s mesh %zu is over the quantization error bounds, kept as float\n",
+					pending->fileName.c_str(), i);
+			}
+		}
+
+		std::cout << "# vertex format: " << packed << "/" << pending->meshes.size() << " meshes at " << sizeof(PackedVertex)
+			<< " bytes per vertex (" << sizeof(Vertex) << " as float), max error position " << error.position
+			<< ", normal " << error.normal << " deg, uv " << error.texCoord << std::endl;
 	}
 
 	// Retrieves a texture associated with the object - by its name and type
 	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
 
-			for (int i = 0; i < loadedTextures.size(); i++) {
-				if (loadedTextures[i].path == path)
-				{
-					//already loaded texture
-					return loadedTextures[i];
-				}
+			std::shared_ptr<TextureAsset> texture;
+
+			std::unordered_map<std::string, std::shared_ptr<TextureAsset> >::iterator found = pending->asset->loadedTextures.find(path);
+			if (found != pending->asset->loadedTextures.end()) {
+				//already loaded texture
+				texture = found->second;
+			}
+			else {
+				// may still be loaded by another model
+				texture = AssetManager::Get().FindTexture(path);
+				pending->asset->loadedTextures[path] = texture;
 			}
 
 			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
+			currentTexture.id = texture ? texture->id : 0;
+			currentTexture.layer = texture ? texture->layer : 0;
 			currentTexture.type = std::string(type);
 			currentTexture.path = path;
 
-			loadedTextures.push_back(currentTexture);
-
 			return currentTexture;
 		}
 
-	// Reads the pixel data from an image file and loads it into the video memory
-	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
-		int x, y, n;
-		int force_channels = 4;
-		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
-		if (!image_data) {
-			fprintf(stderr, "ERROR: could not load %s\n", file_name);
-			return false;
+	// Decodes all the given textures at the same time on the worker pool; the uploads are left to UploadPending
+	void Model3D::PrepareTextures(std::vector<std::string> paths) {
+
+		TextureDecoder decoder;
+		for (size_t i = 0; i < paths.size(); i++) {
+			if (pending->asset->loadedTextures.find(paths[i]) != pending->asset->loadedTextures.end()) {
+				continue;
+			}
+
+			// may already be loaded (or being loaded) by another model
+			std::shared_ptr<TextureAsset> texture = AssetManager::Get().FindTexture(paths[i]);
+			if (!texture) {
+				// registered right away so a path listed twice, or by another model, is decoded once
+				texture = std::make_shared<TextureAsset>(0, paths[i]);
+				AssetManager::Get().AddTexture(paths[i], texture);
+
+				// a block-compressed version from tools/TextureConverter needs no decoding
+				PendingTexture pendingTexture;
+				if (compressedTextures && GLEW_EXT_texture_compression_s3tc &&
+					readCompressedTexture(paths[i], pendingTexture.compressed)) {
+					std::cout << "Loaded " << compressedTexturePath(paths[i]) << " (" << pendingTexture.compressed.width << "x"
+						<< pendingTexture.compressed.height << ", " << pendingTexture.compressed.levels.size() << " levels)" << std::endl;
+					pendingTexture.image.path = paths[i];
+					pendingTexture.image.pixels = NULL;
+					pendingTexture.texture = texture;
+					pending->textures.push_back(pendingTexture);
+				}
+				else {
+					decoder.Request(paths[i], 4, true, true);
+				}
+			}
+			pending->asset->loadedTextures[paths[i]] = texture;
 		}
-		// NPOT check
-		if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
-			fprintf(
-				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", file_name
-			);
-		}
-
-		int width_in_bytes = x * 4;
-		unsigned char *top = NULL;
-		unsigned char *bottom = NULL;
-		unsigned char temp = 0;
-		int half_height = y / 2;
-
-		for (int row = 0; row < half_height; row++) {
-			top = image_data + row * width_in_bytes;
-			bottom = image_data + (y - row - 1) * width_in_bytes;
-			for (int col = 0; col < width_in_bytes; col++) {
-				temp = *top;
-				*top = *bottom;
-				*bottom = temp;
-				top++;
-				bottom++;
-			}
-		}
-
-		GLuint textureID;
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_SRGB, //GL_SRGB,//GL_RGBA,
-			x,
-			y,
-			0,
-			GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			image_data
-		);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glBindTexture(GL_TEXTURE_2D, 0);
-
-		return textureID;
+
+		DecodedImage image;
+		while (decoder.WaitNext(image)) {
+			std::cout << "Decoded " << image.path << " (" << image.width << "x" << image.height << ") in "
+				<< image.decodeMilliseconds << " ms" << std::endl;
+
+			PendingTexture pendingTexture;
+			pendingTexture.image = image;
+			pendingTexture.texture = pending->asset->loadedTextures[image.path];
+			pending->textures.push_back(pendingTexture);
+		}
+
+		PackTextureArrays();
 	}
 
+	void Model3D::PackTextureArrays() {
+		std::vector<std::shared_ptr<TextureArray> > arrays;
+		for (size_t i = 0; i < pending->textures.size(); i++) {
+			PendingTexture& pendingTexture = pending->textures[i];
+			TextureArray layout;
+			if (!describeTexture(pendingTexture, layout)) {
+				continue;
+			}
+			// NPOT check
+			if ((layout.width & (layout.width - 1)) != 0 || (layout.height & (layout.height - 1)) != 0) {
+				fprintf(stderr, "WARNING: texture %s is not power-of-2 dimensions\n", pendingTexture.image.path.c_str());
+			}
+
+			std::shared_ptr<TextureArray> array;
+			for (size_t a = 0; a < arrays.size() && !array; a++) {
+				if (sameLayout(*arrays[a], layout)) {
+					array = arrays[a];
+				}
+			}
+			if (!array) {
+				array = std::make_shared<TextureArray>();
+				array->width = layout.width;
+				array->height = layout.height;
+				array->levels = layout.levels;
+				array->internalFormat = layout.internalFormat;
+				arrays.push_back(array);
+			}
+			pendingTexture.texture->array = array;
+			pendingTexture.texture->layer = array->layers++;
+		}
+
+		if (!pending->textures.empty()) {
+			std::cout << "# texture array: " << pending->textures.size() << " textures in " << arrays.size() << " arrays" << std::endl;
+		}
+	}
+
+	bool Model3D::PrepareTextureReload(std::string changedPath, std::vector<PendingTexture>& reloads) {
+		std::string changed = AssetManager::CanonicalPath(changedPath);
+		std::vector<std::shared_ptr<TextureAsset> > textures = AssetManager::Get().GetTextures();
+		std::unordered_map<std::string, std::shared_ptr<TextureAsset> > decoding;
+		bool found = false;
+
+		TextureDecoder decoder;
+		for (size_t i = 0; i < textures.size(); i++) {
+			// the .ktx2 next to the source image is used instead of it when there is one
+			std::string source = AssetManager::CanonicalPath(textures[i]->path);
+			if (textures[i]->id == 0 || (changed != source && changed != compressedTexturePath(source))) {
+				continue;
+			}
+			found = true;
+
+			PendingTexture reload;
+			reload.texture = textures[i];
+			if (compressedTextures && GLEW_EXT_texture_compression_s3tc && readCompressedTexture(textures[i]->path, reload.compressed)) {
+				reload.image.path = textures[i]->path;
+				reload.image.pixels = NULL;
+				reloads.push_back(reload);
+			}
+			else if (decoding.insert(std::make_pair(textures[i]->path, textures[i])).second) {
+				decoder.Request(textures[i]->path, 4, true, true);
+			}
+		}
+
+		DecodedImage image;
+		while (decoder.WaitNext(image)) {
+			if (!image.pixels) {
+				// e.g. still being written - the next change event reloads it
+				fprintf(stderr, "ERROR: could not reload %s, keeping the loaded version\n", image.path.c_str());
+				continue;
+			}
+			PendingTexture reload;
+			reload.image = image;
+			reload.texture = decoding[image.path];
+			reloads.push_back(reload);
+		}
+		return found;
+	}
+
+	void Model3D::UploadTextureReload(PendingTexture& reload) {
+		TextureArray layout;
+		if (!describeTexture(reload, layout)) {
+			TextureDecoder::Free(reload.image);
+			return;
+		}
+
+		std::shared_ptr<TextureArray> array = reload.texture->array;
+		if (!array || !sameLayout(*array, layout)) {
+			// no longer fits its layer - moves to an array of its own, and the meshes drawing it follow
+			array = std::make_shared<TextureArray>();
+			array->width = layout.width;
+			array->height = layout.height;
+			array->levels = layout.levels;
+			array->internalFormat = layout.internalFormat;
+			array->layers = 1;
+			CreateTextureArray(*array);
+			reload.texture->array = array;
+			reload.texture->id = array->id;
+			reload.texture->layer = 0;
+
+			std::vector<std::shared_ptr<ModelAsset> > models = AssetManager::Get().GetModels();
+			for (size_t m = 0; m < models.size(); m++) {
+				models[m]->version++;
+				for (size_t i = 0; i < models[m]->meshes.size(); i++) {
+					std::vector<gps::Texture>& textures = models[m]->meshes[i].textures;
+					for (size_t t = 0; t < textures.size(); t++) {
+						if (textures[t].path == reload.texture->path) {
+							textures[t].id = array->id;
+							textures[t].layer = 0;
+						}
+					}
+				}
+			}
+		}
+		UploadTextureLayer(reload);
+		std::cout << "Reloaded " << reload.texture->path << std::endl;
+	}
+
+	// GL objects are released by the shared asset once its last user is gone
 	Model3D::~Model3D() {
-        for (size_t i = 0; i < loadedTextures.size(); i++) {
-            glDeleteTextures(1, &loadedTextures.at(i).id);
-        }
-
-        for (size_t i = 0; i < meshes.size(); i++) {
-            GLuint VBO = meshes.at(i).getBuffers().VBO;
-            GLuint EBO = meshes.at(i).getBuffers().EBO;
-            GLuint VAO = meshes.at(i).getBuffers().VAO;
-            glDeleteBuffers(1, &VBO);
-            glDeleteBuffers(1, &EBO);
-            glDeleteVertexArrays(1, &VAO);
-        }
+		Release();
+	}
+
+	void Model3D::Release() {
+		// images decoded for a load that never finished uploading
+		if (pending) {
+			for (size_t i = pending->nextTexture; i < pending->textures.size(); i++) {
+				TextureDecoder::Free(pending->textures[i].image);
+			}
+		}
+		pending.reset();
+		indirect.reset();
+		asset.reset();
 	}
 }
@@ -1,13 +1,32 @@
 #ifndef Model3D_hpp
 #define Model3D_hpp
 
+#include "AssetManager.hpp"
+#include "IndirectRenderer.hpp"
+#include "Ktx2File.hpp"
 #include "Mesh.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "MeshletBuilder.hpp"
+#include "ObjParser.hpp"
+#include "TextureDecoder.hpp"
+#include "Uploader.hpp"
+#include "VertexQuantizer.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace gps {
@@ -16,28 +35,223 @@ namespace gps {
     {
 
     public:
+        // Set to false to always decode the source images, even when a .ktx2 version exists
+        static bool compressedTextures;
+        // Set to false to upload 32-byte float vertices instead of the 16-byte packed ones
+        static bool quantizedVertices;
+        // Set before loading to keep a content hash of every mesh, so PrepareReload can keep the unchanged ones
+        static bool hotReload;
+
+        // Each mesh is drawn at the coarsest level of detail whose error stays under lodPixelError pixels
+        // on screen. lodBias scales that allowance: 2 switches at twice the size, 0 always draws full detail
+        static float lodBias;
+        static float lodPixelError;
+
+        // Meshes drawn and triangles submitted at each level of detail
+        struct LodStats
+        {
+            size_t draws[Mesh::MAX_LODS];
+            size_t triangles[Mesh::MAX_LODS];
+        };
+
+        // Camera the levels of detail are picked for - set once per frame, before drawing
+        static void SetLodView(const glm::mat4& view, const glm::mat4& projection, int viewportHeight);
+        // Totals since the last ResetLodStats
+        static const LodStats& GetLodStats();
+        static void ResetLodStats();
+
+        // Set to false to draw the full detail level whole instead of culling its meshlets
+        static bool clusterCulling;
+
+        // Meshlets of the full detail levels drawn, and those culled with their triangles
+        struct ClusterStats
+        {
+            size_t clusters;
+            size_t outside;
+            size_t backfacing;
+            size_t culledTriangles;
+        };
+
+        // View of the current pass the meshlets are culled against - the camera for the main pass, the light
+        // for the shadow map. `eye` is the eye position (w = 1) or the viewing direction of an orthographic view (w = 0)
+        static void SetCullView(const glm::mat4& viewProjection, const glm::vec4& eye);
+        static const ClusterStats& GetClusterStats();
+        static void ResetClusterStats();
+
+        // Milliseconds spent in each stage of the last load, 0 for the stages it skipped
+        struct LoadTimings
+        {
+            // reading the mesh cache, instead of parse/build/optimize
+            double cache;
+            double parse;
+            // welding the face corners into one mesh per material
+            double build;
+            // vertex cache and overdraw order, levels of detail, meshlets
+            double optimize;
+            double quantize;
+            double textureDecode;
+            // total of the UploadPending calls, whatever the deadlines spread it over
+            double upload;
+        };
+
+        // A texture on its way to the GPU: decoded by Prepare, or by PrepareTextureReload to replace the pixels
+        // of a live texture
+        struct PendingTexture
+        {
+            DecodedImage image;
+            // pre-compressed mip chain, used instead of `image` when it has levels
+            gps::Ktx2File compressed;
+            std::shared_ptr<gps::TextureAsset> texture;
+        };
+
+        // Rereads, on a loader thread, the image (or .ktx2) file at `changedPath` for every live texture it backs.
+        // Returns false when no loaded texture comes from it
+        static bool PrepareTextureReload(std::string changedPath, std::vector<PendingTexture>& reloads);
+        // Replaces the levels of the texture in its layer on the GL thread. A texture whose size or format changed
+        // moves to an array of its own, and the meshes of every loaded model are pointed at it
+        static void UploadTextureReload(PendingTexture& reload);
+
+        // Appends to `meshes` one mesh per material the parsed shapes use, with the corners shared between faces
+        // welded. The allocations do not depend on the number of shapes or vertices, only on the materials
+        static void BuildMeshes(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes,
+                                const std::vector<tinyobj::material_t>& materials, std::string basePath, std::vector<MeshData>& meshes);
+
+        Model3D();
         ~Model3D();
+		// Drops the model's share of its asset, its indirect renderer and any unfinished load. On the GL thread,
+		// before the context is destroyed - the last model to release an asset deletes its buffers and textures
+		void Release();
+
+		// What the meshes keep in system memory after the upload, GEOMETRY_DISCARD by default.
+		// Set before loading - a model sharing an already loaded asset gets what its first loader kept
+		void SetGeometryRetention(GeometryRetention retention);
 
 		void LoadModel(std::string fileName);
 
 		void LoadModel(std::string fileName, std::string basePath);
 
-		void Draw(gps::Shader shaderProgram);
+		// First half of LoadModel: parses the model and decodes its textures without touching GL,
+		// so it can run on a loader thread
+		void Prepare(std::string fileName, std::string basePath);
+
+		// Second half of LoadModel, on the GL thread: uploads what Prepare left until the deadline passes.
+		// With an uploader the data is streamed in small slices, otherwise everything goes in one call.
+		// Returns true once the model is ready to be drawn
+		bool UploadPending(std::chrono::high_resolution_clock::time_point deadline, gps::Uploader* uploader);
+
+		// Parses the .obj file of a loaded model again, on a loader thread, for UploadPending to swap in at
+		// a frame boundary - in place, so every model sharing the asset sees the new version. Meshes that did
+		// not change keep their GL buffers and textures still in use are not decoded again (see hotReload).
+		// Returns false, keeping the loaded version, when the model is not loaded or the file cannot be parsed
+		bool PrepareReload();
+
+		bool IsLoaded();
+
+		const LoadTimings& GetLoadTimings();
+
+		// Draws every mesh at full detail
+		void Draw(const gps::Shader& shaderProgram);
+
+		// Draws every mesh at the level of detail its size on screen calls for, with `model` as the model matrix.
+		// A mesh switches level only once the error is a hysteresis band past the allowance, so it does not flicker.
+		// At full detail, the meshlets outside the cull view or facing away from it are skipped
+		void Draw(const gps::Shader& shaderProgram, const glm::mat4& model);
+
+		// Same as Draw, through a gps::IndirectRenderer: the draws of the meshes sharing their textures are submitted
+		// together. Meant for the static models - the per-draw data is only rebuilt when the asset is reloaded
+		void DrawIndirect(const gps::Shader& shaderProgram, const glm::mat4& model);
+
+		// Meshes of the loaded model, none before
+		size_t GetMeshCount();
+		const gps::Mesh& GetMesh(size_t mesh);
+		// Draws mesh `mesh` the way Draw does - for a gps::RenderQueue, which orders the meshes of every model together
+		void DrawMesh(const gps::Shader& shaderProgram, const glm::mat4& model, size_t mesh);
+
+		// Finest and coarsest level of detail of the last Draw, -1 before the first one
+		void GetDrawnLods(int& finest, int& coarsest);
 
     private:
-		// Component meshes - group of objects
-        std::vector<gps::Mesh> meshes;
-		// Associated textures
-        std::vector<gps::Texture> loadedTextures;
+		// Everything Prepare produced that still has to reach the GPU
+		struct PendingUpload
+		{
+			std::string fileName;
+			std::chrono::high_resolution_clock::time_point start;
+			std::shared_ptr<gps::ModelAsset> asset;
+			// the asset was already loaded by another model
+			bool shared;
+			// loaded asset PrepareReload replaces the contents of, NULL for a first load
+			std::shared_ptr<gps::ModelAsset> reloadTarget;
+			// for each prepared mesh, the mesh of reloadTarget it is identical to, or -1
+			std::vector<int> reusedMeshes;
+			bool cached;
+			gps::MeshCache cache;
+			std::vector<gps::MeshData> meshes;
+			// the .mtl libraries of the parsed .obj file, stamped into its mesh cache
+			std::vector<std::string> materialFiles;
+			std::vector<PendingTexture> textures;
+			size_t nextTexture;
+			size_t nextMesh;
+			// progress inside the current texture / mesh
+			int uploadedLevel;
+			int uploadedRows;
+			GLsizeiptr uploadedBytes;
+		};
+
+		// Component meshes and associated textures - shared with every model loaded from the same file
+        std::shared_ptr<gps::ModelAsset> asset;
+		std::string fileName;
+		std::string basePath;
+		// Only touched by Prepare and UploadPending
+		std::unique_ptr<PendingUpload> pending;
+		// level of detail of each mesh at the last Draw
+		std::vector<int> meshLods;
+		// created by the first DrawIndirect
+		std::unique_ptr<gps::IndirectRenderer> indirect;
+		GeometryRetention geometryRetention;
+		LoadTimings loadTimings;
 
-		// Does the parsing of the .obj file and fills in the data structure
-		void ReadOBJ(std::string fileName, std::string basePath);
+		// Picks the level of detail of each mesh and draws it - or adds its commands to `indirectRenderer`
+		void DrawMeshes(const gps::Shader& shaderProgram, const glm::mat4& model, gps::IndirectRenderer* indirectRenderer);
+		// The same for mesh `i`, with the largest scale of `model` and the cull view in its object space
+		void DrawMeshAt(const gps::Shader& shaderProgram, const glm::mat4& model, float scale, const ClusterView& objectView,
+			size_t i, gps::IndirectRenderer* indirectRenderer);
+
+		// Creates `pending` for a new load of fileName
+		void StartPending();
+		// Rest of Prepare once pending->asset is set: meshes (from the cache when allowed), vertex packing, textures.
+		// Returns false when the .obj file could not be parsed
+		bool PrepareAsset(bool useCache);
+		// Moves the reloaded meshes, and the unchanged ones of the loaded version, into reloadTarget
+		void SwapReload();
+
+		// Takes the meshes from the binary cache of the .obj file, if it is up to date
+		bool ReadCache(std::string fileName);
+
+		// Does the parsing of the .obj file and fills in the data structure.
+		// Returns false when the file (or its .mtl) cannot be read
+		bool ReadOBJ(std::string fileName, std::string basePath);
+
+		// Reorders the meshes parsed from the .obj file, starting at `firstMesh`, and reports the vertex cache gain
+		void OptimizeMeshes(size_t firstMesh);
+
+		// Packs the vertices of the prepared meshes, checking the error against the float ones
+		void QuantizeMeshes();
 
 		// Retrieves a texture associated with the object - by its name and type
 		gps::Texture LoadTexture(std::string path, std::string type);
 
-		// Reads the pixel data from an image file and loads it into the video memory
-		GLuint ReadTextureFromFile(const char* file_name);
+		// Decodes all the given textures at the same time on the worker pool
+		void PrepareTextures(std::vector<std::string> paths);
+		// Gives each prepared texture a layer in a texture array, one array per size, format and mip count
+		void PackTextureArrays();
+
+		void UploadTextureStep(gps::Uploader* uploader);
+		void UploadMeshStep(gps::Uploader* uploader);
+
+		// Creates the storage of every level and layer of the array on the GL thread
+		static void CreateTextureArray(TextureArray& array);
+		// Copies all the levels of a prepared texture into its layer, then frees the pixels
+		static void UploadTextureLayer(PendingTexture& pendingTexture);
     };
 }
 
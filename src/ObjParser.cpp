@@ -0,0 +1,633 @@
+#include "ObjParser.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace gps {
+
+	// The token helpers below follow tiny_obj_loader.h step by step, so the parallel reader
+	// produces bit-identical floats and indices
+
+#define OBJ_IS_SPACE(x) (((x) == ' ') || ((x) == '\t'))
+#define OBJ_IS_DIGIT(x) (static_cast<unsigned int>((x) - '0') < static_cast<unsigned int>(10))
+#define OBJ_IS_NEW_LINE(x) (((x) == '\r') || ((x) == '\n') || ((x) == '\0'))
+#define OBJ_NAME_BUFFER_SIZE (4096)
+
+	static bool tryParseDouble(const char* s, const char* s_end, double* result) {
+		if (s >= s_end) {
+			return false;
+		}
+
+		double mantissa = 0.0;
+		int exponent = 0;
+		char sign = '+';
+		char exp_sign = '+';
+		char const* curr = s;
+		int read = 0;
+		bool end_not_reached = false;
+
+		if (*curr == '+' || *curr == '-') {
+			sign = *curr;
+			curr++;
+		}
+		else if (OBJ_IS_DIGIT(*curr)) {
+		}
+		else {
+			goto fail;
+		}
+
+		// integer part
+		end_not_reached = (curr != s_end);
+		while (end_not_reached && OBJ_IS_DIGIT(*curr)) {
+			mantissa *= 10;
+			mantissa += static_cast<int>(*curr - 0x30);
+			curr++;
+			read++;
+			end_not_reached = (curr != s_end);
+		}
+
+		if (read == 0) goto fail;
+		if (!end_not_reached) goto assemble;
+
+		// decimal part
+		if (*curr == '.') {
+			curr++;
+			read = 1;
+			end_not_reached = (curr != s_end);
+			while (end_not_reached && OBJ_IS_DIGIT(*curr)) {
+				static const double pow_lut[] = {
+					1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001,
+				};
+				const int lut_entries = sizeof pow_lut / sizeof pow_lut[0];
+
+				mantissa += static_cast<int>(*curr - 0x30) *
+					(read < lut_entries ? pow_lut[read] : pow(10.0, -read));
+				read++;
+				curr++;
+				end_not_reached = (curr != s_end);
+			}
+		}
+		else if (*curr == 'e' || *curr == 'E') {
+		}
+		else {
+			goto assemble;
+		}
+
+		if (!end_not_reached) goto assemble;
+
+		// exponent part
+		if (*curr == 'e' || *curr == 'E') {
+			curr++;
+			end_not_reached = (curr != s_end);
+			if (end_not_reached && (*curr == '+' || *curr == '-')) {
+				exp_sign = *curr;
+				curr++;
+			}
+			else if (OBJ_IS_DIGIT(*curr)) {
+			}
+			else {
+				goto fail;
+			}
+
+			read = 0;
+			end_not_reached = (curr != s_end);
+			while (end_not_reached && OBJ_IS_DIGIT(*curr)) {
+				exponent *= 10;
+				exponent += static_cast<int>(*curr - 0x30);
+				curr++;
+				read++;
+				end_not_reached = (curr != s_end);
+			}
+			exponent *= (exp_sign == '+' ? 1 : -1);
+			if (read == 0) goto fail;
+		}
+
+	assemble:
+		*result = (sign == '+' ? 1 : -1) *
+			(exponent ? ldexp(mantissa * pow(5.0, exponent), exponent) : mantissa);
+		return true;
+	fail:
+		return false;
+	}
+
+	static inline float parseFloat(const char** token, double default_value = 0.0) {
+		(*token) += strspn((*token), " \t");
+		const char* end = (*token) + strcspn((*token), " \t\r");
+		double val = default_value;
+		tryParseDouble((*token), end, &val);
+		float f = static_cast<float>(val);
+		(*token) = end;
+		return f;
+	}
+
+	static inline std::string parseString(const char** token) {
+		std::string s;
+		(*token) += strspn((*token), " \t");
+		size_t e = strcspn((*token), " \t\r");
+		s = std::string((*token), &(*token)[e]);
+		(*token) += e;
+		return s;
+	}
+
+	// Corner of a face - components are -1 when not present in the .obj
+	struct ObjCorner
+	{
+		int v;
+		int vt;
+		int vn;
+	};
+
+	// A negative (relative) .obj index can only be resolved once the chunk's global offset is known
+	struct ObjFixup
+	{
+		size_t corner;
+		int component;
+	};
+
+	enum ObjCommandType { OBJ_FACES, OBJ_USEMTL, OBJ_MTLLIB, OBJ_GROUP, OBJ_OBJECT, OBJ_TAG };
+
+	// Everything except vertex data is kept as an ordered list of commands, so it can be replayed in file order
+	struct ObjCommand
+	{
+		ObjCommandType type;
+		// OBJ_FACES: run of consecutive faces in the chunk
+		size_t firstFace;
+		size_t faceCount;
+		size_t firstCorner;
+		// OBJ_USEMTL, OBJ_MTLLIB, OBJ_GROUP, OBJ_OBJECT
+		std::string name;
+		// OBJ_TAG
+		tinyobj::tag_t tag;
+	};
+
+	struct ObjChunk
+	{
+		char* begin;
+		char* end;
+
+		std::vector<float> v;
+		std::vector<float> vn;
+		std::vector<float> vt;
+		std::vector<ObjCorner> corners;
+		std::vector<unsigned int> faceSizes;
+		std::vector<ObjCommand> commands;
+		std::vector<ObjFixup> fixups;
+	};
+
+	// Same as tinyobj's fixIndex, except relative indices stay relative to the chunk
+	static inline int fixChunkIndex(int idx, int n, ObjChunk& chunk, int component) {
+		if (idx > 0) return idx - 1;
+		if (idx == 0) return 0;
+		ObjFixup fixup = { chunk.corners.size(), component };
+		chunk.fixups.push_back(fixup);
+		return n + idx;
+	}
+
+	// Parse triples: i, i/j/k, i//k, i/j
+	static ObjCorner parseTriple(const char** token, int vsize, int vnsize, int vtsize, ObjChunk& chunk) {
+		ObjCorner vi = { -1, -1, -1 };
+
+		vi.v = fixChunkIndex(atoi((*token)), vsize, chunk, 0);
+		(*token) += strcspn((*token), "/ \t\r");
+		if ((*token)[0] != '/') {
+			return vi;
+		}
+		(*token)++;
+
+		// i//k
+		if ((*token)[0] == '/') {
+			(*token)++;
+			vi.vn = fixChunkIndex(atoi((*token)), vnsize, chunk, 2);
+			(*token) += strcspn((*token), "/ \t\r");
+			return vi;
+		}
+
+		// i/j/k or i/j
+		vi.vt = fixChunkIndex(atoi((*token)), vtsize, chunk, 1);
+		(*token) += strcspn((*token), "/ \t\r");
+		if ((*token)[0] != '/') {
+			return vi;
+		}
+
+		// i/j/k
+		(*token)++;
+		vi.vn = fixChunkIndex(atoi((*token)), vnsize, chunk, 2);
+		(*token) += strcspn((*token), "/ \t\r");
+		return vi;
+	}
+
+	static tinyobj::tag_t parseTag(const char* token) {
+		tinyobj::tag_t tag;
+
+		char namebuf[OBJ_NAME_BUFFER_SIZE];
+		token += 2;
+		sscanf(token, "%s", namebuf);
+		tag.name = std::string(namebuf);
+
+		token += tag.name.size() + 1;
+
+		int num_ints = atoi(token);
+		int num_floats = 0;
+		int num_strings = 0;
+		token += strcspn(token, "/ \t\r");
+		if (token[0] == '/') {
+			token++;
+			num_floats = atoi(token);
+			token += strcspn(token, "/ \t\r");
+			if (token[0] == '/') {
+				token++;
+				num_strings = atoi(token);
+				token += strcspn(token, "/ \t\r") + 1;
+			}
+		}
+
+		tag.intValues.resize(static_cast<size_t>(num_ints));
+		for (size_t i = 0; i < static_cast<size_t>(num_ints); ++i) {
+			tag.intValues[i] = atoi(token);
+			token += strcspn(token, "/ \t\r") + 1;
+		}
+
+		tag.floatValues.resize(static_cast<size_t>(num_floats));
+		for (size_t i = 0; i < static_cast<size_t>(num_floats); ++i) {
+			tag.floatValues[i] = parseFloat(&token);
+			token += strcspn(token, "/ \t\r") + 1;
+		}
+
+		tag.stringValues.resize(static_cast<size_t>(num_strings));
+		for (size_t i = 0; i < static_cast<size_t>(num_strings); ++i) {
+			char stringValueBuffer[OBJ_NAME_BUFFER_SIZE];
+			sscanf(token, "%s", stringValueBuffer);
+			tag.stringValues[i] = stringValueBuffer;
+			token += tag.stringValues[i].size() + 1;
+		}
+
+		return tag;
+	}
+
+	static void addCommand(ObjChunk& chunk, ObjCommandType type, std::string name) {
+		ObjCommand command;
+		command.type = type;
+		command.firstFace = 0;
+		command.faceCount = 0;
+		command.firstCorner = 0;
+		command.name = name;
+		chunk.commands.push_back(command);
+	}
+
+	// Parses the lines of one chunk - runs on a worker thread
+	static void parseChunk(ObjChunk& chunk) {
+		// turn every line into a C string, like tinyobj's getline does
+		for (char* c = chunk.begin; c < chunk.end; c++) {
+			if (*c == '\n' || *c == '\r') {
+				*c = '\0';
+			}
+		}
+
+		char* line = chunk.begin;
+		while (line < chunk.end) {
+			size_t length = strlen(line);
+			const char* token = line;
+			line += length + 1;
+
+			token += strspn(token, " \t");
+			if (token[0] == '\0') continue;
+			if (token[0] == '#') continue;
+
+			// vertex
+			if (token[0] == 'v' && OBJ_IS_SPACE((token[1]))) {
+				token += 2;
+				chunk.v.push_back(parseFloat(&token));
+				chunk.v.push_back(parseFloat(&token));
+				chunk.v.push_back(parseFloat(&token));
+				continue;
+			}
+
+			// normal
+			if (token[0] == 'v' && token[1] == 'n' && OBJ_IS_SPACE((token[2]))) {
+				token += 3;
+				chunk.vn.push_back(parseFloat(&token));
+				chunk.vn.push_back(parseFloat(&token));
+				chunk.vn.push_back(parseFloat(&token));
+				continue;
+			}
+
+			// texcoord
+			if (token[0] == 'v' && token[1] == 't' && OBJ_IS_SPACE((token[2]))) {
+				token += 3;
+				chunk.vt.push_back(parseFloat(&token));
+				chunk.vt.push_back(parseFloat(&token));
+				continue;
+			}
+
+			// face
+			if (token[0] == 'f' && OBJ_IS_SPACE((token[1]))) {
+				token += 2;
+				token += strspn(token, " \t");
+
+				if (chunk.commands.empty() || chunk.commands.back().type != OBJ_FACES) {
+					ObjCommand command;
+					command.type = OBJ_FACES;
+					command.firstFace = chunk.faceSizes.size();
+					command.faceCount = 0;
+					command.firstCorner = chunk.corners.size();
+					chunk.commands.push_back(command);
+				}
+
+				size_t firstCorner = chunk.corners.size();
+				while (!OBJ_IS_NEW_LINE(token[0])) {
+					ObjCorner vi = parseTriple(&token, static_cast<int>(chunk.v.size() / 3),
+						static_cast<int>(chunk.vn.size() / 3),
+						static_cast<int>(chunk.vt.size() / 2), chunk);
+					chunk.corners.push_back(vi);
+					token += strspn(token, " \t\r");
+				}
+
+				chunk.faceSizes.push_back(static_cast<unsigned int>(chunk.corners.size() - firstCorner));
+				chunk.commands.back().faceCount++;
+				continue;
+			}
+
+			// use mtl
+			if ((0 == strncmp(token, "usemtl", 6)) && OBJ_IS_SPACE((token[6]))) {
+				char namebuf[OBJ_NAME_BUFFER_SIZE];
+				token += 7;
+				sscanf(token, "%s", namebuf);
+				addCommand(chunk, OBJ_USEMTL, namebuf);
+				continue;
+			}
+
+			// load mtl
+			if ((0 == strncmp(token, "mtllib", 6)) && OBJ_IS_SPACE((token[6]))) {
+				char namebuf[OBJ_NAME_BUFFER_SIZE];
+				token += 7;
+				sscanf(token, "%s", namebuf);
+				addCommand(chunk, OBJ_MTLLIB, namebuf);
+				continue;
+			}
+
+			// group name
+			if (token[0] == 'g' && OBJ_IS_SPACE((token[1]))) {
+				std::vector<std::string> names;
+				while (!OBJ_IS_NEW_LINE(token[0])) {
+					std::string str = parseString(&token);
+					names.push_back(str);
+					token += strspn(token, " \t\r");
+				}
+
+				// names[0] is 'g'
+				addCommand(chunk, OBJ_GROUP, names.size() > 1 ? names[1] : "");
+				continue;
+			}
+
+			// object name
+			if (token[0] == 'o' && OBJ_IS_SPACE((token[1]))) {
+				char namebuf[OBJ_NAME_BUFFER_SIZE];
+				token += 2;
+				sscanf(token, "%s", namebuf);
+				addCommand(chunk, OBJ_OBJECT, namebuf);
+				continue;
+			}
+
+			// tag
+			if (token[0] == 't' && OBJ_IS_SPACE(token[1])) {
+				addCommand(chunk, OBJ_TAG, "");
+				chunk.commands.back().tag = parseTag(token);
+			}
+
+			// Ignore unknown command.
+		}
+	}
+
+	// Faces waiting to be exported to the current shape
+	struct ObjFaceRun
+	{
+		const ObjChunk* chunk;
+		size_t firstFace;
+		size_t faceCount;
+		size_t firstCorner;
+	};
+
+	static void pushIndex(tinyobj::shape_t* shape, const ObjCorner& corner) {
+		tinyobj::index_t idx;
+		idx.vertex_index = corner.v;
+		idx.normal_index = corner.vn;
+		idx.texcoord_index = corner.vt;
+		shape->mesh.indices.push_back(idx);
+	}
+
+	// Same as tinyobj's exportFaceGroupToShape
+	static bool exportFaceGroupToShape(tinyobj::shape_t* shape, const std::vector<ObjFaceRun>& faceGroup,
+		const std::vector<tinyobj::tag_t>& tags, const int material_id,
+		const std::string& name, bool triangulate) {
+		if (faceGroup.empty()) {
+			return false;
+		}
+
+		for (size_t r = 0; r < faceGroup.size(); r++) {
+			const ObjFaceRun& run = faceGroup[r];
+			const ObjCorner* face = &run.chunk->corners[run.firstCorner];
+
+			for (size_t f = 0; f < run.faceCount; f++) {
+				size_t npolys = run.chunk->faceSizes[run.firstFace + f];
+
+				if (triangulate) {
+					// Polygon -> triangle fan conversion
+					for (size_t k = 2; k < npolys; k++) {
+						pushIndex(shape, face[0]);
+						pushIndex(shape, face[k - 1]);
+						pushIndex(shape, face[k]);
+
+						shape->mesh.num_face_vertices.push_back(3);
+						shape->mesh.material_ids.push_back(material_id);
+					}
+				}
+				else {
+					for (size_t k = 0; k < npolys; k++) {
+						pushIndex(shape, face[k]);
+					}
+
+					shape->mesh.num_face_vertices.push_back(static_cast<unsigned char>(npolys));
+					shape->mesh.material_ids.push_back(material_id);
+				}
+
+				face += npolys;
+			}
+		}
+
+		shape->name = name;
+		shape->mesh.tags = tags;
+
+		return true;
+	}
+
+	bool ObjParser::LoadObj(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+		std::vector<tinyobj::material_t>* materials, std::string* err,
+		const char* filename, const char* mtl_basepath, bool triangulate,
+		ThreadPool& pool, std::vector<std::string>* materialFiles) {
+		attrib->vertices.clear();
+		attrib->normals.clear();
+		attrib->texcoords.clear();
+		shapes->clear();
+
+		std::ifstream ifs(filename, std::ios::binary);
+		if (!ifs) {
+			std::stringstream errss;
+			errss << "Cannot open file [" << filename << "]" << std::endl;
+			if (err) {
+				(*err) = errss.str();
+			}
+			return false;
+		}
+
+		ifs.seekg(0, std::ios::end);
+		size_t fileSize = (size_t)ifs.tellg();
+		ifs.seekg(0, std::ios::beg);
+
+		// extra terminator so the last line is a C string even without a trailing newline
+		std::vector<char> text(fileSize + 1, '\0');
+		ifs.read(text.data(), fileSize);
+		ifs.close();
+
+		// split into line-aligned chunks, a few per thread for load balancing
+		size_t chunkCount = pool.GetThreadCount() * 4;
+		if (chunkCount > fileSize / MIN_CHUNK_SIZE) {
+			chunkCount = fileSize / MIN_CHUNK_SIZE;
+		}
+		if (chunkCount == 0) {
+			chunkCount = 1;
+		}
+
+		std::vector<ObjChunk> chunks(chunkCount);
+		char* begin = text.data();
+		char* fileEnd = text.data() + fileSize;
+		for (size_t c = 0; c < chunkCount; c++) {
+			char* end = (c + 1 == chunkCount) ? fileEnd : text.data() + fileSize * (c + 1) / chunkCount;
+			if (end < begin) {
+				end = begin;
+			}
+			while (end < fileEnd && end[-1] != '\n' && end[-1] != '\r') {
+				end++;
+			}
+			chunks[c].begin = begin;
+			chunks[c].end = end;
+			begin = end;
+		}
+
+		std::vector<std::future<void> > parsed;
+		for (size_t c = 0; c < chunkCount; c++) {
+			ObjChunk* chunk = &chunks[c];
+			parsed.push_back(pool.Enqueue([chunk] { parseChunk(*chunk); }));
+		}
+		for (size_t c = 0; c < parsed.size(); c++) {
+			parsed[c].get();
+		}
+
+		// resolve relative indices now that each chunk's position in the file is known
+		size_t vOffset = 0, vtOffset = 0, vnOffset = 0;
+		for (size_t c = 0; c < chunkCount; c++) {
+			ObjChunk& chunk = chunks[c];
+			for (size_t i = 0; i < chunk.fixups.size(); i++) {
+				ObjCorner& corner = chunk.corners[chunk.fixups[i].corner];
+				if (chunk.fixups[i].component == 0) corner.v += (int)vOffset;
+				if (chunk.fixups[i].component == 1) corner.vt += (int)vtOffset;
+				if (chunk.fixups[i].component == 2) corner.vn += (int)vnOffset;
+			}
+			vOffset += chunk.v.size() / 3;
+			vtOffset += chunk.vt.size() / 2;
+			vnOffset += chunk.vn.size() / 3;
+		}
+
+		attrib->vertices.reserve(vOffset * 3);
+		attrib->texcoords.reserve(vtOffset * 2);
+		attrib->normals.reserve(vnOffset * 3);
+		for (size_t c = 0; c < chunkCount; c++) {
+			attrib->vertices.insert(attrib->vertices.end(), chunks[c].v.begin(), chunks[c].v.end());
+			attrib->texcoords.insert(attrib->texcoords.end(), chunks[c].vt.begin(), chunks[c].vt.end());
+			attrib->normals.insert(attrib->normals.end(), chunks[c].vn.begin(), chunks[c].vn.end());
+		}
+
+		// replay the records in file order, exactly like tinyobj's main loop
+		std::string basePath;
+		if (mtl_basepath) {
+			basePath = mtl_basepath;
+		}
+		tinyobj::MaterialFileReader readMatFn(basePath);
+
+		std::vector<tinyobj::tag_t> tags;
+		std::vector<ObjFaceRun> faceGroup;
+		std::string name;
+		std::map<std::string, int> material_map;
+		int material = -1;
+		tinyobj::shape_t shape;
+
+		for (size_t c = 0; c < chunkCount; c++) {
+			const ObjChunk& chunk = chunks[c];
+			for (size_t i = 0; i < chunk.commands.size(); i++) {
+				const ObjCommand& command = chunk.commands[i];
+
+				switch (command.type) {
+				case OBJ_FACES: {
+					ObjFaceRun run = { &chunk, command.firstFace, command.faceCount, command.firstCorner };
+					faceGroup.push_back(run);
+					break;
+				}
+				case OBJ_USEMTL: {
+					int newMaterialId = -1;
+					if (material_map.find(command.name) != material_map.end()) {
+						newMaterialId = material_map[command.name];
+					}
+
+					if (newMaterialId != material) {
+						exportFaceGroupToShape(&shape, faceGroup, tags, material, name, triangulate);
+						faceGroup.clear();
+						material = newMaterialId;
+					}
+					break;
+				}
+				case OBJ_MTLLIB: {
+					if (materialFiles) {
+						materialFiles->push_back(basePath + command.name);
+					}
+					std::string err_mtl;
+					bool ok = readMatFn(command.name, materials, &material_map, &err_mtl);
+					if (err) {
+						(*err) += err_mtl;
+					}
+
+					if (!ok) {
+						return false;
+					}
+					break;
+				}
+				case OBJ_GROUP:
+				case OBJ_OBJECT: {
+					bool ret = exportFaceGroupToShape(&shape, faceGroup, tags, material, name, triangulate);
+					if (ret) {
+						shapes->push_back(shape);
+					}
+
+					shape = tinyobj::shape_t();
+					faceGroup.clear();
+					name = command.name;
+					break;
+				}
+				case OBJ_TAG:
+					tags.push_back(command.tag);
+					break;
+				}
+			}
+		}
+
+		bool ret = exportFaceGroupToShape(&shape, faceGroup, tags, material, name, triangulate);
+		if (ret || shape.mesh.indices.size()) {
+			shapes->push_back(shape);
+		}
+
+		return true;
+	}
+}
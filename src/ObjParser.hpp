@@ -0,0 +1,30 @@
+#ifndef ObjParser_hpp
+#define ObjParser_hpp
+
+#include "ThreadPool.hpp"
+#include "tiny_obj_loader.h"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+// Multi-threaded .obj reader producing the same attrib/shape/material data as tinyobj::LoadObj.
+// The file is split into line-aligned chunks which are parsed on a thread pool; the per-chunk
+// records are then replayed in file order through the same state machine tinyobj uses
+class ObjParser
+{
+public:
+    // `materialFiles`, when given, receives the path of every material library the file names (mtl_basepath + mtllib)
+    static bool LoadObj(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+                        std::vector<tinyobj::material_t>* materials, std::string* err,
+                        const char* filename, const char* mtl_basepath, bool triangulate,
+                        ThreadPool& pool, std::vector<std::string>* materialFiles = NULL);
+
+    // Chunks smaller than this are not worth handing to another thread
+    static const size_t MIN_CHUNK_SIZE = 256 * 1024;
+};
+
+}
+
+#endif /* ObjParser_hpp */
@@ -0,0 +1,190 @@
+#include "RenderQueue.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace gps {
+
+	static const int PASS_SHIFT = 60;
+	static const int PROGRAM_SHIFT = 52;
+	static const int MATERIAL_SHIFT = 32;
+	static const uint64_t PROGRAM_MASK = 0xFF;
+	static const uint64_t MATERIAL_MASK = 0xFFFFF;
+
+	static RenderQueue::Stats stats = {};
+
+	const RenderQueue::Stats& RenderQueue::GetStats()
+	{
+		return stats;
+	}
+
+	void RenderQueue::ResetStats()
+	{
+		stats = Stats();
+	}
+
+	// the bits of `distance` as an unsigned number in the same order, negative distances included
+	static uint64_t distanceBits(float distance)
+	{
+		uint32_t bits;
+		memcpy(&bits, &distance, sizeof(bits));
+		return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+	}
+
+	// distance of the nearest point of a bounding sphere to the eye - along the viewing direction when eye.w is 0
+	static float distanceTo(const glm::vec4& eye, const glm::vec3& center, float radius)
+	{
+		float distance = eye.w == 0.0f ? glm::dot(glm::vec3(eye), center) : glm::length(center - glm::vec3(eye));
+		return distance - radius;
+	}
+
+	void RenderQueue::Clear()
+	{
+		items.clear();
+		entries.clear();
+	}
+
+	void RenderQueue::Add(Pass pass, const gps::Shader& shader, gps::Model3D& model, size_t object, const glm::mat4& transform,
+		const glm::vec4& eye, bool indirect)
+	{
+		size_t meshCount = model.GetMeshCount();
+		if (meshCount == 0) {
+			return;
+		}
+
+		// largest scale of the transform, for the bounding spheres
+		float scale = std::sqrt(std::max(glm::dot(glm::vec3(transform[0]), glm::vec3(transform[0])),
+			std::max(glm::dot(glm::vec3(transform[1]), glm::vec3(transform[1])), glm::dot(glm::vec3(transform[2]), glm::vec3(transform[2])))));
+		uint64_t prefix = ((uint64_t)pass << PASS_SHIFT) | (ProgramNumber(shader.shaderProgram) << PROGRAM_SHIFT);
+
+		Item item;
+		item.shader = &shader;
+		item.model = &model;
+		item.object = object;
+		item.transform = transform;
+
+		if (indirect) {
+			// the batches of the model are drawn together - sorted by its first material and nearest mesh
+			float nearest = INFINITY;
+			for (size_t i = 0; i < meshCount; i++) {
+				const gps::Mesh& mesh = model.GetMesh(i);
+				glm::vec3 center = glm::vec3(transform * glm::vec4(mesh.boundsCenter, 1.0f));
+				nearest = std::min(nearest, distanceTo(eye, center, mesh.boundsRadius * scale));
+			}
+			item.mesh = WHOLE_MODEL;
+			SortEntry entry = { prefix | (MaterialNumber(model.GetMesh(0)) << MATERIAL_SHIFT) | distanceBits(nearest),
+				(uint32_t)items.size() };
+			entries.push_back(entry);
+			items.push_back(item);
+			return;
+		}
+
+		for (size_t i = 0; i < meshCount; i++) {
+			const gps::Mesh& mesh = model.GetMesh(i);
+			glm::vec3 center = glm::vec3(transform * glm::vec4(mesh.boundsCenter, 1.0f));
+			item.mesh = i;
+			SortEntry entry = { prefix | (MaterialNumber(mesh) << MATERIAL_SHIFT) |
+				distanceBits(distanceTo(eye, center, mesh.boundsRadius * scale)), (uint32_t)items.size() };
+			entries.push_back(entry);
+			items.push_back(item);
+		}
+	}
+
+	// Least significant byte first, each pass a stable counting sort into the other buffer
+	void RenderQueue::Sort()
+	{
+		if (entries.size() < 2) {
+			return;
+		}
+		sortScratch.resize(entries.size());
+		for (int shift = 0; shift < 64; shift += 8) {
+			size_t offsets[256] = {};
+			for (size_t i = 0; i < entries.size(); i++) {
+				offsets[(entries[i].key >> shift) & 0xFF]++;
+			}
+			// every key has the same byte there - nothing to reorder
+			if (offsets[(entries[0].key >> shift) & 0xFF] == entries.size()) {
+				continue;
+			}
+			size_t offset = 0;
+			for (int digit = 0; digit < 256; digit++) {
+				size_t count = offsets[digit];
+				offsets[digit] = offset;
+				offset += count;
+			}
+			for (size_t i = 0; i < entries.size(); i++) {
+				sortScratch[offsets[(entries[i].key >> shift) & 0xFF]++] = entries[i];
+			}
+			entries.swap(sortScratch);
+		}
+	}
+
+	void RenderQueue::Submit(Pass pass, gps::UniformBuffers& uniforms)
+	{
+		const uint64_t noKey = ~(uint64_t)0;
+		uint64_t lastProgram = noKey;
+		uint64_t lastMaterial = noKey;
+		size_t lastObject = ~(size_t)0;
+		for (size_t e = 0; e < entries.size(); e++) {
+			uint64_t key = entries[e].key;
+			if ((key >> PASS_SHIFT) != (uint64_t)pass) {
+				continue;
+			}
+			const Item& item = items[entries[e].item];
+
+			uint64_t program = (key >> PROGRAM_SHIFT) & PROGRAM_MASK;
+			uint64_t material = (key >> MATERIAL_SHIFT) & MATERIAL_MASK;
+			stats.items++;
+			stats.programChanges += program != lastProgram;
+			stats.materialChanges += material != lastMaterial;
+			lastProgram = program;
+			lastMaterial = material;
+			if (item.object != lastObject) {
+				uniforms.BindObject(item.object);
+				lastObject = item.object;
+				stats.objectChanges++;
+			}
+
+			if (item.mesh == WHOLE_MODEL) {
+				item.model->DrawIndirect(*item.shader, item.transform);
+			}
+			else {
+				item.model->DrawMesh(*item.shader, item.transform, item.mesh);
+			}
+		}
+	}
+
+	uint64_t RenderQueue::ProgramNumber(GLuint program)
+	{
+		std::vector<GLuint>::iterator found = std::find(programs.begin(), programs.end(), program);
+		if (found == programs.end()) {
+			programs.push_back(program);
+			found = programs.end() - 1;
+		}
+		return std::min((uint64_t)(found - programs.begin()), PROGRAM_MASK);
+	}
+
+	uint64_t RenderQueue::MaterialNumber(const gps::Mesh& mesh)
+	{
+		Material material;
+		material.packed = mesh.getAllocation().packed;
+		memset(material.arrays, 0, sizeof(material.arrays));
+		for (size_t t = 0; t < mesh.textures.size(); t++) {
+			int unit = Mesh::GetTextureUnit(mesh.textures[t].type);
+			if (unit >= 0) {
+				material.arrays[unit] = mesh.textures[t].id;
+			}
+		}
+
+		size_t number = 0;
+		while (number < materials.size() && (materials[number].packed != material.packed ||
+			memcmp(materials[number].arrays, material.arrays, sizeof(material.arrays)) != 0)) {
+			number++;
+		}
+		if (number == materials.size()) {
+			materials.push_back(material);
+		}
+		return std::min((uint64_t)number, MATERIAL_MASK);
+	}
+}
@@ -0,0 +1,96 @@
+#ifndef RenderQueue_hpp
+#define RenderQueue_hpp
+
+#include <GL/glew.h>
+#include "glm.hpp"
+
+#include "Model3D.hpp"
+#include "Shader.hpp"
+#include "UniformBuffers.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+// Draws of a frame, sorted by a 64-bit key before they are submitted. From the most significant bits:
+// pass (4), program (8), material (20) - the texture arrays and vertex format of the mesh - and the distance
+// from the eye (32), so the items sharing a program and material go front to back for early depth rejection
+class RenderQueue
+{
+public:
+    enum Pass
+    {
+        SHADOW_PASS,
+        OPAQUE_PASS
+    };
+
+    // State changes of the submitted items, against the item before them
+    struct Stats
+    {
+        size_t items;
+        size_t programChanges;
+        size_t materialChanges;
+        size_t objectChanges;
+    };
+    static const Stats& GetStats();
+    static void ResetStats();
+
+    // Drops the items of the last frame
+    void Clear();
+
+    // Adds `model`, drawn by `shader` with `transform` and the ObjectBlock of `object`, to `pass`: one item per
+    // mesh, or one for the whole model through DrawIndirect when `indirect`. `eye` is the eye position (w = 1)
+    // or the viewing direction (w = 0) the distances are taken from, as for Model3D::SetCullView
+    void Add(Pass pass, const gps::Shader& shader, gps::Model3D& model, size_t object, const glm::mat4& transform,
+             const glm::vec4& eye, bool indirect);
+
+    // Radix sorts the items by key
+    void Sort();
+
+    // Draws the items of `pass`, in key order once sorted
+    void Submit(Pass pass, gps::UniformBuffers& uniforms);
+
+private:
+    // all the meshes of the model, through DrawIndirect
+    static const size_t WHOLE_MODEL = ~(size_t)0;
+
+    struct Item
+    {
+        const gps::Shader* shader;
+        gps::Model3D* model;
+        size_t mesh;
+        size_t object;
+        glm::mat4 transform;
+    };
+
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t item;
+    };
+
+    // What a material number stands for
+    struct Material
+    {
+        bool packed;
+        GLuint arrays[3];
+    };
+
+    std::vector<Item> items;
+    // keys with the index of their item, sorted by Sort - sortScratch is the other buffer of the radix passes
+    std::vector<SortEntry> entries;
+    std::vector<SortEntry> sortScratch;
+
+    // numbers of the programs and materials seen so far, kept from frame to frame
+    std::vector<GLuint> programs;
+    std::vector<Material> materials;
+
+    uint64_t ProgramNumber(GLuint program);
+    uint64_t MaterialNumber(const gps::Mesh& mesh);
+};
+
+}
+
+#endif /* RenderQueue_hpp */
@@ -0,0 +1,313 @@
+#include "SceneLoader.hpp"
+
+#include <cctype>
+#include <iostream>
+
+namespace gps {
+
+	// quiet time after the last write before reloading, so a file saved in several steps is read once, complete
+	static const double RELOAD_SETTLE_MILLISECONDS = 200.0;
+
+	// Lower case extension of `path` with its dot, empty when it has none
+	static std::string extensionOf(const std::string& path) {
+		size_t dot = path.find_last_of('.');
+		size_t slash = path.find_last_of('/');
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+			return "";
+		}
+		std::string extension = path.substr(dot);
+		for (size_t i = 0; i < extension.size(); i++) {
+			extension[i] = (char)tolower((unsigned char)extension[i]);
+		}
+		return extension;
+	}
+
+	static std::string directoryOf(const std::string& path) {
+		size_t slash = path.find_last_of('/');
+		return slash == std::string::npos ? "" : path.substr(0, slash);
+	}
+
+	static bool isTextureFile(const std::string& extension) {
+		return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".tga" ||
+			extension == ".bmp" || extension == ".ppm" || extension == ".ktx2";
+	}
+
+	SceneLoader::SceneLoader() : preparedCount(0), uploadedCount(0), cancelled(false), uploadBudgetMilliseconds(0.0),
+		worstFrameMilliseconds(0.0), reloading(false), reloadPrepared(false), reloadedCount(0)
+	{
+	}
+
+	SceneLoader::~SceneLoader()
+	{
+		Stop();
+	}
+
+	void SceneLoader::Stop()
+	{
+		cancelled = true;
+		if (thread.joinable()) {
+			thread.join();
+		}
+		if (reloadThread.joinable()) {
+			reloadThread.join();
+		}
+		watcher.reset();
+		uploader.reset();
+		// a reload that was never swapped in - its textures may be the last holders of texture arrays
+		for (size_t i = 0; i < reloadTextures.size(); i++) {
+			TextureDecoder::Free(reloadTextures[i].image);
+		}
+		reloadTextures.clear();
+		reloadModels.clear();
+	}
+
+	void SceneLoader::AddSkyBox(gps::SkyBox* skyBox, std::vector<const GLchar*> faces)
+	{
+		Item item;
+		item.model = NULL;
+		item.skyBox = skyBox;
+		item.faces = faces;
+		items.push_back(item);
+	}
+
+	void SceneLoader::AddModel(gps::Model3D* model, std::string fileName)
+	{
+		Item item;
+		item.model = model;
+		item.skyBox = NULL;
+		item.fileName = fileName;
+		items.push_back(item);
+	}
+
+	void SceneLoader::LoadAll()
+	{
+		for (size_t i = 0; i < items.size(); i++) {
+			Prepare(items[i]);
+			Upload(items[i], std::chrono::high_resolution_clock::time_point::max());
+		}
+		preparedCount = uploadedCount = items.size();
+	}
+
+	void SceneLoader::Start(double uploadBudgetMilliseconds)
+	{
+		this->uploadBudgetMilliseconds = uploadBudgetMilliseconds;
+		this->start = std::chrono::high_resolution_clock::now();
+		this->lastUpdate = start;
+		this->uploader.reset(new gps::Uploader());
+
+		thread = std::thread(&SceneLoader::PrepareAll, this);
+	}
+
+	void SceneLoader::PrepareAll()
+	{
+		for (size_t i = 0; i < items.size() && !cancelled; i++) {
+			Prepare(items[i]);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			preparedCount = i + 1;
+		}
+	}
+
+	bool SceneLoader::Update()
+	{
+		if (cancelled) {
+			return IsDone();
+		}
+		if (IsDone()) {
+			UpdateReloads();
+			return true;
+		}
+
+		std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+		std::chrono::duration<double, std::milli> frame = now - lastUpdate;
+		if (frame.count() > worstFrameMilliseconds) {
+			worstFrameMilliseconds = frame.count();
+		}
+		lastUpdate = now;
+
+		size_t prepared;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			prepared = preparedCount;
+		}
+
+		// items are uploaded in order, so whatever was added first shows up first
+		std::chrono::high_resolution_clock::time_point deadline =
+			now + std::chrono::microseconds((long long)(uploadBudgetMilliseconds * 1000.0));
+		while (uploadedCount < prepared && std::chrono::high_resolution_clock::now() < deadline) {
+			if (Upload(items[uploadedCount], deadline)) {
+				uploadedCount++;
+			}
+		}
+
+		if (IsDone()) {
+			thread.join();
+			// hot reload streams through it too
+			if (!watcher) {
+				uploader.reset();
+			}
+
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+			std::cout << "Scene loaded in " << elapsed.count() << " ms (upload budget " << uploadBudgetMilliseconds
+				<< " ms/frame), worst frame during load " << worstFrameMilliseconds << " ms" << std::endl;
+			return true;
+		}
+		return false;
+	}
+
+	void SceneLoader::WatchForChanges(std::string directory)
+	{
+		Model3D::hotReload = true;
+		watcher.reset(new gps::FileWatcher());
+		if (!watcher->Watch(directory)) {
+			std::cerr << "WARNING: cannot watch " << directory << " for changes, hot reload is off" << std::endl;
+			watcher.reset();
+			return;
+		}
+		std::cout << "Watching " << directory << " for changes" << std::endl;
+	}
+
+	void SceneLoader::UpdateReloads()
+	{
+		if (!watcher) {
+			return;
+		}
+
+		std::vector<std::string> written;
+		watcher->Poll(written);
+		for (size_t i = 0; i < written.size(); i++) {
+			std::string extension = extensionOf(written[i]);
+			// the mesh caches written by the reloads, editor backups...
+			if (extension == ".obj" || extension == ".mtl" || isTextureFile(extension)) {
+				changedPaths.insert(AssetManager::CanonicalPath(written[i]));
+				lastChange = std::chrono::high_resolution_clock::now();
+			}
+		}
+
+		if (reloading) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!reloadPrepared) {
+					return;
+				}
+			}
+			if (reloadThread.joinable()) {
+				reloadThread.join();
+			}
+
+			// the textures keep their names, so they are replaced all at once; the models stream within the budget
+			for (size_t i = 0; i < reloadTextures.size(); i++) {
+				Model3D::UploadTextureReload(reloadTextures[i]);
+			}
+			reloadTextures.clear();
+
+			std::chrono::high_resolution_clock::time_point deadline = std::chrono::high_resolution_clock::now() +
+				std::chrono::microseconds((long long)(uploadBudgetMilliseconds * 1000.0));
+			// at least one step per frame, the budget is 0 after a synchronous load
+			while (reloadedCount < reloadModels.size()) {
+				if (reloadModels[reloadedCount]->UploadPending(deadline, uploader.get())) {
+					reloadedCount++;
+				}
+				if (std::chrono::high_resolution_clock::now() >= deadline) {
+					break;
+				}
+			}
+			if (reloadedCount < reloadModels.size()) {
+				return;
+			}
+
+			reloading = false;
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - reloadStart;
+			std::cout << "Hot reload done in " << elapsed.count() << " ms" << std::endl;
+		}
+
+		std::chrono::duration<double, std::milli> quiet = std::chrono::high_resolution_clock::now() - lastChange;
+		if (!changedPaths.empty() && quiet.count() >= RELOAD_SETTLE_MILLISECONDS) {
+			StartReload();
+		}
+	}
+
+	void SceneLoader::StartReload()
+	{
+		std::vector<gps::Model3D*> models;
+		std::vector<std::string> texturePaths;
+		// models loaded from the same file share their asset - reloading one of them updates all
+		std::set<std::string> reloadedFiles;
+
+		for (std::set<std::string>::iterator path = changedPaths.begin(); path != changedPaths.end(); ++path) {
+			std::string extension = extensionOf(*path);
+			std::cout << "Changed " << *path << std::endl;
+			if (isTextureFile(extension)) {
+				texturePaths.push_back(*path);
+				continue;
+			}
+
+			for (size_t i = 0; i < items.size(); i++) {
+				if (!items[i].model) {
+					continue;
+				}
+				std::string objPath = AssetManager::CanonicalPath(items[i].fileName);
+				// the .mtl libraries of an .obj are looked up next to it
+				bool affected = extension == ".obj" ? objPath == *path : directoryOf(objPath) == directoryOf(*path);
+				if (affected && reloadedFiles.insert(objPath).second) {
+					models.push_back(items[i].model);
+				}
+			}
+		}
+		changedPaths.clear();
+
+		if (models.empty() && texturePaths.empty()) {
+			return;
+		}
+
+		reloading = true;
+		reloadPrepared = false;
+		reloadedCount = 0;
+		reloadStart = std::chrono::high_resolution_clock::now();
+		reloadThread = std::thread(&SceneLoader::PrepareReloads, this, models, texturePaths);
+	}
+
+	void SceneLoader::PrepareReloads(std::vector<gps::Model3D*> models, std::vector<std::string> texturePaths)
+	{
+		std::vector<gps::Model3D*> prepared;
+		for (size_t i = 0; i < models.size() && !cancelled; i++) {
+			if (models[i]->PrepareReload()) {
+				prepared.push_back(models[i]);
+			}
+		}
+
+		std::vector<gps::Model3D::PendingTexture> textures;
+		for (size_t i = 0; i < texturePaths.size() && !cancelled; i++) {
+			Model3D::PrepareTextureReload(texturePaths[i], textures);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		reloadModels.swap(prepared);
+		reloadTextures.swap(textures);
+		reloadPrepared = true;
+	}
+
+	bool SceneLoader::IsDone()
+	{
+		return uploadedCount == items.size();
+	}
+
+	void SceneLoader::Prepare(Item& item)
+	{
+		if (item.skyBox) {
+			item.skyBox->Prepare(item.faces);
+		}
+		else {
+			std::string basePath = item.fileName.substr(0, item.fileName.find_last_of('/')) + "/";
+			item.model->Prepare(item.fileName, basePath);
+		}
+	}
+
+	bool SceneLoader::Upload(Item& item, std::chrono::high_resolution_clock::time_point deadline)
+	{
+		if (item.skyBox) {
+			return item.skyBox->UploadPending(deadline, uploader.get());
+		}
+		return item.model->UploadPending(deadline, uploader.get());
+	}
+}
@@ -0,0 +1,103 @@
+#ifndef SceneLoader_hpp
+#define SceneLoader_hpp
+
+#include "FileWatcher.hpp"
+#include "Model3D.hpp"
+#include "SkyBox.hpp"
+#include "Uploader.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+// Loads the scene progressively: a loader thread parses the models and decodes their textures
+// in the order they were added, while the GL thread uploads whatever is ready for at most
+// a fixed budget per frame, so the window keeps rendering during the load
+class SceneLoader
+{
+public:
+    SceneLoader();
+    ~SceneLoader();
+
+    void AddSkyBox(gps::SkyBox* skyBox, std::vector<const GLchar*> faces);
+    void AddModel(gps::Model3D* model, std::string fileName);
+
+    // Loads everything before returning, like the original startup
+    void LoadAll();
+
+    // Starts the loader thread - must be called on the GL thread
+    void Start(double uploadBudgetMilliseconds);
+    // Uploads for at most the budget, called once per frame on the GL thread.
+    // Returns true once the whole scene is loaded - from then on it swaps in what hot reload prepared
+    bool Update();
+
+    // Hot reload: once the scene is loaded, a .obj or .mtl file written under `directory` is parsed again
+    // in the background and its models swapped in at the start of a frame, and a written image replaces
+    // the textures made from it. Call before loading, so the meshes keep the hashes that tell the unchanged
+    // ones apart. Needs inotify (Linux) or ReadDirectoryChangesW (Windows)
+    void WatchForChanges(std::string directory);
+
+    bool IsDone();
+
+    // Stops the loader and reload threads after the model they are on, waits for them and releases the
+    // uploader and any reload not swapped in yet - on the GL thread, before the context is destroyed.
+    // Nothing is loaded or reloaded after
+    void Stop();
+
+private:
+    struct Item
+    {
+        gps::Model3D* model;
+        gps::SkyBox* skyBox;
+        std::string fileName;
+        std::vector<const GLchar*> faces;
+    };
+
+    std::vector<Item> items;
+    std::thread thread;
+    std::mutex mutex;
+    // items [0, preparedCount) are ready to upload - guarded by mutex
+    size_t preparedCount;
+    size_t uploadedCount;
+    std::unique_ptr<gps::Uploader> uploader;
+    // set by Stop, checked by the threads between models
+    std::atomic<bool> cancelled;
+
+    double uploadBudgetMilliseconds;
+    std::chrono::high_resolution_clock::time_point start;
+    std::chrono::high_resolution_clock::time_point lastUpdate;
+    double worstFrameMilliseconds;
+
+    std::unique_ptr<gps::FileWatcher> watcher;
+    // written since the last reload started, and when the last one was - GL thread only
+    std::set<std::string> changedPaths;
+    std::chrono::high_resolution_clock::time_point lastChange;
+    std::thread reloadThread;
+    bool reloading;
+    // set by the reload thread once the lists below are filled - guarded by mutex
+    bool reloadPrepared;
+    std::vector<gps::Model3D*> reloadModels;
+    std::vector<gps::Model3D::PendingTexture> reloadTextures;
+    size_t reloadedCount;
+    std::chrono::high_resolution_clock::time_point reloadStart;
+
+    void Prepare(Item& item);
+    bool Upload(Item& item, std::chrono::high_resolution_clock::time_point deadline);
+    void PrepareAll();
+
+    void UpdateReloads();
+    // Picks the models and textures the changed paths affect and starts the reload thread on them
+    void StartReload();
+    void PrepareReloads(std::vector<gps::Model3D*> models, std::vector<std::string> texturePaths);
+};
+
+}
+
+#endif /* SceneLoader_hpp */
@@ -1,5 +1,7 @@
 #include "Shader.hpp"
 
+#include <algorithm>
+
 namespace gps {
     std::string Shader::readShaderFile(std::string fileName)
     {
@@ -80,11 +82,104 @@ namespace gps {
         glDeleteShader(fragmentShader);
         //check linking info
         shaderLinkLog(this->shaderProgram);
+        readUniforms();
+    }
+
+    void Shader::readUniforms()
+    {
+        uniforms.clear();
+        GLint count = 0;
+        GLint maxLength = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> buffer(std::max(maxLength, 1));
+
+        std::vector<std::string> names;
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(this->shaderProgram, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+            std::string name(buffer.data(), length);
+            GLint location = glGetUniformLocation(this->shaderProgram, name.c_str());
+            // members of uniform blocks have no location
+            if (location < 0) {
+                continue;
+            }
+
+            ActiveUniform uniform = { UniformHash(name.c_str()), location };
+            uniforms.push_back(uniform);
+            names.push_back(name);
+            // "lights[0]" is also found as "lights"
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+                name.erase(name.size() - 3);
+                ActiveUniform array = { UniformHash(name.c_str()), location };
+                uniforms.push_back(array);
+                names.push_back(name);
+            }
+        }
+
+        // two names with the same hash would make one of them unreachable
+        for (size_t i = 0; i < uniforms.size(); i++) {
+            for (size_t j = i + 1; j < uniforms.size(); j++) {
+                if (uniforms[i].hash == uniforms[j].hash) {
+                    std::cout << "WARNING: uniforms " << names[i] << " and " << names[j] << " have the same hash" << std::endl;
+                }
+            }
+        }
+        std::sort(uniforms.begin(), uniforms.end(), [](const ActiveUniform& a, const ActiveUniform& b) { return a.hash < b.hash; });
+    }
+
+    GLint Shader::GetUniform(uint32_t nameHash) const
+    {
+        std::vector<ActiveUniform>::const_iterator found = std::lower_bound(uniforms.begin(), uniforms.end(), nameHash,
+            [](const ActiveUniform& uniform, uint32_t hash) { return uniform.hash < hash; });
+        return found != uniforms.end() && found->hash == nameHash ? found->location : -1;
+    }
+
+    GLint Shader::GetUniform(const std::string& name) const
+    {
+        return GetUniform(UniformHash(name.c_str()));
+    }
+
+    void Shader::SetUniform(GLint location, GLint value) const
+    {
+        glProgramUniform1i(this->shaderProgram, location, value);
+    }
+
+    void Shader::SetUniform(GLint location, GLfloat value) const
+    {
+        glProgramUniform1f(this->shaderProgram, location, value);
+    }
+
+    void Shader::SetUniform(GLint location, const glm::vec2& value) const
+    {
+        glProgramUniform2fv(this->shaderProgram, location, 1, &value[0]);
+    }
+
+    void Shader::SetUniform(GLint location, const glm::vec3& value) const
+    {
+        glProgramUniform3fv(this->shaderProgram, location, 1, &value[0]);
+    }
+
+    void Shader::SetUniform(GLint location, const glm::vec4& value) const
+    {
+        glProgramUniform4fv(this->shaderProgram, location, 1, &value[0]);
+    }
+
+    void Shader::SetUniform(GLint location, const glm::mat3& value) const
+    {
+        glProgramUniformMatrix3fv(this->shaderProgram, location, 1, GL_FALSE, &value[0][0]);
+    }
+
+    void Shader::SetUniform(GLint location, const glm::mat4& value) const
+    {
+        glProgramUniformMatrix4fv(this->shaderProgram, location, 1, GL_FALSE, &value[0][0]);
     }
 
-    void Shader::useShaderProgram()
+    void Shader::useShaderProgram() const
     {
-        glUseProgram(this->shaderProgram);
+        GLStateCache::UseProgram(this->shaderProgram);
     }
 
 }
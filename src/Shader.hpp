@@ -2,23 +2,58 @@
 #define Shader_hpp
 
 #include <GL/glew.h>
+#include "GLStateCache.hpp"
+#include "glm.hpp"
 
+#include <cstdint>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <vector>
 
 namespace gps {
+
+// FNV-1a hash of a uniform name - a compile-time constant when given a literal in a constexpr context,
+// e.g. static constexpr uint32_t MODEL = UniformHash("model")
+constexpr uint32_t UniformHash(const char* name, uint32_t hash = 2166136261u)
+{
+    return *name ? UniformHash(name + 1, (hash ^ (uint32_t)(unsigned char)*name) * 16777619u) : hash;
+}
 	
 class Shader
 {
 public:
     GLuint shaderProgram;
     void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
-    void useShaderProgram();
+    void useShaderProgram() const;
+
+    // Location of an active uniform, from the table read after linking - -1 when the program has none by that
+    // name (e.g. optimized out), which the setters ignore. Arrays are found by "name" and "name[0]"
+    GLint GetUniform(uint32_t nameHash) const;
+    GLint GetUniform(const std::string& name) const;
+
+    // Set the uniform at `location` of this program, whether or not it is in use (glProgramUniform)
+    void SetUniform(GLint location, GLint value) const;
+    void SetUniform(GLint location, GLfloat value) const;
+    void SetUniform(GLint location, const glm::vec2& value) const;
+    void SetUniform(GLint location, const glm::vec3& value) const;
+    void SetUniform(GLint location, const glm::vec4& value) const;
+    void SetUniform(GLint location, const glm::mat3& value) const;
+    void SetUniform(GLint location, const glm::mat4& value) const;
 
 private:
+    struct ActiveUniform
+    {
+        uint32_t hash;
+        GLint location;
+    };
+    // sorted by hash, for a binary search
+    std::vector<ActiveUniform> uniforms;
+
+    // Fills `uniforms` with the active uniforms of the linked program
+    void readUniforms();
     std::string readShaderFile(std::string fileName);
     void shaderCompileLog(GLuint shaderId);
     void shaderLinkLog(GLuint shaderProgramId);
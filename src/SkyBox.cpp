@@ -10,59 +10,135 @@
 
 namespace gps {
     
-    SkyBox::SkyBox()
+    static constexpr uint32_t SKYBOX_UNIFORM = UniformHash("skybox");
+    
+    SkyBox::SkyBox() : cubemapTexture(0), loaded(false), nextFace(0), uploadedRows(0)
     {
         
     }
     
     void SkyBox::Load(std::vector<const GLchar*> cubeMapFaces)
     {
-        cubemapTexture = LoadSkyBoxTextures(cubeMapFaces);
-        InitSkyBox();
+        Prepare(cubeMapFaces);
+        UploadPending(std::chrono::high_resolution_clock::time_point::max(), NULL);
     }
     
-    void SkyBox::Draw(gps::Shader shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
+    void SkyBox::Prepare(std::vector<const GLchar*> skyBoxFaces)
     {
-        shader.useShaderProgram();
+        // RGBA rows are 4-byte aligned and the RGB->RGBA expansion is vectorized;
+        // the cube map keeps its GL_RGB storage
+        int force_channels = 4;
         
-        //set the view and projection matrices
-        glm::mat4 transformedView = glm::mat4(glm::mat3(viewMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(transformedView));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+        //decode all faces at the same time
+        TextureDecoder decoder;
+        for(GLuint i = 0; i < skyBoxFaces.size(); i++)
+        {
+            decoder.Request(skyBoxFaces[i], force_channels, false);
+        }
         
-        glDepthFunc(GL_LEQUAL);
+        pendingFaces.assign(skyBoxFaces.size(), DecodedImage());
+        nextFace = 0;
+        uploadedRows = 0;
         
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glUniform1i(glGetUniformLocation(shader.shaderProgram, "skybox"), 0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        DecodedImage image;
+        while (decoder.WaitNext(image))
+        {
+            if (image.pixels) {
+                printf("Decoded %s (%dx%d) in %g ms\n", image.path.c_str(), image.width, image.height, image.decodeMilliseconds);
+            }
+            pendingFaces[image.index] = image;
+        }
+    }
+    
+    bool SkyBox::UploadPending(std::chrono::high_resolution_clock::time_point deadline, gps::Uploader* uploader)
+    {
+        if (loaded) {
+            return true;
+        }
+        
+        if (nextFace == 0 && uploadedRows == 0 && !AllocateSkyBoxTextures()) {
+            // keep the previous behaviour - the sky box is drawn without a texture
+            for (size_t i = 0; i < pendingFaces.size(); i++) {
+                TextureDecoder::Free(pendingFaces[i]);
+            }
+            nextFace = pendingFaces.size();
+        }
+        
+        do {
+            if (nextFace >= pendingFaces.size()) {
+                pendingFaces.clear();
+                InitSkyBox();
+                loaded = true;
+                return true;
+            }
+            
+            DecodedImage& image = pendingFaces[nextFace];
+            if (!uploader) {
+                glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+                glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + image.index, 0, 0, 0, image.width, image.height,
+                                GL_RGBA, GL_UNSIGNED_BYTE, image.pixels);
+                glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+                uploadedRows = image.height;
+            }
+            else {
+                uploadedRows += uploader->UploadTextureRows(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_CUBE_MAP_POSITIVE_X + image.index,
+                                                            cubemapTexture, 0, 0, image.width, image.height, image.channels,
+                                                            image.pixels, uploadedRows);
+            }
+            
+            if (uploadedRows >= image.height) {
+                TextureDecoder::Free(image);
+                uploadedRows = 0;
+                nextFace++;
+            }
+        } while (std::chrono::high_resolution_clock::now() < deadline);
+        
+        return false;
+    }
+    
+    bool SkyBox::IsLoaded()
+    {
+        return loaded;
+    }
+    
+    void SkyBox::Draw(const gps::Shader& shader)
+    {
+        if (!loaded) {
+            return;
+        }
+        
+        shader.useShaderProgram();
+        
+        GLStateCache::DepthFunc(GL_LEQUAL);
+        
+        GLStateCache::BindVertexArray(skyboxVAO);
+        shader.SetUniform(shader.GetUniform(SKYBOX_UNIFORM), 0);
+        GLStateCache::BindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
         
-        glDepthFunc(GL_LESS);
+        GLStateCache::DepthFunc(GL_LESS);
     }
     
-    GLuint SkyBox::LoadSkyBoxTextures(std::vector<const GLchar*> skyBoxFaces)
+    // Creates the cube map with storage for every decoded face, the pixels follow in UploadPending
+    bool SkyBox::AllocateSkyBoxTextures()
     {
+        for (size_t i = 0; i < pendingFaces.size(); i++)
+        {
+            if (!pendingFaces[i].pixels) {
+                fprintf(stderr, "ERROR: could not load %s\n", pendingFaces[i].path.c_str());
+                return false;
+            }
+        }
+        
         GLuint textureID;
         glGenTextures(1, &textureID);
         glActiveTexture(GL_TEXTURE0);
-        
-        int width,height, n;
-        unsigned char* image;
-        int force_channels = 3;
-        
         glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-        for(GLuint i = 0; i < skyBoxFaces.size(); i++)
+        for (size_t i = 0; i < pendingFaces.size(); i++)
         {
-            image = stbi_load(skyBoxFaces[i], &width, &height, &n, force_channels);
-            if (!image) {
-                fprintf(stderr, "ERROR: could not load %s\n", skyBoxFaces[i]);
-                return false;
-            }
             glTexImage2D(
-                         GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0,
-                         GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image
+                         GL_TEXTURE_CUBE_MAP_POSITIVE_X + pendingFaces[i].index, 0,
+                         GL_RGB, pendingFaces[i].width, pendingFaces[i].height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL
                          );
         }
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -72,7 +148,8 @@ namespace gps {
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
         glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
         
-        return textureID;
+        cubemapTexture = textureID;
+        return true;
     }
     
     void SkyBox::InitSkyBox()
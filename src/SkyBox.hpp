@@ -11,6 +11,9 @@
 
 #include <stdio.h>
 #include "Shader.hpp"
+#include "TextureDecoder.hpp"
+#include "Uploader.hpp"
+#include <chrono>
 #include <vector>
 #include "stb_image.h"
 #include "glm.hpp"
@@ -22,13 +25,25 @@ namespace gps {
     public:
         SkyBox();
         void Load(std::vector<const GLchar*> cubeMapFaces);
-        void Draw(gps::Shader shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix);
+        // Decodes the faces without touching GL, so it can run on a loader thread
+        void Prepare(std::vector<const GLchar*> cubeMapFaces);
+        // Uploads the decoded faces until the deadline passes (sliced when an uploader is given).
+        // Returns true once the sky box can be drawn
+        bool UploadPending(std::chrono::high_resolution_clock::time_point deadline, gps::Uploader* uploader);
+        bool IsLoaded();
+        // The view and projection matrices come from the FrameBlock of the shader (gps::UniformBuffers)
+        void Draw(const gps::Shader& shader);
         GLuint GetTextureId();
     private:
         GLuint skyboxVAO;
         GLuint skyboxVBO;
         GLuint cubemapTexture;
-        GLuint LoadSkyBoxTextures(std::vector<const GLchar*> cubeMapFaces);
+        bool loaded;
+        // decoded faces waiting for upload, in face order
+        std::vector<DecodedImage> pendingFaces;
+        size_t nextFace;
+        int uploadedRows;
+        bool AllocateSkyBoxTextures();
         void InitSkyBox();
     };
 }
@@ -0,0 +1,382 @@
+#include "TextureCompressor.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace gps {
+
+	static int expand5(int v) { return (v << 3) | (v >> 2); }
+	static int expand6(int v) { return (v << 2) | (v >> 4); }
+
+	static unsigned short packColor(float r, float g, float b) {
+		int r5 = (int)(r * 31.0f / 255.0f + 0.5f);
+		int g6 = (int)(g * 63.0f / 255.0f + 0.5f);
+		int b5 = (int)(b * 31.0f / 255.0f + 0.5f);
+		r5 = r5 < 0 ? 0 : (r5 > 31 ? 31 : r5);
+		g6 = g6 < 0 ? 0 : (g6 > 63 ? 63 : g6);
+		b5 = b5 < 0 ? 0 : (b5 > 31 ? 31 : b5);
+		return (unsigned short)((r5 << 11) | (g6 << 5) | b5);
+	}
+
+	static void unpackColor(unsigned short c, int rgb[3]) {
+		rgb[0] = expand5((c >> 11) & 31);
+		rgb[1] = expand6((c >> 5) & 63);
+		rgb[2] = expand5(c & 31);
+	}
+
+	// Four-color palette of a BC1 block (color0 > color1 mode)
+	static void colorPalette(unsigned short c0, unsigned short c1, int palette[4][3]) {
+		unpackColor(c0, palette[0]);
+		unpackColor(c1, palette[1]);
+		for (int k = 0; k < 3; k++) {
+			palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+			palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+		}
+	}
+
+	// Picks the closest palette entry for every texel, returns the squared error
+	static int assignIndices(const unsigned char block[64], int palette[4][3], int indices[16]) {
+		int total = 0;
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			int bestError = std::numeric_limits<int>::max();
+			for (int p = 0; p < 4; p++) {
+				int dr = block[4 * i + 0] - palette[p][0];
+				int dg = block[4 * i + 1] - palette[p][1];
+				int db = block[4 * i + 2] - palette[p][2];
+				int error = dr * dr + dg * dg + db * db;
+				if (error < bestError) {
+					bestError = error;
+					best = p;
+				}
+			}
+			indices[i] = best;
+			total += bestError;
+		}
+		return total;
+	}
+
+	int TextureCompressor::GetBlockBytes(Format format) {
+		return format == BC1 ? 8 : 16;
+	}
+
+	size_t TextureCompressor::GetCompressedSize(int width, int height, Format format) {
+		return (size_t)((width + 3) / 4) * ((height + 3) / 4) * GetBlockBytes(format);
+	}
+
+	std::vector<unsigned char> TextureCompressor::Compress(const unsigned char* rgba, int width, int height, Format format) {
+		std::vector<unsigned char> output(GetCompressedSize(width, height, format));
+		int blockBytes = GetBlockBytes(format);
+		unsigned char* out = output.data();
+
+		for (int by = 0; by < height; by += 4) {
+			for (int bx = 0; bx < width; bx += 4) {
+				// gather the 4x4 texels, repeating the edge for partial blocks
+				unsigned char block[64];
+				for (int y = 0; y < 4; y++) {
+					int sy = by + y < height ? by + y : height - 1;
+					for (int x = 0; x < 4; x++) {
+						int sx = bx + x < width ? bx + x : width - 1;
+						memcpy(block + 4 * (4 * y + x), rgba + 4 * ((size_t)sy * width + sx), 4);
+					}
+				}
+
+				if (format == BC3) {
+					CompressAlphaBlock(block, out);
+					CompressColorBlock(block, out + 8);
+				}
+				else {
+					CompressColorBlock(block, out);
+				}
+				out += blockBytes;
+			}
+		}
+
+		return output;
+	}
+
+	void TextureCompressor::Decompress(const unsigned char* blocks, int width, int height, Format format, unsigned char* rgba) {
+		int blockBytes = GetBlockBytes(format);
+
+		for (int by = 0; by < height; by += 4) {
+			for (int bx = 0; bx < width; bx += 4) {
+				unsigned char block[64];
+				if (format == BC3) {
+					DecompressColorBlock(blocks + 8, block);
+					DecompressAlphaBlock(blocks, block);
+				}
+				else {
+					DecompressColorBlock(blocks, block);
+				}
+				blocks += blockBytes;
+
+				for (int y = 0; y < 4 && by + y < height; y++) {
+					for (int x = 0; x < 4 && bx + x < width; x++) {
+						memcpy(rgba + 4 * ((size_t)(by + y) * width + bx + x), block + 4 * (4 * y + x), 4);
+					}
+				}
+			}
+		}
+	}
+
+	// Endpoints along the principal axis of the block colors, refined once by least squares
+	void TextureCompressor::CompressColorBlock(const unsigned char block[64], unsigned char* output) {
+		float mean[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++) {
+			for (int k = 0; k < 3; k++) {
+				mean[k] += block[4 * i + k];
+			}
+		}
+		for (int k = 0; k < 3; k++) {
+			mean[k] /= 16.0f;
+		}
+
+		float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++) {
+			float r = block[4 * i + 0] - mean[0];
+			float g = block[4 * i + 1] - mean[1];
+			float b = block[4 * i + 2] - mean[2];
+			covariance[0] += r * r;
+			covariance[1] += r * g;
+			covariance[2] += r * b;
+			covariance[3] += g * g;
+			covariance[4] += g * b;
+			covariance[5] += b * b;
+		}
+
+		// power iteration, starting from the diagonal of the bounding box
+		float axis[3];
+		for (int k = 0; k < 3; k++) {
+			int minC = 255;
+			int maxC = 0;
+			for (int i = 0; i < 16; i++) {
+				if (block[4 * i + k] < minC) minC = block[4 * i + k];
+				if (block[4 * i + k] > maxC) maxC = block[4 * i + k];
+			}
+			axis[k] = (float)(maxC - minC);
+		}
+		for (int iteration = 0; iteration < 8; iteration++) {
+			float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+			float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+			float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+			float length = std::sqrt(x * x + y * y + z * z);
+			if (length < 1e-6f) {
+				break;
+			}
+			axis[0] = x / length;
+			axis[1] = y / length;
+			axis[2] = z / length;
+		}
+
+		float minT = std::numeric_limits<float>::max();
+		float maxT = -std::numeric_limits<float>::max();
+		for (int i = 0; i < 16; i++) {
+			float t = (block[4 * i + 0] - mean[0]) * axis[0] + (block[4 * i + 1] - mean[1]) * axis[1] + (block[4 * i + 2] - mean[2]) * axis[2];
+			if (t < minT) minT = t;
+			if (t > maxT) maxT = t;
+		}
+		// inset the endpoints a little, the extremes are reached by the interpolated entries anyway
+		float inset = (maxT - minT) / 16.0f;
+		minT += inset;
+		maxT -= inset;
+
+		unsigned short c0 = packColor(mean[0] + axis[0] * maxT, mean[1] + axis[1] * maxT, mean[2] + axis[2] * maxT);
+		unsigned short c1 = packColor(mean[0] + axis[0] * minT, mean[1] + axis[1] * minT, mean[2] + axis[2] * minT);
+
+		int palette[4][3];
+		int indices[16];
+		colorPalette(c0, c1, palette);
+		int error = assignIndices(block, palette, indices);
+
+		// least squares endpoints for the chosen indices
+		static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float ax[3] = { 0.0f, 0.0f, 0.0f };
+		float bx[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++) {
+			float a = weights[indices[i]];
+			float b = 1.0f - a;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int k = 0; k < 3; k++) {
+				ax[k] += a * block[4 * i + k];
+				bx[k] += b * block[4 * i + k];
+			}
+		}
+		float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) > 1e-6f) {
+			float e0[3], e1[3];
+			for (int k = 0; k < 3; k++) {
+				e0[k] = (ax[k] * bb - bx[k] * ab) / determinant;
+				e1[k] = (bx[k] * aa - ax[k] * ab) / determinant;
+			}
+			unsigned short r0 = packColor(e0[0], e0[1], e0[2]);
+			unsigned short r1 = packColor(e1[0], e1[1], e1[2]);
+			int refinedPalette[4][3];
+			int refinedIndices[16];
+			colorPalette(r0, r1, refinedPalette);
+			int refinedError = assignIndices(block, refinedPalette, refinedIndices);
+			if (refinedError < error) {
+				c0 = r0;
+				c1 = r1;
+				memcpy(indices, refinedIndices, sizeof(indices));
+			}
+		}
+
+		// color0 > color1 selects the four-color mode
+		if (c0 < c1) {
+			unsigned short swap = c0;
+			c0 = c1;
+			c1 = swap;
+			static const int remap[4] = { 1, 0, 3, 2 };
+			for (int i = 0; i < 16; i++) {
+				indices[i] = remap[indices[i]];
+			}
+		}
+		else if (c0 == c1) {
+			for (int i = 0; i < 16; i++) {
+				indices[i] = 0;
+			}
+		}
+
+		unsigned int bits = 0;
+		for (int i = 0; i < 16; i++) {
+			bits |= (unsigned int)indices[i] << (2 * i);
+		}
+		output[0] = (unsigned char)(c0 & 0xFF);
+		output[1] = (unsigned char)(c0 >> 8);
+		output[2] = (unsigned char)(c1 & 0xFF);
+		output[3] = (unsigned char)(c1 >> 8);
+		output[4] = (unsigned char)(bits & 0xFF);
+		output[5] = (unsigned char)((bits >> 8) & 0xFF);
+		output[6] = (unsigned char)((bits >> 16) & 0xFF);
+		output[7] = (unsigned char)(bits >> 24);
+	}
+
+	// Eight-value mode between the block's alpha extremes
+	void TextureCompressor::CompressAlphaBlock(const unsigned char block[64], unsigned char* output) {
+		int minA = 255;
+		int maxA = 0;
+		for (int i = 0; i < 16; i++) {
+			int a = block[4 * i + 3];
+			if (a < minA) minA = a;
+			if (a > maxA) maxA = a;
+		}
+
+		int palette[8];
+		palette[0] = maxA;
+		palette[1] = minA;
+		for (int k = 1; k < 7; k++) {
+			palette[k + 1] = ((7 - k) * maxA + k * minA) / 7;
+		}
+
+		unsigned long long bits = 0;
+		if (maxA > minA) {
+			for (int i = 0; i < 16; i++) {
+				int a = block[4 * i + 3];
+				int best = 0;
+				int bestError = 256;
+				for (int p = 0; p < 8; p++) {
+					int error = std::abs(a - palette[p]);
+					if (error < bestError) {
+						bestError = error;
+						best = p;
+					}
+				}
+				bits |= (unsigned long long)best << (3 * i);
+			}
+		}
+
+		output[0] = (unsigned char)maxA;
+		output[1] = (unsigned char)minA;
+		for (int k = 0; k < 6; k++) {
+			output[2 + k] = (unsigned char)((bits >> (8 * k)) & 0xFF);
+		}
+	}
+
+	void TextureCompressor::DecompressColorBlock(const unsigned char* input, unsigned char block[64]) {
+		unsigned short c0 = (unsigned short)(input[0] | (input[1] << 8));
+		unsigned short c1 = (unsigned short)(input[2] | (input[3] << 8));
+		unsigned int bits = input[4] | (input[5] << 8) | (input[6] << 16) | ((unsigned int)input[7] << 24);
+
+		int palette[4][3];
+		int alpha[4] = { 255, 255, 255, 255 };
+		if (c0 > c1) {
+			colorPalette(c0, c1, palette);
+		}
+		else {
+			// three colors and transparent black
+			unpackColor(c0, palette[0]);
+			unpackColor(c1, palette[1]);
+			for (int k = 0; k < 3; k++) {
+				palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+				palette[3][k] = 0;
+			}
+			alpha[3] = 0;
+		}
+
+		for (int i = 0; i < 16; i++) {
+			int index = (bits >> (2 * i)) & 3;
+			block[4 * i + 0] = (unsigned char)palette[index][0];
+			block[4 * i + 1] = (unsigned char)palette[index][1];
+			block[4 * i + 2] = (unsigned char)palette[index][2];
+			block[4 * i + 3] = (unsigned char)alpha[index];
+		}
+	}
+
+	void TextureCompressor::DecompressAlphaBlock(const unsigned char* input, unsigned char block[64]) {
+		int palette[8];
+		palette[0] = input[0];
+		palette[1] = input[1];
+		if (palette[0] > palette[1]) {
+			for (int k = 1; k < 7; k++) {
+				palette[k + 1] = ((7 - k) * palette[0] + k * palette[1]) / 7;
+			}
+		}
+		else {
+			for (int k = 1; k < 5; k++) {
+				palette[k + 1] = ((5 - k) * palette[0] + k * palette[1]) / 5;
+			}
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		unsigned long long bits = 0;
+		for (int k = 0; k < 6; k++) {
+			bits |= (unsigned long long)input[2 + k] << (8 * k);
+		}
+		for (int i = 0; i < 16; i++) {
+			block[4 * i + 3] = (unsigned char)palette[(bits >> (3 * i)) & 7];
+		}
+	}
+
+	double TextureCompressor::PSNR(const unsigned char* a, const unsigned char* b, int width, int height, bool alpha) {
+		int channels = alpha ? 4 : 3;
+		double sum = 0.0;
+		size_t texels = (size_t)width * height;
+		for (size_t i = 0; i < texels; i++) {
+			for (int k = 0; k < channels; k++) {
+				double d = (double)a[4 * i + k] - (double)b[4 * i + k];
+				sum += d * d;
+			}
+		}
+		double mse = sum / (double)(texels * channels);
+		if (mse == 0.0) {
+			return std::numeric_limits<double>::infinity();
+		}
+		return 10.0 * std::log10(255.0 * 255.0 / mse);
+	}
+
+	bool TextureCompressor::HasAlpha(const unsigned char* rgba, int width, int height) {
+		size_t texels = (size_t)width * height;
+		for (size_t i = 0; i < texels; i++) {
+			if (rgba[4 * i + 3] != 255) {
+				return true;
+			}
+		}
+		return false;
+	}
+}
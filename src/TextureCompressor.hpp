@@ -0,0 +1,45 @@
+#ifndef TextureCompressor_hpp
+#define TextureCompressor_hpp
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+// CPU encoder/decoder for the S3TC block formats, used offline by tools/TextureConverter.
+// Works on 8-bit RGBA images; colors are encoded as stored (sRGB)
+class TextureCompressor
+{
+public:
+    enum Format
+    {
+        // 4x4 texels in 8 bytes, opaque
+        BC1,
+        // 4x4 texels in 16 bytes, BC1 color + interpolated alpha
+        BC3
+    };
+
+    static int GetBlockBytes(Format format);
+    static size_t GetCompressedSize(int width, int height, Format format);
+
+    // Encodes a whole image (any size - partial edge blocks repeat the last row/column)
+    static std::vector<unsigned char> Compress(const unsigned char* rgba, int width, int height, Format format);
+    // Decodes a whole image to RGBA
+    static void Decompress(const unsigned char* blocks, int width, int height, Format format, unsigned char* rgba);
+
+    // Peak signal-to-noise ratio in dB of the RGB (and optionally alpha) channels
+    static double PSNR(const unsigned char* a, const unsigned char* b, int width, int height, bool alpha);
+
+    // True if any texel is not fully opaque
+    static bool HasAlpha(const unsigned char* rgba, int width, int height);
+
+private:
+    static void CompressColorBlock(const unsigned char block[64], unsigned char* output);
+    static void CompressAlphaBlock(const unsigned char block[64], unsigned char* output);
+    static void DecompressColorBlock(const unsigned char* input, unsigned char block[64]);
+    static void DecompressAlphaBlock(const unsigned char* input, unsigned char block[64]);
+};
+
+}
+
+#endif /* TextureCompressor_hpp */
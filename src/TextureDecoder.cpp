@@ -0,0 +1,109 @@
+#include "TextureDecoder.hpp"
+
+#include "ImageProcessing.hpp"
+#include "stb_image.h"
+
+#include <chrono>
+#include <cstdlib>
+
+namespace gps {
+
+	TextureDecoder::TextureDecoder(ThreadPool& pool) : pool(pool), requested(0), returned(0)
+	{
+	}
+
+	TextureDecoder::~TextureDecoder()
+	{
+		// let the in-flight jobs finish before the queue goes away
+		DecodedImage image;
+		while (WaitNext(image)) {
+			Free(image);
+		}
+	}
+
+	void TextureDecoder::Request(std::string path, int channels, bool flipVertically, bool buildMips)
+	{
+		int index;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			index = requested++;
+		}
+
+		pool.Enqueue([this, index, path, channels, flipVertically, buildMips] {
+			DecodedImage image = Decode(path, channels, flipVertically, buildMips);
+			image.index = index;
+			// notified under the lock: once WaitNext has the last image, the decoder may be destroyed
+			std::lock_guard<std::mutex> lock(mutex);
+			completed.push_back(image);
+			imageReady.notify_one();
+		});
+	}
+
+	bool TextureDecoder::WaitNext(DecodedImage& image)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (returned == requested) {
+			return false;
+		}
+
+		imageReady.wait(lock, [this] { return !completed.empty(); });
+		image = completed.front();
+		completed.pop_front();
+		returned++;
+		return true;
+	}
+
+	void TextureDecoder::Free(DecodedImage& image)
+	{
+		if (image.pixels) {
+			stbi_image_free(image.pixels);
+			image.pixels = NULL;
+		}
+		image.mipLevels.clear();
+	}
+
+	DecodedImage TextureDecoder::Decode(std::string path, int channels, bool flipVertically, bool buildMips)
+	{
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+		DecodedImage image;
+		image.index = 0;
+		image.path = path;
+		image.channels = channels;
+		image.width = 0;
+		image.height = 0;
+
+		// decode at the file's own channel count - RGB files are widened to RGBA with the SIMD kernel
+		// rather than stb's per-texel conversion
+		int n;
+		image.pixels = stbi_load(path.c_str(), &image.width, &image.height, &n, 0);
+		if (image.pixels && n != channels) {
+			if (n == 3 && channels == 4) {
+				size_t texels = (size_t)image.width * image.height;
+				// malloc, so Free() can release it like stb's buffers
+				unsigned char* rgba = (unsigned char*)malloc(texels * 4);
+				if (rgba) {
+					ImageProcessing::ExpandRGBToRGBA(image.pixels, rgba, texels);
+				}
+				stbi_image_free(image.pixels);
+				image.pixels = rgba;
+			}
+			else {
+				stbi_image_free(image.pixels);
+				image.pixels = stbi_load(path.c_str(), &image.width, &image.height, &n, channels);
+			}
+		}
+
+		if (image.pixels && flipVertically) {
+			ImageProcessing::FlipRows(image.pixels, image.width, image.height, channels);
+		}
+
+		if (image.pixels && buildMips && channels == 4) {
+			image.mipLevels = ImageProcessing::BuildMipChain(image.pixels, image.width, image.height);
+		}
+
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+		image.decodeMilliseconds = elapsed.count();
+		return image;
+	}
+}
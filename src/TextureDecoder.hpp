@@ -0,0 +1,62 @@
+#ifndef TextureDecoder_hpp
+#define TextureDecoder_hpp
+
+#include "ThreadPool.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+// Pixels of one image file, decoded on a worker thread
+struct DecodedImage
+{
+    // Position of the request - lets the caller match images that complete out of order
+    int index;
+    std::string path;
+    unsigned char* pixels;
+    int width;
+    int height;
+    // Channels of `pixels` (the requested channel count)
+    int channels;
+    // Levels 1..n of the mip chain when requested (RGBA only), empty otherwise
+    std::vector<std::vector<unsigned char> > mipLevels;
+    double decodeMilliseconds;
+};
+
+// Decodes image files on a thread pool. Decoded images are handed back through a completion
+// queue, so the GL uploads can stay on the GL thread
+class TextureDecoder
+{
+public:
+    TextureDecoder(ThreadPool& pool = ThreadPool::Shared());
+    ~TextureDecoder();
+
+    // Queues the decode of a file, converted to `channels` channels, optionally flipped vertically
+    // and with its sRGB mip chain built on the worker
+    void Request(std::string path, int channels, bool flipVertically, bool buildMips = false);
+
+    // Blocks until the next image is decoded. Returns false once every requested image was returned.
+    // `pixels` is NULL if the file could not be decoded; otherwise release it with Free()
+    bool WaitNext(DecodedImage& image);
+
+    static void Free(DecodedImage& image);
+
+    // Decodes on the calling thread
+    static DecodedImage Decode(std::string path, int channels, bool flipVertically, bool buildMips = false);
+
+private:
+    ThreadPool& pool;
+    std::mutex mutex;
+    std::condition_variable imageReady;
+    std::deque<DecodedImage> completed;
+    int requested;
+    int returned;
+};
+
+}
+
+#endif /* TextureDecoder_hpp */
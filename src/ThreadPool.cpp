@@ -0,0 +1,72 @@
+#include "ThreadPool.hpp"
+
+namespace gps {
+
+	ThreadPool::ThreadPool(unsigned int threadCount) : stopping(false)
+	{
+		if (threadCount == 0) {
+			threadCount = std::thread::hardware_concurrency();
+		}
+		if (threadCount == 0) {
+			threadCount = 1;
+		}
+
+		for (unsigned int i = 0; i < threadCount; i++) {
+			workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		jobAvailable.notify_all();
+
+		for (size_t i = 0; i < workers.size(); i++) {
+			workers[i].join();
+		}
+	}
+
+	std::future<void> ThreadPool::Enqueue(std::function<void()> job)
+	{
+		std::shared_ptr<std::packaged_task<void()> > task = std::make_shared<std::packaged_task<void()> >(job);
+		std::future<void> done = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back([task] { (*task)(); });
+		}
+		jobAvailable.notify_one();
+		return done;
+	}
+
+	unsigned int ThreadPool::GetThreadCount()
+	{
+		return (unsigned int)workers.size();
+	}
+
+	ThreadPool& ThreadPool::Shared()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+	void ThreadPool::WorkerLoop()
+	{
+		for (;;) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+				if (stopping && jobs.empty()) {
+					return;
+				}
+				job = jobs.front();
+				jobs.pop_front();
+			}
+
+			job();
+		}
+	}
+}
@@ -0,0 +1,43 @@
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+// Fixed set of worker threads running queued jobs
+class ThreadPool
+{
+public:
+    // threadCount == 0 uses one thread per hardware core
+    ThreadPool(unsigned int threadCount = 0);
+    ~ThreadPool();
+
+    // The returned future becomes ready once the job has run
+    std::future<void> Enqueue(std::function<void()> job);
+
+    unsigned int GetThreadCount();
+
+    // Pool shared by the asset loaders
+    static ThreadPool& Shared();
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()> > jobs;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    bool stopping;
+
+    void WorkerLoop();
+};
+
+}
+
+#endif /* ThreadPool_hpp */
@@ -0,0 +1,139 @@
+#include "UniformBuffers.hpp"
+
+#include <gtc/matrix_inverse.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace gps {
+
+	// the offsets the std140 rules give the blocks of the shaders
+	static_assert(sizeof(PointLightUniforms) == 80, "PointLight is 80 bytes in std140");
+	static_assert(offsetof(PointLightUniforms, ambient) == 32, "PointLight.ambient is at 32 in std140");
+	static_assert(offsetof(FrameUniforms, lightDir) == 192, "FrameBlock.lightDir is at 192 in std140");
+	static_assert(offsetof(FrameUniforms, pointLights) == 224, "FrameBlock.pointLights is at 224 in std140");
+	static_assert(sizeof(ObjectUniforms) == 112, "ObjectBlock is 112 bytes in std140");
+
+	// longest wait for the GPU to release a slot, per glClientWaitSync
+	static const GLuint64 FENCE_TIMEOUT = 1000000000;
+
+	void ObjectUniforms::Set(const glm::mat4& model, const glm::mat4& view)
+	{
+		this->model = model;
+		glm::mat3 normal = glm::mat3(glm::inverseTranspose(view * model));
+		for (int column = 0; column < 3; column++) {
+			normalMatrix[column] = glm::vec4(normal[column], 0.0f);
+		}
+	}
+
+	void UniformBuffers::BindBlocks(const gps::Shader& shader)
+	{
+		GLuint frameBlock = glGetUniformBlockIndex(shader.shaderProgram, "FrameBlock");
+		if (frameBlock != GL_INVALID_INDEX) {
+			glUniformBlockBinding(shader.shaderProgram, frameBlock, FRAME_BINDING);
+		}
+		GLuint objectBlock = glGetUniformBlockIndex(shader.shaderProgram, "ObjectBlock");
+		if (objectBlock != GL_INVALID_INDEX) {
+			glUniformBlockBinding(shader.shaderProgram, objectBlock, OBJECT_BINDING);
+		}
+	}
+
+	UniformBuffers::UniformBuffers(size_t objects) : objectsPerSlot(0), slot(0)
+	{
+		std::fill(fences, fences + RING_FRAMES, (GLsync)0);
+
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		alignment = std::max(alignment, 1);
+		objectStride = ((GLsizeiptr)sizeof(ObjectUniforms) + alignment - 1) / alignment * alignment;
+
+		glGenBuffers(1, &frameBuffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BINDING, frameBuffer);
+
+		glGenBuffers(1, &objectBuffer);
+		Allocate(std::max(objects, (size_t)1));
+	}
+
+	UniformBuffers::~UniformBuffers()
+	{
+		for (int s = 0; s < RING_FRAMES; s++) {
+			if (fences[s]) {
+				glDeleteSync(fences[s]);
+			}
+		}
+		glDeleteBuffers(1, &frameBuffer);
+		glDeleteBuffers(1, &objectBuffer);
+	}
+
+	void UniformBuffers::Allocate(size_t objects)
+	{
+		// a new data store - the draws still reading the old one keep it alive
+		for (int s = 0; s < RING_FRAMES; s++) {
+			if (fences[s]) {
+				glDeleteSync(fences[s]);
+				fences[s] = 0;
+			}
+		}
+		objectsPerSlot = objects;
+		glBindBuffer(GL_UNIFORM_BUFFER, objectBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, RING_FRAMES * objectsPerSlot * objectStride, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	void UniformBuffers::Update(const FrameUniforms& frame, const std::vector<ObjectUniforms>& objects)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		// the buffer stays on the binding point, unless something else took it
+		glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BINDING, frameBuffer);
+
+		if (objects.size() > objectsPerSlot) {
+			Allocate(std::max(objects.size(), objectsPerSlot * 2));
+		}
+		slot = (slot + 1) % RING_FRAMES;
+		if (fences[slot]) {
+			GLenum waited = glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+			if (waited == GL_TIMEOUT_EXPIRED || waited == GL_WAIT_FAILED) {
+				std::cout << "WARNING: uniform ring slot " << slot << " still in use after 1 s" << std::endl;
+			}
+			glDeleteSync(fences[slot]);
+			fences[slot] = 0;
+		}
+		if (objects.empty()) {
+			return;
+		}
+
+		// the fence says the GPU is done with the slot - no need for the driver to synchronize
+		GLintptr offset = slot * objectsPerSlot * objectStride;
+		GLsizeiptr size = objects.size() * objectStride;
+		glBindBuffer(GL_UNIFORM_BUFFER, objectBuffer);
+		unsigned char* data = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, offset, size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (data) {
+			for (size_t i = 0; i < objects.size(); i++) {
+				memcpy(data + i * objectStride, &objects[i], sizeof(ObjectUniforms));
+			}
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	void UniformBuffers::BindObject(size_t index)
+	{
+		glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BINDING, objectBuffer, (slot * objectsPerSlot + index) * objectStride,
+			sizeof(ObjectUniforms));
+	}
+
+	void UniformBuffers::EndFrame()
+	{
+		if (fences[slot]) {
+			glDeleteSync(fences[slot]);
+		}
+		fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
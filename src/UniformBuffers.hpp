@@ -0,0 +1,98 @@
+#ifndef UniformBuffers_hpp
+#define UniformBuffers_hpp
+
+#include <GL/glew.h>
+#include "glm.hpp"
+
+#include "Shader.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+// std140 layout of the PointLight struct of the shaders
+struct PointLightUniforms
+{
+    glm::vec3 position;
+    GLfloat constant;
+    GLfloat linear;
+    GLfloat quadratic;
+    GLfloat padding0[2];
+    glm::vec3 ambient;
+    GLfloat padding1;
+    glm::vec3 diffuse;
+    GLfloat padding2;
+    glm::vec3 specular;
+    GLfloat padding3;
+};
+
+// std140 layout of the FrameBlock of the shaders - constants shared by every draw of a frame
+struct FrameUniforms
+{
+    static const int POINT_LIGHTS = 4;
+
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 lightSpaceTrMatrix;
+    glm::vec3 lightDir;
+    GLint fog;
+    glm::vec3 lightColor;
+    GLint directionalLightEnabled;
+    PointLightUniforms pointLights[POINT_LIGHTS];
+};
+
+// std140 layout of the ObjectBlock of the shaders - the constants of one model
+struct ObjectUniforms
+{
+    glm::mat4 model;
+    // the columns of a mat3, each padded to a vec4
+    glm::vec4 normalMatrix[3];
+
+    // Sets the model matrix and the normal matrix of the eye space of `view`
+    void Set(const glm::mat4& model, const glm::mat4& view);
+};
+
+// The buffers behind the FrameBlock and ObjectBlock of the shaders. The frame constants are one
+// glBufferSubData per frame; the objects of a frame are written together, with one mapping, into the next
+// slot of a ring of RING_FRAMES slots, so the GPU can still read the slots of the frames before. A fence
+// per slot keeps the CPU from overwriting a slot the GPU has not finished with
+class UniformBuffers
+{
+public:
+    static const GLuint FRAME_BINDING = 0;
+    static const GLuint OBJECT_BINDING = 1;
+    static const int RING_FRAMES = 3;
+
+    // Binds the FrameBlock and ObjectBlock of `shader`, those it declares, to their binding points
+    static void BindBlocks(const gps::Shader& shader);
+
+    // Room for `objects` objects per frame at first, grown when a frame has more
+    explicit UniformBuffers(size_t objects);
+    ~UniformBuffers();
+    UniformBuffers(const UniformBuffers&) = delete;
+    UniformBuffers& operator=(const UniformBuffers&) = delete;
+
+    // Moves to the next slot of the ring and writes the constants of the frame
+    void Update(const FrameUniforms& frame, const std::vector<ObjectUniforms>& objects);
+    // Points the ObjectBlock at object `index` of the last Update
+    void BindObject(size_t index);
+    // Fences the draws of the frame, which read the current slot - after its last draw
+    void EndFrame();
+
+private:
+    // Reallocates the ring for `objects` objects per slot, once the GPU is done with every slot
+    void Allocate(size_t objects);
+
+    GLuint frameBuffer;
+    GLuint objectBuffer;
+    // ObjectUniforms rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, the step of glBindBufferRange
+    GLsizeiptr objectStride;
+    size_t objectsPerSlot;
+    int slot;
+    GLsync fences[RING_FRAMES];
+};
+
+}
+
+#endif /* UniformBuffers_hpp */
@@ -0,0 +1,151 @@
+#include "Uploader.hpp"
+
+#include <cstring>
+
+namespace gps {
+
+	// Rows [y, y + height) of one level - of one layer for a texture array
+	static void texSubImage(GLenum target, GLint level, GLint layer, GLint y, GLsizei width, GLsizei height, GLenum format, const GLvoid* pixels)
+	{
+		if (target == GL_TEXTURE_2D_ARRAY) {
+			glTexSubImage3D(target, level, 0, y, layer, width, height, 1, format, GL_UNSIGNED_BYTE, pixels);
+		}
+		else {
+			glTexSubImage2D(target, level, 0, y, width, height, format, GL_UNSIGNED_BYTE, pixels);
+		}
+	}
+
+	static void compressedTexSubImage(GLenum target, GLint level, GLint layer, GLint y, GLsizei width, GLsizei height, GLenum format,
+		GLsizei size, const GLvoid* data)
+	{
+		if (target == GL_TEXTURE_2D_ARRAY) {
+			glCompressedTexSubImage3D(target, level, 0, y, layer, width, height, 1, format, size, data);
+		}
+		else {
+			glCompressedTexSubImage2D(target, level, 0, y, width, height, format, size, data);
+		}
+	}
+
+	Uploader::Uploader()
+	{
+		glGenBuffers(1, &stagingBuffer);
+		glGenBuffers(1, &pixelBuffer);
+	}
+
+	Uploader::~Uploader()
+	{
+		glDeleteBuffers(1, &stagingBuffer);
+		glDeleteBuffers(1, &pixelBuffer);
+	}
+
+	GLsizeiptr Uploader::UploadBuffer(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data)
+	{
+		if (size > SLICE_SIZE) {
+			size = SLICE_SIZE;
+		}
+		if (size <= 0) {
+			return 0;
+		}
+
+		// orphan the previous slice so the driver never has to wait for the last copy
+		glBindBuffer(GL_COPY_READ_BUFFER, stagingBuffer);
+		glBufferData(GL_COPY_READ_BUFFER, SLICE_SIZE, NULL, GL_STREAM_DRAW);
+		void* staging = glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (staging) {
+			memcpy(staging, data, size);
+			glUnmapBuffer(GL_COPY_READ_BUFFER);
+
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset, size);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		else {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+		return size;
+	}
+
+	int Uploader::UploadTextureRows(GLenum bindTarget, GLenum imageTarget, GLuint texture, GLint level, GLint layer,
+		GLsizei width, GLsizei height, int channels, const unsigned char* pixels, int firstRow)
+	{
+		GLsizeiptr rowBytes = (GLsizeiptr)width * channels;
+		int rows = (int)(SLICE_SIZE / rowBytes);
+		if (rows < 1) {
+			rows = 1;
+		}
+		if (rows > height - firstRow) {
+			rows = height - firstRow;
+		}
+		if (rows <= 0) {
+			return 0;
+		}
+
+		GLsizeiptr size = rowBytes * rows;
+		const unsigned char* source = pixels + rowBytes * firstRow;
+		GLenum format = channels == 4 ? GL_RGBA : GL_RGB;
+
+		glBindTexture(bindTarget, texture);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (staging) {
+			memcpy(staging, source, size);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			texSubImage(imageTarget, level, layer, firstRow, width, rows, format, (GLvoid*)0);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+		else {
+			// the unpack buffer must be unbound before passing a client pointer
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			texSubImage(imageTarget, level, layer, firstRow, width, rows, format, source);
+		}
+		glBindTexture(bindTarget, 0);
+
+		return rows;
+	}
+
+	int Uploader::UploadCompressedRows(GLenum bindTarget, GLenum imageTarget, GLuint texture, GLint level, GLint layer, GLenum format,
+		GLsizei width, GLsizei height, GLsizei blockBytes, const unsigned char* data, int firstBlockRow)
+	{
+		int blockRows = (height + 3) / 4;
+		GLsizeiptr rowBytes = (GLsizeiptr)((width + 3) / 4) * blockBytes;
+		int rows = (int)(SLICE_SIZE / rowBytes);
+		if (rows < 1) {
+			rows = 1;
+		}
+		if (rows > blockRows - firstBlockRow) {
+			rows = blockRows - firstBlockRow;
+		}
+		if (rows <= 0) {
+			return 0;
+		}
+
+		// the last block row may cover fewer than 4 texel rows
+		GLint y = firstBlockRow * 4;
+		GLsizei texelRows = rows * 4 < height - y ? rows * 4 : height - y;
+		GLsizeiptr size = rowBytes * rows;
+		const unsigned char* source = data + rowBytes * firstBlockRow;
+
+		glBindTexture(bindTarget, texture);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (staging) {
+			memcpy(staging, source, size);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			compressedTexSubImage(imageTarget, level, layer, y, width, texelRows, format, (GLsizei)size, (GLvoid*)0);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+		else {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			compressedTexSubImage(imageTarget, level, layer, y, width, texelRows, format, (GLsizei)size, source);
+		}
+		glBindTexture(bindTarget, 0);
+
+		return rows;
+	}
+}
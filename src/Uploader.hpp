@@ -0,0 +1,42 @@
+#ifndef Uploader_hpp
+#define Uploader_hpp
+
+#include <GL/glew.h>
+
+namespace gps {
+
+// Streams buffer and texture data to the GPU in bounded slices through staging buffers,
+// so a large upload can be spread over several frames
+class Uploader
+{
+public:
+    // Upper bound of the bytes copied by one call
+    static const GLsizeiptr SLICE_SIZE = 1 << 20;
+
+    Uploader();
+    ~Uploader();
+
+    // Copies up to SLICE_SIZE bytes of `data` into `buffer` at `offset` through the vertex staging buffer.
+    // Returns the number of bytes copied
+    GLsizeiptr UploadBuffer(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data);
+
+    // Copies as many rows of `pixels` (one 8-bit image level), starting at `firstRow`, as fit in one slice
+    // through the pixel unpack buffer. `texture` must already have storage for `level` of `imageTarget`.
+    // `layer` is the layer of a GL_TEXTURE_2D_ARRAY, ignored for the other targets.
+    // Returns the number of rows copied
+    int UploadTextureRows(GLenum bindTarget, GLenum imageTarget, GLuint texture, GLint level, GLint layer,
+                          GLsizei width, GLsizei height, int channels, const unsigned char* pixels, int firstRow);
+
+    // Same for one level of a block-compressed texture, in rows of 4x4 blocks. `data` holds the whole level.
+    // Returns the number of block rows copied
+    int UploadCompressedRows(GLenum bindTarget, GLenum imageTarget, GLuint texture, GLint level, GLint layer, GLenum format,
+                             GLsizei width, GLsizei height, GLsizei blockBytes, const unsigned char* data, int firstBlockRow);
+
+private:
+    GLuint stagingBuffer;
+    GLuint pixelBuffer;
+};
+
+}
+
+#endif /* Uploader_hpp */
@@ -0,0 +1,143 @@
+#include "VertexQuantizer.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace gps {
+
+	QuantizationError::QuantizationError() : position(0.0f), normal(0.0f), texCoord(0.0f)
+	{
+	}
+
+	// Worst angle between a normal and its 16-bit octahedral encoding is about 0.003 degrees
+	static const float MAX_NORMAL_ERROR = 0.01f;
+
+	static GLushort quantizeUnorm16(float v) {
+		float clamped = std::min(std::max(v, 0.0f), 1.0f);
+		return (GLushort)(clamped * 65535.0f + 0.5f);
+	}
+
+	static float dequantizeUnorm16(GLushort v) {
+		return v / 65535.0f;
+	}
+
+	// Position of `value` in the range [offset, offset + scale], 0 for an empty range
+	static float relative(float value, float offset, float scale) {
+		return scale > 0.0f ? (value - offset) / scale : 0.0f;
+	}
+
+	glm::vec2 VertexQuantizer::EncodeOctahedral(const glm::vec3& normal) {
+		float length = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+		if (length == 0.0f) {
+			return glm::vec2(0.0f);
+		}
+		glm::vec3 n = normal / length;
+		if (n.z < 0.0f) {
+			// fold the lower half over the diagonals
+			glm::vec2 folded((1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f), (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+			return folded;
+		}
+		return glm::vec2(n.x, n.y);
+	}
+
+	// Same steps as octahedralDecode in the vertex shaders
+	glm::vec3 VertexQuantizer::DecodeOctahedral(const glm::vec2& encoded) {
+		glm::vec3 n(encoded.x, encoded.y, 1.0f - std::fabs(encoded.x) - std::fabs(encoded.y));
+		float t = std::max(-n.z, 0.0f);
+		n.x += n.x >= 0.0f ? -t : t;
+		n.y += n.y >= 0.0f ? -t : t;
+		return glm::normalize(n);
+	}
+
+	PackedVertex VertexQuantizer::Pack(const Vertex& vertex, const VertexQuantization& quantization) {
+		PackedVertex packed;
+		for (int k = 0; k < 3; k++) {
+			packed.Position[k] = quantizeUnorm16(relative(vertex.Position[k], quantization.positionOffset[k], quantization.positionScale[k]));
+		}
+		packed.Position[3] = 0;
+
+		glm::vec2 octahedral = EncodeOctahedral(vertex.Normal);
+		packed.Normal[0] = quantizeUnorm16(octahedral.x * 0.5f + 0.5f);
+		packed.Normal[1] = quantizeUnorm16(octahedral.y * 0.5f + 0.5f);
+
+		for (int k = 0; k < 2; k++) {
+			packed.TexCoords[k] = quantizeUnorm16(relative(vertex.TexCoords[k], quantization.texCoordOffset[k], quantization.texCoordScale[k]));
+		}
+		return packed;
+	}
+
+	Vertex VertexQuantizer::Unpack(const PackedVertex& packed, const VertexQuantization& quantization) {
+		Vertex vertex;
+		for (int k = 0; k < 3; k++) {
+			vertex.Position[k] = quantization.positionOffset[k] + dequantizeUnorm16(packed.Position[k]) * quantization.positionScale[k];
+		}
+		glm::vec2 octahedral(dequantizeUnorm16(packed.Normal[0]) * 2.0f - 1.0f, dequantizeUnorm16(packed.Normal[1]) * 2.0f - 1.0f);
+		vertex.Normal = DecodeOctahedral(octahedral);
+		for (int k = 0; k < 2; k++) {
+			vertex.TexCoords[k] = quantization.texCoordOffset[k] + dequantizeUnorm16(packed.TexCoords[k]) * quantization.texCoordScale[k];
+		}
+		return vertex;
+	}
+
+	bool VertexQuantizer::Quantize(MeshData& mesh, const glm::vec3& boundsMin, const glm::vec3& boundsMax, QuantizationError& error) {
+		const Vertex* vertices = mesh.GetVertices();
+		size_t count = (size_t)mesh.GetVertexCount();
+		mesh.packedVertices.clear();
+		mesh.quantization = VertexQuantization();
+		if (count == 0) {
+			return false;
+		}
+
+		VertexQuantization quantization;
+		quantization.packed = true;
+		quantization.positionOffset = boundsMin;
+		quantization.positionScale = boundsMax - boundsMin;
+		glm::vec2 texCoordMin = vertices[0].TexCoords;
+		glm::vec2 texCoordMax = texCoordMin;
+		for (size_t v = 1; v < count; v++) {
+			texCoordMin = glm::min(texCoordMin, vertices[v].TexCoords);
+			texCoordMax = glm::max(texCoordMax, vertices[v].TexCoords);
+		}
+		quantization.texCoordOffset = texCoordMin;
+		quantization.texCoordScale = texCoordMax - texCoordMin;
+
+		// half a step of the grid on each axis, plus float rounding of offset + value * scale
+		glm::vec3 positionStep = quantization.positionScale / 65535.0f;
+		float positionBound = 0.5f * glm::length(positionStep) +
+			4.0f * FLT_EPSILON * (glm::length(boundsMin) + glm::length(quantization.positionScale));
+		glm::vec2 texCoordStep = quantization.texCoordScale / 65535.0f;
+		float texCoordBound = 0.5f * std::max(texCoordStep.x, texCoordStep.y) +
+			4.0f * FLT_EPSILON * (std::max(std::fabs(texCoordMin.x), std::fabs(texCoordMin.y)) + std::max(quantization.texCoordScale.x, quantization.texCoordScale.y));
+
+		std::vector<PackedVertex> packed(count);
+		QuantizationError meshError;
+		for (size_t v = 0; v < count; v++) {
+			packed[v] = Pack(vertices[v], quantization);
+			Vertex decoded = Unpack(packed[v], quantization);
+
+			meshError.position = std::max(meshError.position, glm::length(decoded.Position - vertices[v].Position));
+			glm::vec2 texCoordError = glm::abs(decoded.TexCoords - vertices[v].TexCoords);
+			meshError.texCoord = std::max(meshError.texCoord, std::max(texCoordError.x, texCoordError.y));
+
+			// atan2 of the cross and dot products stays accurate for tiny angles, unlike acos
+			glm::dvec3 a(vertices[v].Normal);
+			glm::dvec3 b(decoded.Normal);
+			if (glm::dot(a, a) > 0.0) {
+				double degrees = std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b)) * 180.0 / 3.14159265358979323846;
+				meshError.normal = std::max(meshError.normal, (float)degrees);
+			}
+		}
+
+		if (meshError.position > positionBound || meshError.texCoord > texCoordBound || meshError.normal > MAX_NORMAL_ERROR) {
+			return false;
+		}
+
+		mesh.packedVertices.swap(packed);
+		mesh.quantization = quantization;
+		error.position = std::max(error.position, meshError.position);
+		error.normal = std::max(error.normal, meshError.normal);
+		error.texCoord = std::max(error.texCoord, meshError.texCoord);
+		return true;
+	}
+}
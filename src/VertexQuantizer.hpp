@@ -0,0 +1,42 @@
+#ifndef VertexQuantizer_hpp
+#define VertexQuantizer_hpp
+
+#include "Mesh.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+// Largest differences between float vertices and their packed versions
+struct QuantizationError
+{
+    // object space units
+    float position;
+    // degrees
+    float normal;
+    float texCoord;
+
+    QuantizationError();
+};
+
+// Converts gps::Vertex (32 bytes) to gps::PackedVertex (16 bytes) and back, exactly as the shaders decode it
+class VertexQuantizer
+{
+public:
+    // Packs the float vertices of `mesh` into its packedVertices, positions relative to the given bounds
+    // (shared by all the meshes of a model, so vertices on mesh boundaries land on the same values).
+    // Decodes them again and keeps the float vertices instead if an error is over what 16 bits allow
+    static bool Quantize(MeshData& mesh, const glm::vec3& boundsMin, const glm::vec3& boundsMax, QuantizationError& error);
+
+    static PackedVertex Pack(const Vertex& vertex, const VertexQuantization& quantization);
+    static Vertex Unpack(const PackedVertex& vertex, const VertexQuantization& quantization);
+
+    // Octahedral mapping of a unit vector to [-1, 1]^2
+    static glm::vec2 EncodeOctahedral(const glm::vec3& normal);
+    static glm::vec3 DecodeOctahedral(const glm::vec2& encoded);
+};
+
+}
+
+#endif /* VertexQuantizer_hpp */
@@ -13,9 +13,15 @@
 #include "Shader.hpp"
 #include "Camera.hpp"
 #include "Model3D.hpp"
+#include "RenderQueue.hpp"
 #include "SkyBox.hpp"
+#include "SceneLoader.hpp"
+#include "UniformBuffers.hpp"
 
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
 
 // constants
 const int WINDOW_WIDTH = 1000;
@@ -31,10 +37,8 @@ GLFWwindow* glWindow = NULL;
 
 
 // matrices
-glm::mat4 model;
 glm::mat4 view;
 glm::mat4 projection;
-glm::mat3 normalMatrix;
 
 // light parameters
 glm::vec3 lightDir;
@@ -49,17 +53,22 @@ glm::vec3 pointLightPositions[4] = {
 };
 int directionalLightEnabled = 1;
 
-// shader uniform locations
-GLint modelLoc;
-GLint viewLoc;
-GLint projectionLoc;
-GLint normalMatrixLoc;
-GLint lightDirLoc;
-GLint lightColorLoc;
+// shader constants - the FrameBlock, and the ObjectBlock of every object, written once per frame
+enum SceneObject { OBJECT_SCENE, OBJECT_CARAVAN, OBJECT_CARAVAN2, OBJECT_MERCHANT, OBJECT_LANTERN, OBJECT_GHOST, OBJECT_LIGHT_CUBE, OBJECT_COUNT };
+std::unique_ptr<gps::UniformBuffers> uniformBuffers;
+gps::FrameUniforms frameUniforms;
+std::vector<gps::ObjectUniforms> objectUniforms(OBJECT_COUNT);
+// the draws of both passes, sorted once per frame
+gps::RenderQueue renderQueue;
+// name hashes of the sampler uniforms, looked up in the tables of the shaders
+static constexpr uint32_t SHADOW_MAP_UNIFORM = gps::UniformHash("shadowMap");
+static constexpr uint32_t DEPTH_MAP_UNIFORM = gps::UniformHash("depthMap");
+static constexpr uint32_t DIFFUSE_TEXTURE_UNIFORM = gps::UniformHash("diffuseTexture");
+static constexpr uint32_t SPECULAR_TEXTURE_UNIFORM = gps::UniformHash("specularTexture");
+static constexpr uint32_t DRAW_DATA_UNIFORM = gps::UniformHash("drawData");
 
 // fog
 int fog = 1;
-GLfloat fogLoc, fogSkyBoxLoc;
 
 // camera
 gps::Camera myCamera(
@@ -95,6 +104,17 @@ gps::SkyBox mySkyBoxDay;
 gps::SkyBox mySkyBox;
 gps::Shader skyBoxShader;
 
+// scene loading
+gps::SceneLoader sceneLoader;
+bool asyncLoad = true;
+double uploadBudget = 2.0;
+bool hotReload = false;
+
+// frame stats, printed every second while enabled
+bool showFrameStats = false;
+int statsFrames = 0;
+std::chrono::high_resolution_clock::time_point statsStart;
+
 
 GLuint shadowMapFBO;
 GLuint depthMapTexture;
@@ -177,15 +197,15 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
     }
     // Wireframe
     if (pressedKeys[GLFW_KEY_Z]) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        gps::GLStateCache::PolygonMode(GL_LINE);
     }
     // Point
     if (pressedKeys[GLFW_KEY_X]) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
+        gps::GLStateCache::PolygonMode(GL_POINT);
     }
     // Normal
     if (pressedKeys[GLFW_KEY_C]) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        gps::GLStateCache::PolygonMode(GL_FILL);
     }
     // Depth Map
     if (key == GLFW_KEY_V && action == GLFW_PRESS) {
@@ -199,24 +219,21 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
     if (key == GLFW_KEY_N && action == GLFW_RELEASE) {
         fog = 1 - fog;
         night = !night;
-
-        view = myCamera.getViewMatrix();
-        myCustomShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-        glUniform1i(fogLoc, fog);
-        skyBoxShader.useShaderProgram();
-        glUniform1i(fogSkyBoxLoc, fog);
+    }
+    // Frame stats
+    if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+        showFrameStats = !showFrameStats;
+        statsFrames = 0;
+        statsStart = std::chrono::high_resolution_clock::now();
+        gps::Model3D::ResetLodStats();
+        gps::Model3D::ResetClusterStats();
+        gps::GLStateCache::ResetStats();
+        gps::IndirectRenderer::ResetStats();
+        gps::RenderQueue::ResetStats();
     }
     // Toggle Directional Light
     if (key == GLFW_KEY_M && action == GLFW_RELEASE) {
         directionalLightEnabled = 1 - directionalLightEnabled;
-        myCustomShader.useShaderProgram();
-
-        glUniform1i(glGetUniformLocation(myCustomShader.shaderProgram, "directionalLightEnabled"), directionalLightEnabled);
-   
     }
     
 
@@ -251,12 +268,6 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
     pitch = glm::clamp(pitch - yDiff, -89.0f, 89.0f);
 
     myCamera.rotate(pitch, yaw);
-
-    view = myCamera.getViewMatrix();
-    myCustomShader.useShaderProgram();
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 }
 
 void presentScene() {
@@ -352,6 +363,7 @@ bool initOpenGLWindow()
     const GLubyte* version = glGetString(GL_VERSION);
     printf("Renderer: %s\n", renderer);
     printf("OpenGL version supported %s\n", version);
+    printf("Static models drawn with %s\n", gps::IndirectRenderer::IsMultiDrawSupported() ? "glMultiDrawElementsIndirect" : "a loop of indirect commands");
     glfwGetFramebufferSize(glWindow, &retina_width, &retina_height);
 
     return true;
@@ -362,7 +374,7 @@ void initOpenGLState() {
 	glViewport(0, 0, retina_width, retina_height);
     glEnable(GL_FRAMEBUFFER_SRGB);
 	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS);
+	gps::GLStateCache::DepthFunc(GL_LESS);
 	glCullFace(GL_BACK);
 	glFrontFace(GL_CCW); 
 }
@@ -378,33 +390,110 @@ void initSkyBox()
     faces.push_back("skybox/skyboxDay/posz.jpg");
     faces.push_back("skybox/skyboxDay/negz.jpg");
 
-    mySkyBox.Load(faces);
+    sceneLoader.AddSkyBox(&mySkyBox, faces);
     skyBoxShader.loadShader("shaders/skyboxShader.vert", "shaders/skyboxShader.frag");
 }
 
 void renderSkyBox() {
-    glDepthMask(GL_FALSE);
-    skyBoxShader.useShaderProgram();
+    gps::GLStateCache::DepthMask(GL_FALSE);
+    mySkyBox.Draw(skyBoxShader);
 
-    glm::mat4 viewMatrix = glm::mat4(glm::mat3(myCamera.getViewMatrix()));
-    glUniformMatrix4fv(glGetUniformLocation(skyBoxShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(viewMatrix));
-    glUniformMatrix4fv(glGetUniformLocation(skyBoxShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-    mySkyBox.Draw(skyBoxShader, view, projection);
+    gps::GLStateCache::DepthMask(GL_TRUE);
+}
 
-    glDepthMask(GL_TRUE);
+void printLoadStats(std::chrono::high_resolution_clock::time_point start) {
+    gps::AssetManager::Get().PrintStats();
+    gps::GeometryArena::PrintStats();
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    std::cout << "Models loaded in " << elapsed.count() << " ms"
+        << (gps::MeshCache::enabled ? "" : " (mesh cache disabled)") << std::endl;
+}
+
+void printFrameStats() {
+    statsFrames++;
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - statsStart;
+    if (!showFrameStats || elapsed.count() < 1000.0) {
+        return;
+    }
+
+    // per frame averages, shadow and main pass together
+    const gps::Model3D::LodStats& stats = gps::Model3D::GetLodStats();
+    std::cout << "Frame stats    : " << elapsed.count() / statsFrames << " ms/frame, LOD bias " << gps::Model3D::lodBias << std::endl;
+    for (size_t lod = 0; lod < gps::Mesh::MAX_LODS; lod++) {
+        std::cout << "  LOD" << lod << " : " << stats.draws[lod] / statsFrames << " draws, "
+            << stats.triangles[lod] / statsFrames << " triangles" << std::endl;
+    }
+
+    const char* names[] = { "scene", "caravan", "caravan2", "merchant", "lantern", "ghost" };
+    gps::Model3D* models[] = { &staticScene, &caravan, &caravan2, &merchant, &lantern, &ghost };
+    std::cout << "  LOD drawn :";
+    for (int i = 0; i < 6; i++) {
+        int finest, coarsest;
+        models[i]->GetDrawnLods(finest, coarsest);
+        std::cout << " " << names[i] << " " << finest;
+        if (coarsest != finest) {
+            std::cout << "-" << coarsest;
+        }
+    }
+    std::cout << std::endl;
+
+    const gps::Model3D::ClusterStats& clusters = gps::Model3D::GetClusterStats();
+    std::cout << "  meshlets  : " << clusters.clusters / statsFrames << ", culled " << clusters.outside / statsFrames
+        << " outside + " << clusters.backfacing / statsFrames << " backfacing (" << clusters.culledTriangles / statsFrames
+        << " triangles)" << std::endl;
+
+    // issued / skipped because the state was already set
+    const gps::GLStateCache::Stats& state = gps::GLStateCache::GetStats();
+    std::cout << "  GL state  :";
+    for (int kind = 0; kind < gps::GLStateCache::KINDS; kind++) {
+        std::cout << (kind > 0 ? ", " : " ") << gps::GLStateCache::GetKindName((gps::GLStateCache::Kind)kind) << " "
+            << state.issued[kind] / statsFrames << "/" << state.skipped[kind] / statsFrames;
+    }
+    std::cout << " (issued/skipped)" << std::endl;
+
+    const gps::IndirectRenderer::Stats& indirect = gps::IndirectRenderer::GetStats();
+    std::cout << "  indirect  : " << indirect.commands / statsFrames << " commands in " << indirect.multiDraws / statsFrames
+        << " multi-draws + " << indirect.draws / statsFrames << " single draws" << std::endl;
+
+    const gps::RenderQueue::Stats& queue = gps::RenderQueue::GetStats();
+    std::cout << "  queue     : " << queue.items / statsFrames << " items, " << queue.programChanges / statsFrames
+        << " program / " << queue.materialChanges / statsFrames << " material / " << queue.objectChanges / statsFrames
+        << " object changes" << std::endl;
+
+    statsFrames = 0;
+    statsStart = std::chrono::high_resolution_clock::now();
+    gps::Model3D::ResetLodStats();
+    gps::Model3D::ResetClusterStats();
+    gps::GLStateCache::ResetStats();
+    gps::IndirectRenderer::ResetStats();
+    gps::RenderQueue::ResetStats();
 }
 
 void initModels() {
     initSkyBox();
  
-    caravan.LoadModel("models/caravan/caravan.obj");
-    caravan2.LoadModel("models/caravan/caravan.obj");
-    merchant.LoadModel("models/merchant/merchant.obj");
-    lantern.LoadModel("models/lantern/lantern.obj");
-    quad.LoadModel("models/quad/quad.obj");
-    staticScene.LoadModel("models/scene/staticScene.obj");
-    ghost.LoadModel("models/ghost/ghost.obj");
-   
+    // the big static scene first, so it appears right after the sky box
+    sceneLoader.AddModel(&staticScene, "models/scene/staticScene.obj");
+    sceneLoader.AddModel(&caravan, "models/caravan/caravan.obj");
+    sceneLoader.AddModel(&caravan2, "models/caravan/caravan.obj");
+    sceneLoader.AddModel(&merchant, "models/merchant/merchant.obj");
+    sceneLoader.AddModel(&lantern, "models/lantern/lantern.obj");
+    sceneLoader.AddModel(&quad, "models/quad/quad.obj");
+    sceneLoader.AddModel(&ghost, "models/ghost/ghost.obj");
+
+    if (hotReload) {
+        sceneLoader.WatchForChanges("models");
+    }
+
+    if (asyncLoad) {
+        sceneLoader.Start(uploadBudget);
+        return;
+    }
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    sceneLoader.LoadAll();
+    printLoadStats(start);
 }
 
 void initShaders() {
@@ -416,77 +505,44 @@ void initShaders() {
 }
 
 void initUniforms() {
-    myCustomShader.useShaderProgram();
-
-    // === Model Matrix ===
-    model = glm::rotate(glm::mat4(1.0f), glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    modelLoc = glGetUniformLocation(myCustomShader.shaderProgram, "model");
+    // === Uniform Blocks === - the constants of every shader but the screen quad
+    uniformBuffers.reset(new gps::UniformBuffers(OBJECT_COUNT));
+    gps::UniformBuffers::BindBlocks(myCustomShader);
+    gps::UniformBuffers::BindBlocks(lightShader);
+    gps::UniformBuffers::BindBlocks(depthMapShader);
+    gps::UniformBuffers::BindBlocks(skyBoxShader);
 
     // === View Matrix ===
     view = myCamera.getViewMatrix();
-    viewLoc = glGetUniformLocation(myCustomShader.shaderProgram, "view");
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-
-    // === Normal Matrix ===
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-    normalMatrixLoc = glGetUniformLocation(myCustomShader.shaderProgram, "normalMatrix");
 
     // === Projection Matrix ===
     projection = glm::perspective(glm::radians(90.0f), (float)retina_width / (float)retina_height, 0.1f, 1000.0f); //!
-    projectionLoc = glGetUniformLocation(myCustomShader.shaderProgram, "projection");
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
     // === Light Direction ===
     lightDir = glm::vec3(0.0f, 1.0f, 1.0f);
-    lightDirLoc = glGetUniformLocation(myCustomShader.shaderProgram, "lightDir");
-    glUniform3fv(lightDirLoc, 1, glm::value_ptr(lightDir));
 
     // === Light Color ===
     lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
-    lightColorLoc = glGetUniformLocation(myCustomShader.shaderProgram, "lightColor");
-    glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
 
-    // === Light Shader Projection Matrix ===
-    lightShader.useShaderProgram();
-    glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-
-    // === Fog ===
+    // === Texture Arrays === - a fixed unit per type, the meshes only change the bound arrays and layers
+    myCustomShader.SetUniform(myCustomShader.GetUniform(DIFFUSE_TEXTURE_UNIFORM), gps::Mesh::GetTextureUnit("diffuseTexture"));
+    myCustomShader.SetUniform(myCustomShader.GetUniform(SPECULAR_TEXTURE_UNIFORM), gps::Mesh::GetTextureUnit("specularTexture"));
+    myCustomShader.SetUniform(myCustomShader.GetUniform(DRAW_DATA_UNIFORM), gps::IndirectRenderer::DRAW_DATA_UNIT);
+    depthMapShader.SetUniform(depthMapShader.GetUniform(DRAW_DATA_UNIFORM), gps::IndirectRenderer::DRAW_DATA_UNIT);
     myCustomShader.useShaderProgram();
-    fogLoc = glGetUniformLocation(myCustomShader.shaderProgram, "fog");
-    glUniform1i(fogLoc, fog);
-
-
-    // === Point Lights ===
-    for (int i = 0; i < 4; i++) {
-        std::string index = std::to_string(i);
-
-        GLuint positionLoc = glGetUniformLocation(myCustomShader.shaderProgram, ("pointLights[" + index + "].position").c_str());
-        glUniform3fv(positionLoc, 1, glm::value_ptr(pointLightPositions[i]));
-
-        GLuint constantLoc = glGetUniformLocation(myCustomShader.shaderProgram, ("pointLights[" + index + "].constant").c_str());
-        glUniform1f(constantLoc, 1.0f);
 
-        GLuint linearLoc = glGetUniformLocation(myCustomShader.shaderProgram, ("pointLights[" + index + "].linear").c_str());
-        glUniform1f(linearLoc, 0.09f);
 
-        GLuint quadraticLoc = glGetUniformLocation(myCustomShader.shaderProgram, ("pointLights[" + index + "].quadratic").c_str());
-        glUniform1f(quadraticLoc, 0.032f);
-
-        GLuint ambientLoc = glGetUniformLocation(myCustomShader.shaderProgram, ("pointLights[" + index + "].ambient").c_str());
-        glUniform3fv(ambientLoc, 1, glm::value_ptr(glm::vec3(0.3f, 0.3f, 0.1f)));
-
-        GLuint diffuseLoc = glGetUniformLocation(myCustomShader.shaderProgram, ("pointLights[" + index + "].diffuse").c_str());
-        glUniform3fv(diffuseLoc, 1, glm::value_ptr(glm::vec3(0.8f, 0.8f, 0.8f)));
-
-        GLuint specularLoc = glGetUniformLocation(myCustomShader.shaderProgram, ("pointLights[" + index + "].specular").c_str());
-        glUniform3fv(specularLoc, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 1.0f)));
+    // === Point Lights === - they do not move, but go with the rest of the FrameBlock
+    for (int i = 0; i < gps::FrameUniforms::POINT_LIGHTS; i++) {
+        gps::PointLightUniforms& light = frameUniforms.pointLights[i];
+        light.position = pointLightPositions[i];
+        light.constant = 1.0f;
+        light.linear = 0.09f;
+        light.quadratic = 0.032f;
+        light.ambient = glm::vec3(0.3f, 0.3f, 0.1f);
+        light.diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+        light.specular = glm::vec3(1.0f, 1.0f, 1.0f);
     }
-
-    // === SkyBox ===
-    skyBoxShader.useShaderProgram();
-    fogSkyBoxLoc = glGetUniformLocation(skyBoxShader.shaderProgram, "fog");
-    glUniform1i(fogSkyBoxLoc, fog);
-
 }
 
 void initFBO() {
@@ -519,71 +575,52 @@ glm::mat4 computeLightSpaceTrMatrix() {
     return lightSpaceTrMatrix;
 }
 
-void renderModels(gps::Shader shader, bool depthPass) {
-    shader.useShaderProgram();
-    //send normal to shader
-    if (!depthPass) {
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-    }
+// Advances the animations and writes the constants of both passes - one buffer write for the frame block
+// and one for the objects
+void updateUniforms() {
+    view = myCamera.getViewMatrix();
+    lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
 
-    // fog / night color and shader
-    if (fog == 1) {
-        myCustomShader.useShaderProgram(); 
-        lightColor = glm::vec3(0.05f, 0.05f, 0.1f); 
-    } else {
-        myCustomShader.useShaderProgram(); 
-        lightColor = glm::vec3(1.0f, 1.0f, 1.0f); 
-    }
-    glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
+    // fog / night color
+    lightColor = fog == 1 ? glm::vec3(0.05f, 0.05f, 0.1f) : glm::vec3(1.0f, 1.0f, 1.0f);
 
-    // === Render Static Scene ===
-    shader.useShaderProgram();
-    staticScene.Draw(shader); 
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+    frameUniforms.view = view;
+    frameUniforms.projection = projection;
+    frameUniforms.lightSpaceTrMatrix = computeLightSpaceTrMatrix();
+    frameUniforms.lightDir = glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir;
+    frameUniforms.fog = fog;
+    frameUniforms.lightColor = lightColor;
+    frameUniforms.directionalLightEnabled = directionalLightEnabled;
 
-    if (!depthPass) {
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-    }
+    // === Static Scene ===
+    objectUniforms[OBJECT_SCENE].Set(glm::mat4(1.0f), view);
 
-    // === Render Caravan 1 ===
+    // === Caravan 1 ===
     //movement logic for caravans
-    caravan_x += (caravan_inc ? 0.01f : -0.01f);
-    caravan_y += (caravan_inc ? 0.01f : -0.01f);
+    caravan_x += (caravan_inc ? 0.02f : -0.02f);
+    caravan_y += (caravan_inc ? 0.02f : -0.02f);
 
     //reverse direction
     if (caravan_x >= 10.0f || caravan_x <= 0.0f) {
         	caravan_inc = !caravan_inc;
     }
 
-    model = glm::mat4(1.0f);
+    glm::mat4 model = glm::mat4(1.0f);
     //the caravans float if it's night
     model = glm::translate(model, glm::vec3(-40.5f, night ? 1.5f : -8.5f, -19.0f));
     model = glm::translate(model, glm::vec3(caravan_x, 0.0f, -caravan_y));
+    objectUniforms[OBJECT_CARAVAN].Set(model, view);
 
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-    if (!depthPass) {
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-    }
-    caravan.Draw(shader);
-
-    // === Render Caravan 2 ===
+    // === Caravan 2 ===
     model = glm::mat4(1.0f);  // Reset the model matrix
     model = glm::translate(model, glm::vec3(4.0f, night ? 1.5f : -8.5f, -13.0f));
     model = glm::translate(model, glm::vec3(-caravan_x, 0.0f, caravan_y));
     //model = glm::rotate(model, glm::radians(-1.5f * angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-    if (!depthPass) {
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-    }
-    caravan2.Draw(shader);
+    objectUniforms[OBJECT_CARAVAN2].Set(model, view);
 
-    // === Render Merchant ===
-    merchant_x += (merchant_inc ? 0.01f : -0.01f);
-    merchant_y += (merchant_inc ? 0.01f : -0.01f);
+    // === Merchant ===
+    merchant_x += (merchant_inc ? 0.02f : -0.02f);
+    merchant_y += (merchant_inc ? 0.02f : -0.02f);
 
     //reverse direction
     if (merchant_x >= 10.0f || merchant_x <= 0.0f) {
@@ -592,62 +629,73 @@ void renderModels(gps::Shader shader, bool depthPass) {
     model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(74.0f, night ? 5.0f : -1.0f, -8.0f));
     model = glm::translate(model, glm::vec3(0.0f, 0.0f, merchant_y));
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-    if (!depthPass) {
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-    }
-    merchant.Draw(shader);
+    objectUniforms[OBJECT_MERCHANT].Set(model, view);
 
-    // === Render Lantern ===
+    // === Lantern ===
     model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(-20.0f, -8.0f, 0.0f));
     model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));  // Rotate model
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-    if (!depthPass) {
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-    }
-    lantern.Draw(shader);
-
-    // === Render Ghost ===
-    if (night){
-        model = glm::mat4(1.0f);  // Reset the model matrix
-        model = glm::translate(model, glm::vec3(10.0f, 4.5f, 0.0f));
-        model = glm::translate(model, glm::vec3(caravan_x, 0.0f, caravan_y));
-        model = glm::rotate(model, glm::radians(3.0f * angle), glm::vec3(0.0f, 1.0f, 0.0f));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        if (!depthPass) {
-            normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-            glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-        }
-        ghost.Draw(shader);
-    }
-   
+    objectUniforms[OBJECT_LANTERN].Set(model, view);
 
-    //reset
-    model = glm::mat4(1.0f);
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+    // === Ghost ===
+    model = glm::mat4(1.0f);  // Reset the model matrix
+    model = glm::translate(model, glm::vec3(10.0f, 4.5f, 0.0f));
+    model = glm::translate(model, glm::vec3(caravan_x, 0.0f, caravan_y));
+    model = glm::rotate(model, glm::radians(3.0f * angle), glm::vec3(0.0f, 1.0f, 0.0f));
+    objectUniforms[OBJECT_GHOST].Set(model, view);
 
+    // === Light Cube ===
+    model = glm::translate(lightRotation, 100.0f * lightDir);
+    objectUniforms[OBJECT_LIGHT_CUBE].Set(model, view);
 
+    uniformBuffers->Update(frameUniforms, objectUniforms);
+}
+
+// Adds the models to `pass`, sorted by their distance from `eye` (see gps::RenderQueue::Add)
+void queueModels(gps::RenderQueue::Pass pass, const gps::Shader& shader, const glm::vec4& eye) {
+    // the static models go through their indirect command lists, as one item each
+    renderQueue.Add(pass, shader, staticScene, OBJECT_SCENE, objectUniforms[OBJECT_SCENE].model, eye, true);
+    renderQueue.Add(pass, shader, caravan, OBJECT_CARAVAN, objectUniforms[OBJECT_CARAVAN].model, eye, false);
+    renderQueue.Add(pass, shader, caravan2, OBJECT_CARAVAN2, objectUniforms[OBJECT_CARAVAN2].model, eye, false);
+    renderQueue.Add(pass, shader, merchant, OBJECT_MERCHANT, objectUniforms[OBJECT_MERCHANT].model, eye, false);
+    renderQueue.Add(pass, shader, lantern, OBJECT_LANTERN, objectUniforms[OBJECT_LANTERN].model, eye, true);
+    if (night) {
+        renderQueue.Add(pass, shader, ghost, OBJECT_GHOST, objectUniforms[OBJECT_GHOST].model, eye, false);
+    }
 }
 
 void renderScene() {
-    depthMapShader.useShaderProgram();
-    glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "lightSpaceTrMatrix"), 1, GL_FALSE, glm::value_ptr(computeLightSpaceTrMatrix()));
+    // the uploads since the last frame bound textures and vertex arrays behind the back of the cache
+    gps::GLStateCache::Invalidate();
+    updateUniforms();
+
+    // the shadow map looks from the light towards the origin - orthographic
+    glm::vec4 lightEye = glm::vec4(-glm::normalize(glm::mat3(lightRotation) * lightDir), 0.0f);
+    glm::vec4 cameraEye = glm::inverse(view)[3];
+    renderQueue.Clear();
+    queueModels(gps::RenderQueue::SHADOW_PASS, depthMapShader, lightEye);
+    if (!showDepthMap) {
+        queueModels(gps::RenderQueue::OPAQUE_PASS, myCustomShader, cameraEye);
+    }
+    renderQueue.Sort();
+
+    // both passes draw the levels of detail the camera needs
+    gps::Model3D::SetLodView(view, projection, retina_height);
+    // the shadow map culls against the light
+    gps::Model3D::SetCullView(frameUniforms.lightSpaceTrMatrix, lightEye);
+
     glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
     glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
     glClear(GL_DEPTH_BUFFER_BIT);
-    renderModels(depthMapShader, true);
+    renderQueue.Submit(gps::RenderQueue::SHADOW_PASS, *uniformBuffers);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     if (showDepthMap) {
         glViewport(0, 0, retina_width, retina_height);
         glClear(GL_COLOR_BUFFER_BIT);
         screenQuadShader.useShaderProgram();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-        glUniform1i(glGetUniformLocation(screenQuadShader.shaderProgram, "depthMap"), 0);
+        gps::GLStateCache::BindTexture(0, GL_TEXTURE_2D, depthMapTexture);
+        screenQuadShader.SetUniform(screenQuadShader.GetUniform(DEPTH_MAP_UNIFORM), 0);
         glDisable(GL_DEPTH_TEST);
         quad.Draw(screenQuadShader);
         glEnable(GL_DEPTH_TEST);
@@ -656,43 +704,43 @@ void renderScene() {
         glViewport(0, 0, retina_width, retina_height);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        myCustomShader.useShaderProgram();
-        view = myCamera.getViewMatrix();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+        gps::Model3D::SetCullView(projection * view, cameraEye);
 
-        //light logic
-        lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-        glUniform3fv(lightDirLoc, 1, glm::value_ptr(glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir));
-        
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-        glUniform1i(glGetUniformLocation(myCustomShader.shaderProgram, "shadowMap"), 3);
-        glUniformMatrix4fv(glGetUniformLocation(myCustomShader.shaderProgram, "lightSpaceTrMatrix"), 1, GL_FALSE, glm::value_ptr(computeLightSpaceTrMatrix()));
+        gps::GLStateCache::BindTexture(3, GL_TEXTURE_2D, depthMapTexture);
+        myCustomShader.SetUniform(myCustomShader.GetUniform(SHADOW_MAP_UNIFORM), 3);
 
         //models
-        renderModels(myCustomShader, false);
+        renderQueue.Submit(gps::RenderQueue::OPAQUE_PASS, *uniformBuffers);
 
         //light source
         lightShader.useShaderProgram();
-        glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        model = lightRotation;
-        model = glm::translate(model,100.0f * lightDir);
-        glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+        uniformBuffers->BindObject(OBJECT_LIGHT_CUBE);
 
         //skybox
-        mySkyBox.Draw(skyBoxShader, view, projection);
+        mySkyBox.Draw(skyBoxShader);
         
         if (present) {
             presentScene();
         }
     }
     angle += 0.1f;
+    // after the last draw reading this frame's slot of the ring
+    uniformBuffers->EndFrame();
 }
 
 void cleanup() {
+    // the loader threads use the shared pool and the uploader its buffers in the GL context
+    sceneLoader.Stop();
     glDeleteTextures(1, &depthMapTexture);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glDeleteFramebuffers(1, &shadowMapFBO);
+    // the models are globals, destroyed after glfwTerminate - their GL objects go while the context is current
+    gps::Model3D* models[] = { &caravan, &caravan2, &merchant, &quad, &staticScene, &rustyFerrisWheel, &lantern, &ghost };
+    for (size_t i = 0; i < sizeof(models) / sizeof(models[0]); i++) {
+        models[i]->Release();
+    }
+    uniformBuffers.reset();
+    gps::GeometryArena::Destroy();
     glfwDestroyWindow(glWindow);
     //cleanup code for your own data
     glfwTerminate();
@@ -700,6 +748,41 @@ void cleanup() {
 
 int main(int argc, const char * argv[]) {
 
+    // --no-mesh-cache always parses the .obj files, to compare against cached startup
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--no-mesh-cache") {
+            gps::MeshCache::enabled = false;
+        }
+        // --no-compressed-textures decodes the source images even when .ktx2 versions exist
+        else if (std::string(argv[i]) == "--no-compressed-textures") {
+            gps::Model3D::compressedTextures = false;
+        }
+        // --float-vertices uploads the 32-byte float vertices instead of the 16-byte packed ones
+        else if (std::string(argv[i]) == "--float-vertices") {
+            gps::Model3D::quantizedVertices = false;
+        }
+        // --sync-load loads the whole scene before the first frame
+        else if (std::string(argv[i]) == "--sync-load") {
+            asyncLoad = false;
+        }
+        // --upload-budget <ms> bounds the GPU uploads of the progressive load per frame
+        else if (std::string(argv[i]) == "--upload-budget" && i + 1 < argc) {
+            uploadBudget = atof(argv[++i]);
+        }
+        // --lod-bias <x> switches to coarser levels of detail x times earlier, 0 keeps full detail
+        else if (std::string(argv[i]) == "--lod-bias" && i + 1 < argc) {
+            gps::Model3D::lodBias = (float)atof(argv[++i]);
+        }
+        // --no-cluster-culling draws the full detail meshes whole instead of culling their meshlets
+        else if (std::string(argv[i]) == "--no-cluster-culling") {
+            gps::Model3D::clusterCulling = false;
+        }
+        // --hot-reload reloads the models and textures written under models/ while the scene runs
+        else if (std::string(argv[i]) == "--hot-reload") {
+            hotReload = true;
+        }
+    }
+
     try {
         initOpenGLWindow();
     } catch (const std::exception& e) {
@@ -707,6 +790,7 @@ int main(int argc, const char * argv[]) {
         return EXIT_FAILURE;
     }
 
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
     initOpenGLState();
 	initModels();
 	initShaders();
@@ -714,12 +798,28 @@ int main(int argc, const char * argv[]) {
 	initUniforms();
     glCheckError();
 
+    bool firstFrame = true;
+    bool loading = asyncLoad;
+
 	// application loop
     while (!glfwWindowShouldClose(glWindow)) {
+        // once loaded, Update swaps in the hot reloads instead
+        if (sceneLoader.Update() && loading) {
+            loading = false;
+            printLoadStats(start);
+        }
+
         processMovement();
         renderScene();
+        printFrameStats();
         glfwPollEvents();
         glfwSwapBuffers(glWindow);
+
+        if (firstFrame) {
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+            std::cout << "First frame after " << elapsed.count() << " ms" << std::endl;
+            firstFrame = false;
+        }
     }
 	cleanup();
     return EXIT_SUCCESS;
@@ -0,0 +1,158 @@
+//
+//  TextureConverter.cpp
+//
+//  Converts model textures to block-compressed KTX2 files with a full mip chain, which
+//  Model3D loads instead of the source image when they are present ("foo.png" -> "foo.ktx2").
+//  Opaque images become BC1, images with alpha BC3, both sRGB. Each level is decoded again
+//  on the CPU to report its PSNR against the source, and --verify reads the written file back.
+//
+//  Build (from the repository root):
+//    g++ -O2 -std=c++11 -Isrc tools/TextureConverter.cpp src/TextureCompressor.cpp src/ImageProcessing.cpp src/Ktx2File.cpp src/stb_image.cpp -o textureConverter
+//  Run:
+//    textureConverter [--verify] [--bc1|--bc3] models/caravan/*.png
+//
+
+#include "ImageProcessing.hpp"
+#include "Ktx2File.hpp"
+#include "TextureCompressor.hpp"
+#include "stb_image.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static std::string outputPath(std::string path)
+{
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return path + ".ktx2";
+    }
+    return path.substr(0, dot) + ".ktx2";
+}
+
+static bool convert(std::string path, int forcedFormat, bool verify, double& sourceBytes, double& compressedBytes)
+{
+    int width, height, channels;
+    // stored bottom row first, like the textures Model3D decodes with stbi_set_flip_vertically_on_load
+    stbi_set_flip_vertically_on_load(1);
+    unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &channels, 4);
+    if (!pixels) {
+        fprintf(stderr, "ERROR: could not load %s\n", path.c_str());
+        return false;
+    }
+
+    gps::TextureCompressor::Format format = gps::TextureCompressor::HasAlpha(pixels, width, height) ?
+        gps::TextureCompressor::BC3 : gps::TextureCompressor::BC1;
+    if (forcedFormat >= 0) {
+        format = (gps::TextureCompressor::Format)forcedFormat;
+    }
+
+    gps::Ktx2File ktx;
+    ktx.vkFormat = format == gps::TextureCompressor::BC1 ?
+        gps::Ktx2File::VK_FORMAT_BC1_RGB_SRGB_BLOCK : gps::Ktx2File::VK_FORMAT_BC3_SRGB_BLOCK;
+    ktx.width = width;
+    ktx.height = height;
+    ktx.orientation = "ru";
+
+    // RGBA8 with a runtime generated mip chain is what the GPU held before
+    std::vector<unsigned char> level(pixels, pixels + (size_t)width * height * 4);
+    stbi_image_free(pixels);
+    double uncompressed = 0.0;
+    double worstPSNR = 1e30;
+    int w = width;
+    int h = height;
+    while (true) {
+        ktx.levels.push_back(gps::TextureCompressor::Compress(level.data(), w, h, format));
+        uncompressed += (double)w * h * 4;
+
+        std::vector<unsigned char> decoded((size_t)w * h * 4);
+        gps::TextureCompressor::Decompress(ktx.levels.back().data(), w, h, format, decoded.data());
+        double psnr = gps::TextureCompressor::PSNR(level.data(), decoded.data(), w, h, format == gps::TextureCompressor::BC3);
+        if (ktx.levels.size() == 1) {
+            printf("%s: %dx%d %s, level 0 PSNR %.2f dB", path.c_str(), width, height,
+                format == gps::TextureCompressor::BC1 ? "BC1" : "BC3", psnr);
+        }
+        if (psnr < worstPSNR) {
+            worstPSNR = psnr;
+        }
+
+        if (w == 1 && h == 1) {
+            break;
+        }
+        int nextW = w > 1 ? w / 2 : 1;
+        int nextH = h > 1 ? h / 2 : 1;
+        std::vector<unsigned char> next((size_t)nextW * nextH * 4);
+        gps::ImageProcessing::DownsampleSRGB(level.data(), w, h, next.data());
+        level.swap(next);
+        w = nextW;
+        h = nextH;
+    }
+
+    double compressed = 0.0;
+    for (size_t i = 0; i < ktx.levels.size(); i++) {
+        compressed += (double)ktx.levels[i].size();
+    }
+    printf(", worst level %.2f dB, %zu levels, %.2f MB -> %.2f MB\n", worstPSNR, ktx.levels.size(),
+        uncompressed / (1024.0 * 1024.0), compressed / (1024.0 * 1024.0));
+
+    std::string output = outputPath(path);
+    if (!ktx.Write(output)) {
+        return false;
+    }
+
+    if (verify) {
+        gps::Ktx2File reread;
+        bool same = reread.Read(output) && reread.vkFormat == ktx.vkFormat && reread.width == ktx.width &&
+            reread.height == ktx.height && reread.orientation == ktx.orientation && reread.levels == ktx.levels;
+        printf("  %s: %s\n", output.c_str(), same ? "verified" : "MISMATCH");
+        if (!same) {
+            return false;
+        }
+    }
+
+    sourceBytes += uncompressed;
+    compressedBytes += compressed;
+    return true;
+}
+
+int main(int argc, const char* argv[])
+{
+    bool verify = false;
+    int forcedFormat = -1;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--verify") == 0) {
+            verify = true;
+        }
+        else if (strcmp(argv[i], "--bc1") == 0) {
+            forcedFormat = gps::TextureCompressor::BC1;
+        }
+        else if (strcmp(argv[i], "--bc3") == 0) {
+            forcedFormat = gps::TextureCompressor::BC3;
+        }
+        else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.empty()) {
+        fprintf(stderr, "usage: %s [--verify] [--bc1|--bc3] image...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    double sourceBytes = 0.0;
+    double compressedBytes = 0.0;
+    int failed = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!convert(files[i], forcedFormat, verify, sourceBytes, compressedBytes)) {
+            failed++;
+        }
+    }
+
+    printf("VRAM: %.2f MB as RGBA8 -> %.2f MB compressed (%.2f MB saved)\n", sourceBytes / (1024.0 * 1024.0),
+        compressedBytes / (1024.0 * 1024.0), (sourceBytes - compressedBytes) / (1024.0 * 1024.0));
+
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}